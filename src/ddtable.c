@@ -5,7 +5,8 @@
 #endif
 
 #include "libddtable.h"
-#include "spooky-c.h"
+#include "ddtable_internal.h"
+#include "ddtable_trace.h"
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -14,49 +15,46 @@
 #include <stdint.h>
 #include <inttypes.h>
 
-struct ddtable
-{
-    //! Absolute number of key-value pairs
-    uint_fast32_t num_kv_pairs;
-    //! Internal size used for hashing
-    uint_fast32_t size;
-    //! Fast-checker for key existence
-    char* ddtable_RESTRICT exists;     
-    //! Single-alloc array for kv pairs
-    double key_vals[];
-};
-
-//! Default NULL value (not a value) for our table
-#define DDTABLE_NULL_VAL 0
-
-//! Checks if x is a power of 2
-#define IS_POW2(x) ((x != 0) && ((x & (~x + 1)) == x))
-
-//! Enforces size must be power of 2 minus 1 (i.e. use & instead of %)
-#ifndef DDTABLE_ENFORCE_POW2
-#define DDTABLE_ENFORCE_POW2 1
+//! Records an operation if tracing was compiled in and enabled for the table
+#ifdef DDTABLE_TRACE
+#define DD_TRACE(ddtable, op, key) \
+    do { if ((ddtable)->traced) ddtable_trace_record((op), (key)); } while (0)
+#else
+#define DD_TRACE(ddtable, op, key) ((void) 0)
 #endif
 
-//! Sets the seed we pass to spooky
-#ifndef SPOOKY_HASH_SEED
-#define SPOOKY_HASH_SEED 0
+//! Default front cache footprint, small enough to stay resident in L1
+#ifndef DDTABLE_CACHE_DEFAULT_BYTES
+#define DDTABLE_CACHE_DEFAULT_BYTES 4096
 #endif
 
+//! Stores a pair in slot indx of a hashed scalar table; 1 if it is taken
+static inline int dd_set_at(ddtable_t ddtable, const uint64_t indx,
+                            const double key, const double val)
+{
+    uint8_t* exists = dd_exists(ddtable);
+
+    if (exists[indx] == ddtable->generation)
+    {
+        return 1; // Collision
+    } else {
+        dd_touch_slot(ddtable, indx);
+        exists[indx] = ddtable->generation;
+        ddtable->key_vals[2 * indx] = key;
+        ddtable->key_vals[(2 * indx) + 1] = val;
+        return 0;
+    }
+}
 
-// TODO: Support other hash functions?
-//! Hash function using spooky 64-bit hash
-static inline uint_fast32_t dd_hash(const double key, const uint_fast32_t size)
+//! Stores a pair in a hashed scalar table; 1 if the key's slot is taken
+static inline int dd_set_hashed(ddtable_t ddtable, const double key,
+                                const double val)
 {
-    #if DDTABLE_ENFORCE_POW2
-    // Can use faster & instead of % if we enforce power of 2 size.
-    return spooky_hash64(&key, sizeof(double), SPOOKY_HASH_SEED) & size;
-    #else
-    return spooky_hash64(&key, sizeof(double), SPOOKY_HASH_SEED) % size;
-    #endif
+    return dd_set_at(ddtable, dd_hash(key, ddtable), key, val);
 }
 
 //! Gets the next power of two from the given number (e.g. 30 -> 32)
-static uint_fast32_t next_power_of_two(uint_fast32_t n)
+static uint64_t next_power_of_two(uint64_t n)
 {
     n--;
     n |= n >> 1;
@@ -64,84 +62,754 @@ static uint_fast32_t next_power_of_two(uint_fast32_t n)
     n |= n >> 4;
     n |= n >> 8;
     n |= n >> 16;
+    n |= n >> 32;
     n++;
     return n;
 }
 
-ddtable_t ddtable_new(const uint_fast32_t num_keys)
+//! Slot counts for a table asked to hold num_keys keys
+static void dd_table_dims(const uint64_t num_keys,
+                          uint64_t* ht_size, uint64_t* ht_num_kv_pairs)
 {
     // Set the absolute number of key-value pairs, and also
     // set the internal size depending on whether we enforce
     // "power of 2"-sized tables.
 #if DDTABLE_ENFORCE_POW2
     // This minus one trick is necessary for &: http://goo.gl/FlcEb0
-    const uint_fast32_t ht_size = next_power_of_two(num_keys) - 1;
-    const uint_fast32_t ht_num_kv_pairs = ht_size + 1;
+    *ht_size = next_power_of_two(num_keys) - 1;
+    *ht_num_kv_pairs = *ht_size + 1;
 #else
-    const uint_fast32_t ht_size = num_keys;
-    const uint_fast32_t ht_num_kv_pairs = num_keys;
+    *ht_size = num_keys;
+    *ht_num_kv_pairs = num_keys;
 #endif
+}
+
+size_t dd_table_bytes(const uint64_t num_keys, const uint32_t key_width,
+                      const uint32_t val_width)
+{
+    uint64_t ht_size, ht_num_kv_pairs;
+    dd_table_dims(num_keys, &ht_size, &ht_num_kv_pairs);
 
-    ddtable_t new_ht = malloc(sizeof(struct ddtable) +
-                              (sizeof(double) * ht_num_kv_pairs * 2));
-    assert(new_ht);
-    new_ht->size = ht_size;
-    new_ht->num_kv_pairs = ht_num_kv_pairs;
+    // Refuse requests whose byte size can't be represented (e.g. more than
+    // 2^63 keys, or more than 4GB worth on a 32-bit size_t)
+    const size_t slot_bytes = (dd_stride(key_width, val_width) *
+                               sizeof(double)) + sizeof(uint8_t);
+    if (ht_num_kv_pairs == 0 || key_width == 0 ||
+        ht_num_kv_pairs > (SIZE_MAX - sizeof(struct ddtable)) / slot_bytes)
+    {
+        return 0;
+    }
+    return sizeof(struct ddtable) + (slot_bytes * ht_num_kv_pairs);
+}
+
+ddtable_t dd_table_init(void* mem, const uint64_t num_keys,
+                        const uint32_t key_width, const uint32_t val_width)
+{
+    ddtable_t new_ht = mem;
+    dd_table_dims(num_keys, &new_ht->size, &new_ht->num_kv_pairs);
+    new_ht->key_width = key_width;
+    new_ht->val_width = val_width;
+    new_ht->stride = dd_stride(key_width, val_width);
+    new_ht->exists_offset = sizeof(struct ddtable) +
+        (sizeof(double) * new_ht->num_kv_pairs * new_ht->stride);
+    new_ht->seed = SPOOKY_HASH_SEED;
+    new_ht->generation = DDTABLE_EMPTY_GEN + 1;
+    new_ht->shared = 0;
+    new_ht->traced = 0;
+    new_ht->linear = 0;
+    new_ht->linear_count = 0;
+    new_ht->cache = NULL;
+    new_ht->order = NULL;
+    new_ht->dirty = NULL;
+
+    memset(dd_exists(new_ht), DDTABLE_EMPTY_GEN,
+           new_ht->num_kv_pairs * sizeof(uint8_t));
+
+    return new_ht;
+}
+
+//! Allocates a table with its kv array on a cache line boundary
+ddtable_t dd_table_new(const uint64_t num_keys, const uint32_t key_width,
+                       const uint32_t val_width, const uint64_t seed)
+{
+    const size_t ht_bytes = dd_table_bytes(num_keys, key_width, val_width);
+    if (ht_bytes == 0)
+    {
+        return NULL;
+    }
+
+    // Single allocation: header, kv pairs and existance array
+    void* mem = NULL;
+#ifdef MSVC
+    mem = _aligned_malloc(ht_bytes, DDTABLE_CACHE_LINE);
+#else
+    if (posix_memalign(&mem, DDTABLE_CACHE_LINE, ht_bytes) != 0)
+    {
+        mem = NULL;
+    }
+#endif
+    assert(mem);
+    ddtable_t new_ht = dd_table_init(mem, num_keys, key_width, val_width);
+    new_ht->seed = seed;
 
 #ifndef NDEBUG
-    fprintf(stderr, "Created new ddtable %p with size %"PRIuFAST32"\n",
+    fprintf(stderr, "Created new ddtable %p with size %"PRIu64"\n",
             (void*) new_ht, new_ht->size);
 #endif
 
-    // Allocate space for existance array
-    new_ht->exists = calloc(new_ht->num_kv_pairs, sizeof(char));
-    assert(new_ht->exists);
+    return new_ht;
+}
 
+ddtable_t ddtable_new(const uint64_t num_keys)
+{
+    ddtable_t new_ht = dd_table_new(num_keys, 1, 1, SPOOKY_HASH_SEED);
+    // Comparing against a handful of packed keys beats hashing, and holds
+    // every key up to the table's size with no collisions at all
+    if (new_ht != NULL && new_ht->num_kv_pairs <= DDTABLE_LINEAR_MAX_KEYS)
+    {
+        new_ht->linear = 1;
+    }
     return new_ht;
 }
 
+ddtable_t ddtable_new_vec(const uint64_t num_keys, const uint32_t val_width)
+{
+    if (val_width == 0)
+    {
+        return NULL;
+    }
+    return dd_table_new(num_keys, 1, val_width, SPOOKY_HASH_SEED);
+}
+
+ddtable_t ddtable_new_multi(const uint64_t num_keys, const uint32_t key_width,
+                            const uint32_t val_width)
+{
+    if (key_width == 0 || key_width > DDTABLE_MAX_KEY_WIDTH || val_width == 0)
+    {
+        return NULL;
+    }
+    return dd_table_new(num_keys, key_width, val_width, SPOOKY_HASH_SEED);
+}
+
+ddtable_t ddtable_new_seeded(const uint64_t num_keys, const uint64_t seed)
+{
+    return dd_table_new(num_keys, 1, 1, seed);
+}
+
+uint64_t ddtable_seed(const ddtable_t ddtable)
+{
+    return ddtable->seed;
+}
+
+uint32_t ddtable_val_width(const ddtable_t ddtable)
+{
+    return ddtable->val_width;
+}
+
 void ddtable_free(ddtable_t ddtable)
 {
     if (ddtable != NULL)
     {
-        if (ddtable->exists != NULL)
+        // Shared tables are unmapped with ddtable_shm_detach instead
+        assert(!ddtable->shared);
+        // and a checkpoint must be freed before its table
+        assert(ddtable->dirty == NULL);
+
+        ddtable_detach_cache(ddtable);
+        ddtable_detach_order(ddtable);
+
+#ifdef MSVC
+        _aligned_free(ddtable);
+#else
+        free(ddtable);
+#endif
+    }
+}
+
+uint64_t ddtable_bytes(const ddtable_t ddtable)
+{
+    return dd_table_bytes(ddtable->num_kv_pairs, ddtable->key_width,
+                          ddtable->val_width);
+}
+
+ddtable_t ddtable_resize(const ddtable_t ddtable, const uint64_t num_keys)
+{
+    ddtable_t new_ht = dd_table_new(num_keys, ddtable->key_width,
+                                    ddtable->val_width, ddtable->seed);
+    if (new_ht == NULL)
+    {
+        return NULL;
+    }
+
+    if (ddtable->linear)
+    {
+        for (uint32_t i = 0; i < ddtable->linear_count; i++)
         {
-            free(ddtable->exists);
+            dd_set_hashed(new_ht, ddtable->key_vals[i],
+                          ddtable->key_vals[ddtable->num_kv_pairs + i]);
         }
-        
-        free(ddtable);
+        return new_ht;
+    }
+
+    // Rehash every live slot; the first entry to claim a new slot keeps it
+    const uint8_t* exists = dd_exists(ddtable);
+    uint8_t* new_exists = dd_exists(new_ht);
+    const size_t slot_bytes = ddtable->stride * sizeof(double);
+    for (uint64_t i = 0; i < ddtable->num_kv_pairs; i++)
+    {
+        if (exists[i] != ddtable->generation)
+        {
+            continue;
+        }
+        const double* slot = &ddtable->key_vals[ddtable->stride * i];
+        const uint64_t indx = dd_index(dd_raw_hash_multi(slot,
+                                                         ddtable->key_width,
+                                                         new_ht->seed),
+                                       new_ht->size);
+        if (new_exists[indx] != new_ht->generation)
+        {
+            new_exists[indx] = new_ht->generation;
+            memcpy(&new_ht->key_vals[new_ht->stride * indx], slot, slot_bytes);
+        }
+    }
+
+    return new_ht;
+}
+
+int ddtable_attach_cache(ddtable_t ddtable, uint64_t cache_bytes)
+{
+    // The cache is process-local, so it can't hang off a shared table, and
+    // it only mirrors hashed scalar slots
+    if (ddtable->shared || !dd_is_scalar(ddtable) || ddtable->linear)
+    {
+        return 1;
+    }
+    if (cache_bytes == 0)
+    {
+        cache_bytes = DDTABLE_CACHE_DEFAULT_BYTES;
+    }
+
+    // Round the entry count down to a power of 2 so the cache never
+    // exceeds the requested footprint.
+    const uint64_t entry_bytes = (2 * sizeof(double)) + sizeof(uint8_t);
+    uint64_t num_entries = next_power_of_two(cache_bytes / entry_bytes);
+    if (num_entries > cache_bytes / entry_bytes)
+    {
+        num_entries >>= 1;
+    }
+    if (num_entries == 0)
+    {
+        return 1;
+    }
+
+    struct ddtable_cache* cache = malloc(sizeof(struct ddtable_cache) +
+                                         (sizeof(double) * num_entries * 2));
+    if (cache == NULL)
+    {
+        return 1;
+    }
+    cache->exists = calloc(num_entries, sizeof(uint8_t));
+    if (cache->exists == NULL)
+    {
+        free(cache);
+        return 1;
+    }
+    cache->mask = num_entries - 1;
+    cache->lookups = 0;
+    cache->hits = 0;
+
+    ddtable_detach_cache(ddtable);
+    ddtable->cache = cache;
+    
+    return 0;
+}
+
+void ddtable_detach_cache(ddtable_t ddtable)
+{
+    if (ddtable->cache != NULL)
+    {
+        free(ddtable->cache->exists);
+        free(ddtable->cache);
+        ddtable->cache = NULL;
+    }
+}
+
+void ddtable_get_cache_stats(const ddtable_t ddtable,
+                             uint64_t* lookups, uint64_t* hits)
+{
+    const struct ddtable_cache* cache = ddtable->cache;
+    *lookups = (cache != NULL) ? cache->lookups : 0;
+    *hits = (cache != NULL) ? cache->hits : 0;
+}
+
+int ddtable_trace_table(ddtable_t ddtable, const int enable)
+{
+#ifdef DDTABLE_TRACE
+    ddtable->traced = (enable != 0);
+    return 0;
+#else
+    (void) ddtable;
+    (void) enable;
+    return 1;
+#endif
+}
+
+void ddtable_clear(ddtable_t ddtable)
+{
+    DD_TRACE(ddtable, DDTABLE_TRACE_CLEAR, 0);
+
+    dd_touch_header(ddtable);
+    ddtable->linear_count = 0;
+    if (ddtable->order != NULL)
+    {
+        dd_order_clear(ddtable);
+    }
+
+    // Bumping the generation invalidates every stamp at once. Only when the
+    // counter wraps do we have to touch the stamps, so the memset cost is
+    // amortized over DDTABLE_MAX_GEN clears.
+    if (ddtable->generation == DDTABLE_MAX_GEN)
+    {
+        dd_touch(ddtable, dd_exists(ddtable),
+                 ddtable->num_kv_pairs * sizeof(uint8_t));
+        memset(dd_exists(ddtable), DDTABLE_EMPTY_GEN,
+               ddtable->num_kv_pairs * sizeof(uint8_t));
+        if (ddtable->cache != NULL)
+        {
+            memset(ddtable->cache->exists, DDTABLE_EMPTY_GEN,
+                   (ddtable->cache->mask + 1) * sizeof(uint8_t));
+        }
+        ddtable->generation = DDTABLE_EMPTY_GEN + 1;
+    } else {
+        ddtable->generation++;
     }
 }
 
 double ddtable_get_val(ddtable_t ddtable, const double key)
 {
-    const uint_fast32_t indx = dd_hash(key, ddtable->size);
+    assert(dd_is_scalar(ddtable));
+    DD_TRACE(ddtable, DDTABLE_TRACE_GET, key);
+
+    if (ddtable->linear)
+    {
+        const int64_t i = dd_linear_find(ddtable, key);
+        return (i >= 0) ? ddtable->key_vals[ddtable->num_kv_pairs + i]
+            : (double) DDTABLE_NULL_VAL;
+    }
 
-    return (ddtable->exists[indx]) ? 
+    const uint64_t indx = dd_hash(key, ddtable);
+    return (dd_exists(ddtable)[indx] == ddtable->generation) ? 
         ddtable->key_vals[(2 * indx) + 1] : (double) DDTABLE_NULL_VAL;
 }
 
-double ddtable_get_check_key(ddtable_t ddtable, const double key)
+//! Value of key in a linear-mode table, or DDTABLE_NULL_VAL
+static inline double dd_linear_get(const struct ddtable* ddtable,
+                                   const double key)
+{
+    const int64_t i = dd_linear_find(ddtable, key);
+    return (i >= 0) ? ddtable->key_vals[ddtable->num_kv_pairs + i]
+        : (double) DDTABLE_NULL_VAL;
+}
+
+//! Raw hash of a handle's key under the table's seed, reusing it if it fits
+static inline uint64_t dd_handle_hash(const ddtable_hash_t* handle,
+                                      const struct ddtable* ddtable)
 {
-    const uint_fast32_t indx = dd_hash(key, ddtable->size);
+    return (handle->seed == ddtable->seed) ? handle->hash
+        : dd_raw_hash(handle->key, ddtable->seed);
+}
+
+/* Checked lookup in a hashed scalar table, given the key's raw hash;
+ * *found tells a stored DDTABLE_NULL_VAL from a miss. */
+static inline double dd_get_check_hashed(ddtable_t ddtable, const double key,
+                                         const uint64_t hash, int* found)
+{
+    struct ddtable_cache* cache = ddtable->cache;
+    uint64_t cindx = 0;
+
+    if (cache != NULL)
+    {
+        cindx = dd_cache_index(hash, cache);
+        cache->lookups++;
+        if (cache->exists[cindx] == ddtable->generation &&
+            cache->key_vals[2 * cindx] == key)
+        {
+            cache->hits++;
+            *found = 1;
+            return cache->key_vals[(2 * cindx) + 1];
+        }
+    }
+
+    const uint64_t indx = dd_index(hash, ddtable->size);
 
     // If the key exists AND it's equal to the given one,
     // then return the value. Otherwise, return DDTABLE_NULL_VAL
-    return (ddtable->exists[indx] && ddtable->key_vals[2 * indx] == key)
-        ? ddtable->key_vals[(2 * indx) + 1] : (double) DDTABLE_NULL_VAL;
+    if (dd_exists(ddtable)[indx] == ddtable->generation &&
+        ddtable->key_vals[2 * indx] == key)
+    {
+        const double val = ddtable->key_vals[(2 * indx) + 1];
+        if (cache != NULL)
+        {
+            // Fill on hit; only accumulators rewrite a value, and they update
+            // the cache entry too, so it never goes stale
+            cache->exists[cindx] = ddtable->generation;
+            cache->key_vals[2 * cindx] = key;
+            cache->key_vals[(2 * cindx) + 1] = val;
+        }
+        *found = 1;
+        return val;
+    }
+
+    *found = 0;
+    return (double) DDTABLE_NULL_VAL;
+}
+
+//! dd_set_at, logging the pair to the ordered index if it was stored
+static inline int dd_set_logged(ddtable_t ddtable, const uint64_t indx,
+                                const double key, const double val)
+{
+    const int collided = dd_set_at(ddtable, indx, key, val);
+    if (!collided && ddtable->order != NULL)
+    {
+        dd_order_log(ddtable, key, val);
+    }
+    return collided;
+}
+
+/* Scalar insert shared by the plain and handle variants. The hash is only
+ * needed once the table is hashed, so handle may be NULL to have it
+ * computed on demand. */
+static inline int dd_set_scalar(ddtable_t ddtable, const double key,
+                                const double val,
+                                const ddtable_hash_t* handle)
+{
+    if (ddtable->linear)
+    {
+        if (dd_linear_find(ddtable, key) >= 0)
+        {
+            return 1; // Already present, like a hashed collision
+        }
+        if (ddtable->linear_count < ddtable->num_kv_pairs)
+        {
+            const uint32_t i = ddtable->linear_count;
+            dd_touch_linear(ddtable, i);
+            ddtable->linear_count++;
+            ddtable->key_vals[i] = key;
+            ddtable->key_vals[ddtable->num_kv_pairs + i] = val;
+            if (ddtable->order != NULL)
+            {
+                dd_order_log(ddtable, key, val);
+            }
+            return 0;
+        }
+        return 1; // Full: a new key is dropped, as on a hashed collision
+    }
+
+    const uint64_t indx = (handle != NULL)
+        ? dd_index(dd_handle_hash(handle, ddtable), ddtable->size)
+        : dd_hash(key, ddtable);
+    return dd_set_logged(ddtable, indx, key, val);
+}
+
+double ddtable_get_check_key(ddtable_t ddtable, const double key)
+{
+    assert(dd_is_scalar(ddtable));
+    DD_TRACE(ddtable, DDTABLE_TRACE_GET_CHECK, key);
+
+    if (ddtable->linear)
+    {
+        return dd_linear_get(ddtable, key);
+    }
+    int found;
+    return dd_get_check_hashed(ddtable, key, dd_raw_hash(key, ddtable->seed),
+                               &found);
 }
 
 int ddtable_set_val(ddtable_t ddtable, const double key, const double val)
 {
-    const uint_fast32_t indx = dd_hash(key, ddtable->size);
+    assert(dd_is_scalar(ddtable));
+    DD_TRACE(ddtable, DDTABLE_TRACE_SET, key);
+
+    return dd_set_scalar(ddtable, key, val, NULL);
+}
+
+/* Hands out a pointer to key's value slot. The caller may write through
+ * it, so the key's front cache entry is dropped (it refills from the slot
+ * on the next hit) and the ordered index learns its values can go stale. */
+static inline double* dd_expose_slot(ddtable_t ddtable, const uint64_t hash,
+                                     const double key, double* slot)
+{
+    struct ddtable_cache* cache = ddtable->cache;
+    if (cache != NULL)
+    {
+        const uint64_t cindx = dd_cache_index(hash, cache);
+        if (cache->exists[cindx] == ddtable->generation &&
+            cache->key_vals[2 * cindx] == key)
+        {
+            cache->exists[cindx] = DDTABLE_EMPTY_GEN;
+        }
+    }
+    if (ddtable->order != NULL)
+    {
+        ddtable->order->reread_vals = 1;
+    }
+    // Writes through the slot can't be seen, so count it written now
+    dd_touch(ddtable, slot, sizeof(double));
+    return slot;
+}
+
+double* ddtable_find(ddtable_t ddtable, const double key)
+{
+    assert(dd_is_scalar(ddtable));
+    DD_TRACE(ddtable, DDTABLE_TRACE_GET_CHECK, key);
 
-    if (ddtable->exists[indx])
+    if (ddtable->linear)
     {
-        return 1; // Collision
+        // Linear tables never have a front cache, so no hash is needed
+        const int64_t i = dd_linear_find(ddtable, key);
+        return (i >= 0) ? dd_expose_slot(ddtable, 0, key,
+                                         &ddtable->key_vals[
+                                             ddtable->num_kv_pairs + i])
+            : NULL;
+    }
+
+    const uint64_t hash = dd_raw_hash(key, ddtable->seed);
+    const uint64_t indx = dd_index(hash, ddtable->size);
+    if (dd_exists(ddtable)[indx] == ddtable->generation &&
+        ddtable->key_vals[2 * indx] == key)
+    {
+        return dd_expose_slot(ddtable, hash, key,
+                              &ddtable->key_vals[(2 * indx) + 1]);
+    }
+    return NULL;
+}
+
+double* ddtable_upsert(ddtable_t ddtable, const double key, int* inserted)
+{
+    assert(dd_is_scalar(ddtable));
+    DD_TRACE(ddtable, DDTABLE_TRACE_SET, key);
+
+    int added = 0;
+    double* slot = NULL;
+    uint64_t hash = 0;
+
+    if (ddtable->linear)
+    {
+        int64_t i = dd_linear_find(ddtable, key);
+        if (i < 0 && ddtable->linear_count < ddtable->num_kv_pairs)
+        {
+            i = ddtable->linear_count;
+            dd_touch_linear(ddtable, i);
+            ddtable->linear_count++;
+            ddtable->key_vals[i] = key;
+            ddtable->key_vals[ddtable->num_kv_pairs + i] = DDTABLE_NULL_VAL;
+            added = 1;
+        } else if (i < 0) {
+            return NULL; // Full, like a collision
+        }
+        slot = &ddtable->key_vals[ddtable->num_kv_pairs + i];
     } else {
-        ddtable->exists[indx] = '1';
-        ddtable->key_vals[2 * indx] = key;
-        ddtable->key_vals[(2 * indx) + 1] = val;
-        return 0;
+        hash = dd_raw_hash(key, ddtable->seed);
+        const uint64_t indx = dd_index(hash, ddtable->size);
+        added = !dd_set_at(ddtable, indx, key, DDTABLE_NULL_VAL);
+        if (!added && ddtable->key_vals[2 * indx] != key)
+        {
+            return NULL; // Collision
+        }
+        slot = &ddtable->key_vals[(2 * indx) + 1];
+    }
+
+    if (added && ddtable->order != NULL)
+    {
+        dd_order_log(ddtable, key, DDTABLE_NULL_VAL);
+    }
+    if (inserted != NULL)
+    {
+        *inserted = added;
+    }
+    return dd_expose_slot(ddtable, hash, key, slot);
+}
+
+ddtable_hash_t ddtable_hash_key(const double key)
+{
+    return ddtable_hash_key_seeded(key, SPOOKY_HASH_SEED);
+}
+
+ddtable_hash_t ddtable_hash_key_seeded(const double key, const uint64_t seed)
+{
+    ddtable_hash_t handle;
+    handle.key = key;
+    handle.seed = seed;
+    handle.hash = dd_raw_hash(key, seed);
+    return handle;
+}
+
+double ddtable_get_check_key_with_hash(ddtable_t ddtable,
+                                       const ddtable_hash_t* handle)
+{
+    assert(dd_is_scalar(ddtable));
+    DD_TRACE(ddtable, DDTABLE_TRACE_GET_CHECK, handle->key);
+
+    if (ddtable->linear)
+    {
+        return dd_linear_get(ddtable, handle->key);
+    }
+    int found;
+    return dd_get_check_hashed(ddtable, handle->key,
+                               dd_handle_hash(handle, ddtable), &found);
+}
+
+int ddtable_set_val_with_hash(ddtable_t ddtable, const ddtable_hash_t* handle,
+                              const double val)
+{
+    assert(dd_is_scalar(ddtable));
+    DD_TRACE(ddtable, DDTABLE_TRACE_SET, handle->key);
+
+    return dd_set_scalar(ddtable, handle->key, val, handle);
+}
+
+int dd_memo_probe(ddtable_t ddtable, const double key,
+                  const ddtable_hash_t* handle, uint64_t* hash, double* val)
+{
+    assert(dd_is_scalar(ddtable));
+    DD_TRACE(ddtable, DDTABLE_TRACE_GET_CHECK, key);
+
+    if (ddtable->linear)
+    {
+        const int64_t i = dd_linear_find(ddtable, key);
+        *hash = 0; // Linear tables never hash
+        *val = (i >= 0) ? ddtable->key_vals[ddtable->num_kv_pairs + i]
+            : (double) DDTABLE_NULL_VAL;
+        return i >= 0;
+    }
+
+    int found;
+    *hash = (handle != NULL) ? dd_handle_hash(handle, ddtable)
+        : dd_raw_hash(key, ddtable->seed);
+    *val = dd_get_check_hashed(ddtable, key, *hash, &found);
+    return found;
+}
+
+int dd_memo_store(ddtable_t ddtable, const double key, const uint64_t hash,
+                  const double val)
+{
+    DD_TRACE(ddtable, DDTABLE_TRACE_SET, key);
+
+    if (ddtable->linear)
+    {
+        return dd_set_scalar(ddtable, key, val, NULL) &&
+            dd_linear_find(ddtable, key) < 0;
+    }
+    const uint64_t indx = dd_index(hash, ddtable->size);
+    return dd_set_logged(ddtable, indx, key, val) &&
+        ddtable->key_vals[2 * indx] != key;
+}
+
+//! Memoizer shared by the plain and handle variants
+static inline double dd_memoize_scalar(ddtable_t ddtable, const double key,
+                                       const ddtable_hash_t* handle,
+                                       ddtable_memo_fn fn, void* arg)
+{
+    uint64_t hash;
+    double val;
+    if (dd_memo_probe(ddtable, key, handle, &hash, &val))
+    {
+        return val;
+    }
+
+    // fn runs before the store, as it may memoize other keys itself
+    val = fn(key, arg);
+    dd_memo_store(ddtable, key, hash, val);
+    return val;
+}
+
+double ddtable_memoize(ddtable_t ddtable, const double key,
+                       ddtable_memo_fn fn, void* arg)
+{
+    return dd_memoize_scalar(ddtable, key, NULL, fn, arg);
+}
+
+double ddtable_memoize_with_hash(ddtable_t ddtable,
+                                 const ddtable_hash_t* handle,
+                                 ddtable_memo_fn fn, void* arg)
+{
+    return dd_memoize_scalar(ddtable, handle->key, handle, fn, arg);
+}
+
+const double* ddtable_get_vec(const ddtable_t ddtable, const double key)
+{
+    const uint64_t indx = dd_hash(key, ddtable);
+    const double* slot = &ddtable->key_vals[ddtable->stride * indx];
+
+    assert(ddtable->key_width == 1);
+    DD_TRACE(ddtable, DDTABLE_TRACE_GET_CHECK, key);
+
+    return (dd_exists(ddtable)[indx] == ddtable->generation && slot[0] == key)
+        ? slot + 1 : NULL;
+}
+
+int ddtable_get_vec_copy(const ddtable_t ddtable, const double key,
+                         double* vals)
+{
+    const double* slot_vals = ddtable_get_vec(ddtable, key);
+    if (slot_vals == NULL)
+    {
+        return 1;
     }
+    memcpy(vals, slot_vals, ddtable->val_width * sizeof(double));
+    return 0;
+}
+
+int ddtable_set_vec(ddtable_t ddtable, const double key, const double* vals)
+{
+    const uint64_t indx = dd_hash(key, ddtable);
+    uint8_t* exists = dd_exists(ddtable);
+
+    assert(ddtable->key_width == 1);
+    DD_TRACE(ddtable, DDTABLE_TRACE_SET, key);
+
+    if (exists[indx] == ddtable->generation)
+    {
+        return 1; // Collision
+    }
+
+    double* slot = &ddtable->key_vals[ddtable->stride * indx];
+    dd_touch_slot(ddtable, indx);
+    exists[indx] = ddtable->generation;
+    slot[0] = key;
+    memcpy(slot + 1, vals, ddtable->val_width * sizeof(double));
+    return 0;
+}
+
+const double* ddtable_get_multi(const ddtable_t ddtable, const double* keys)
+{
+    const uint32_t key_width = ddtable->key_width;
+    const uint64_t hash = dd_raw_hash_multi(keys, key_width, ddtable->seed);
+    const uint64_t indx = dd_index(hash, ddtable->size);
+    const double* slot = &ddtable->key_vals[ddtable->stride * indx];
+
+    return (dd_exists(ddtable)[indx] == ddtable->generation &&
+            dd_keys_equal(slot, keys, key_width))
+        ? slot + key_width : NULL;
+}
+
+int ddtable_set_multi(ddtable_t ddtable, const double* keys,
+                      const double* vals)
+{
+    const uint32_t key_width = ddtable->key_width;
+    const uint64_t hash = dd_raw_hash_multi(keys, key_width, ddtable->seed);
+    const uint64_t indx = dd_index(hash, ddtable->size);
+    uint8_t* exists = dd_exists(ddtable);
+
+    if (exists[indx] == ddtable->generation)
+    {
+        return 1; // Collision
+    }
+
+    double* slot = &ddtable->key_vals[ddtable->stride * indx];
+    dd_touch_slot(ddtable, indx);
+    exists[indx] = ddtable->generation;
+    memcpy(slot, keys, key_width * sizeof(double));
+    memcpy(slot + key_width, vals, ddtable->val_width * sizeof(double));
+    return 0;
 }
@@ -0,0 +1,310 @@
+#if HAVE_DDTABLE_CONFIG_H
+#include "ddtable_config.h"
+#else
+#include "../build/config/ddtable_config.h"
+#endif
+
+#include "libddtable.h"
+#include "ddtable_internal.h"
+
+#include <assert.h>
+#include <stdint.h>
+
+//! Keys hashed and prefetched ahead of being folded in batch accumulation
+#ifndef DDTABLE_ACCUM_BLOCK
+#define DDTABLE_ACCUM_BLOCK 16
+#endif
+
+/* Every helper below takes op as a parameter but is inlined into callers
+ * passing a constant, so the switches fold away and each public function
+ * (and each batch loop) is specialized for its one operation. */
+
+//! Value stored for a key's first update
+static inline double accum_first(const enum ddtable_accum_op op,
+                                 const double val)
+{
+    return (op == DDTABLE_ACCUM_COUNT) ? 1 : val;
+}
+
+//! Folds val into a key's current value
+static inline double accum_apply(const enum ddtable_accum_op op,
+                                 const double cur, const double val)
+{
+    switch (op)
+    {
+        case DDTABLE_ACCUM_MIN:
+            return (val < cur) ? val : cur;
+        case DDTABLE_ACCUM_MAX:
+            return (val > cur) ? val : cur;
+        case DDTABLE_ACCUM_COUNT:
+            return cur + 1;
+        case DDTABLE_ACCUM_ADD:
+        default:
+            return cur + val;
+    }
+}
+
+//! Keeps a key's front cache entry, if it has one, in step with its slot
+static inline void accum_sync_cache(ddtable_t ddtable, const uint64_t hash,
+                                    const double key, const double val)
+{
+    struct ddtable_cache* cache = ddtable->cache;
+    const uint64_t cindx = dd_cache_index(hash, cache);
+    if (cache->exists[cindx] == ddtable->generation &&
+        cache->key_vals[2 * cindx] == key)
+    {
+        cache->key_vals[(2 * cindx) + 1] = val;
+    }
+}
+
+//! Single-probe upsert into slot indx of a hashed scalar table
+static inline int accum_at(ddtable_t ddtable, const enum ddtable_accum_op op,
+                           const uint64_t indx, const uint64_t hash,
+                           const double key, const double val)
+{
+    uint8_t* exists = dd_exists(ddtable);
+    double* kv = &ddtable->key_vals[2 * indx];
+
+    if (exists[indx] != ddtable->generation)
+    {
+        dd_touch_slot(ddtable, indx);
+        exists[indx] = ddtable->generation;
+        kv[0] = key;
+        kv[1] = accum_first(op, val);
+    } else if (kv[0] == key) {
+        dd_touch(ddtable, &kv[1], sizeof(double));
+        kv[1] = accum_apply(op, kv[1], val);
+        if (ddtable->cache != NULL)
+        {
+            accum_sync_cache(ddtable, hash, key, kv[1]);
+        }
+    } else {
+        return 1; // Collision
+    }
+
+    if (ddtable->order != NULL)
+    {
+        // The index keeps the latest value logged for a key
+        dd_order_log(ddtable, key, kv[1]);
+    }
+    return 0;
+}
+
+static inline int accumulate(ddtable_t ddtable, const enum ddtable_accum_op op,
+                             const double key, const double val)
+{
+    assert(dd_is_scalar(ddtable));
+
+    if (ddtable->linear)
+    {
+        const int64_t i = dd_linear_find(ddtable, key);
+        double* vals = &ddtable->key_vals[ddtable->num_kv_pairs];
+        if (i >= 0 || ddtable->linear_count < ddtable->num_kv_pairs)
+        {
+            double* slot;
+            if (i >= 0)
+            {
+                slot = &vals[i];
+                dd_touch(ddtable, slot, sizeof(double));
+                *slot = accum_apply(op, *slot, val);
+            } else {
+                const uint32_t n = ddtable->linear_count;
+                dd_touch_linear(ddtable, n);
+                ddtable->linear_count++;
+                ddtable->key_vals[n] = key;
+                slot = &vals[n];
+                *slot = accum_first(op, val);
+            }
+            if (ddtable->order != NULL)
+            {
+                dd_order_log(ddtable, key, *slot);
+            }
+            return 0;
+        }
+        return 1; // Full: dropped, as on a hashed collision
+    }
+
+    const uint64_t hash = dd_raw_hash(key, ddtable->seed);
+    return accum_at(ddtable, op, dd_index(hash, ddtable->size), hash, key,
+                    val);
+}
+
+int ddtable_add(ddtable_t ddtable, const double key, const double val)
+{
+    return accumulate(ddtable, DDTABLE_ACCUM_ADD, key, val);
+}
+
+int ddtable_min(ddtable_t ddtable, const double key, const double val)
+{
+    return accumulate(ddtable, DDTABLE_ACCUM_MIN, key, val);
+}
+
+int ddtable_max(ddtable_t ddtable, const double key, const double val)
+{
+    return accumulate(ddtable, DDTABLE_ACCUM_MAX, key, val);
+}
+
+int ddtable_count(ddtable_t ddtable, const double key)
+{
+    return accumulate(ddtable, DDTABLE_ACCUM_COUNT, key, 0);
+}
+
+/* Concurrent upsert. A free slot is claimed by moving its stamp to BUSY, as
+ * ddtable_shm_set_val does, and published with a release store once the
+ * pair is written. Unlike an insert, an updater finding the slot BUSY
+ * waits for it, since the claimant may be adding the very same key. The
+ * value is then folded in with a CAS loop on its bits (there is no native
+ * floating-point fetch-add). */
+static inline int accumulate_atomic(ddtable_t ddtable,
+                                    const enum ddtable_accum_op op,
+                                    const double key, const double val)
+{
+    if (ddtable->linear || ddtable->cache != NULL || ddtable->order != NULL ||
+        ddtable->dirty != NULL || !dd_is_scalar(ddtable))
+    {
+        return 1;
+    }
+
+    const uint64_t indx = dd_hash(key, ddtable);
+    const uint8_t gen = __atomic_load_n(&ddtable->generation,
+                                        __ATOMIC_RELAXED);
+    uint8_t* stamp = &dd_exists(ddtable)[indx];
+    double* kv = &ddtable->key_vals[2 * indx];
+    uint8_t cur = __atomic_load_n(stamp, __ATOMIC_ACQUIRE);
+
+    while (cur != gen)
+    {
+        if (cur == DDTABLE_BUSY_GEN)
+        {
+            cur = __atomic_load_n(stamp, __ATOMIC_ACQUIRE);
+            continue; // Another updater is mid-claim
+        }
+        if (__atomic_compare_exchange_n(stamp, &cur, DDTABLE_BUSY_GEN, 0,
+                                        __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE))
+        {
+            const double first = accum_first(op, val);
+            __atomic_store(&kv[0], (double*) &key, __ATOMIC_RELAXED);
+            __atomic_store(&kv[1], (double*) &first, __ATOMIC_RELAXED);
+            __atomic_store_n(stamp, gen, __ATOMIC_RELEASE);
+            return 0;
+        }
+    }
+
+    // Published keys never change (short of a clear), so one check will do
+    double slot_key;
+    __atomic_load(&kv[0], &slot_key, __ATOMIC_RELAXED);
+    if (slot_key != key)
+    {
+        return 1; // Collision
+    }
+
+    double old_val, new_val;
+    __atomic_load(&kv[1], &old_val, __ATOMIC_RELAXED);
+    do
+    {
+        new_val = accum_apply(op, old_val, val);
+    } while (!__atomic_compare_exchange(&kv[1], &old_val, &new_val, 1,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+    return 0;
+}
+
+int ddtable_add_atomic(ddtable_t ddtable, const double key, const double val)
+{
+    return accumulate_atomic(ddtable, DDTABLE_ACCUM_ADD, key, val);
+}
+
+int ddtable_min_atomic(ddtable_t ddtable, const double key, const double val)
+{
+    return accumulate_atomic(ddtable, DDTABLE_ACCUM_MIN, key, val);
+}
+
+int ddtable_max_atomic(ddtable_t ddtable, const double key, const double val)
+{
+    return accumulate_atomic(ddtable, DDTABLE_ACCUM_MAX, key, val);
+}
+
+int ddtable_count_atomic(ddtable_t ddtable, const double key)
+{
+    return accumulate_atomic(ddtable, DDTABLE_ACCUM_COUNT, key, 0);
+}
+
+/* Batch loop for one operation: hash a block of keys at once (several
+ * lanes per instruction where the target has them) and prefetch their
+ * slots, then fold the block in once the lines have landed. Keys repeating
+ * within a block simply hit the slot the earlier one claimed. */
+static inline uint64_t accumulate_blocks(ddtable_t ddtable,
+                                         const enum ddtable_accum_op op,
+                                         const double* keys,
+                                         const double* vals,
+                                         const uint64_t num_keys)
+{
+    const uint8_t* exists = dd_exists(ddtable);
+    uint64_t hashes[DDTABLE_ACCUM_BLOCK];
+    uint64_t num_dropped = 0;
+
+    for (uint64_t base = 0; base < num_keys; base += DDTABLE_ACCUM_BLOCK)
+    {
+        const uint64_t n = (num_keys - base < DDTABLE_ACCUM_BLOCK)
+            ? num_keys - base : DDTABLE_ACCUM_BLOCK;
+        dd_raw_hash_block(keys + base, n, ddtable->seed, hashes);
+        for (uint64_t j = 0; j < n; j++)
+        {
+            const uint64_t indx = dd_index(hashes[j], ddtable->size);
+            __builtin_prefetch(&ddtable->key_vals[2 * indx], 1);
+            __builtin_prefetch(&exists[indx], 1);
+        }
+        for (uint64_t j = 0; j < n; j++)
+        {
+            const double val = (vals != NULL) ? vals[base + j] : 0;
+            num_dropped += accum_at(ddtable, op,
+                                    dd_index(hashes[j], ddtable->size),
+                                    hashes[j], keys[base + j], val);
+        }
+    }
+    return num_dropped;
+}
+
+uint64_t ddtable_accumulate_batch(ddtable_t ddtable,
+                                  const enum ddtable_accum_op op,
+                                  const double* keys, const double* vals,
+                                  const uint64_t num_keys)
+{
+    assert(dd_is_scalar(ddtable));
+    uint64_t i = 0;
+    uint64_t num_dropped = 0;
+
+    // A tiny table has nothing to hash or prefetch, so it takes the keys
+    // one at a time
+    if (ddtable->linear)
+    {
+        for (; i < num_keys; i++)
+        {
+            num_dropped += accumulate(ddtable, op, keys[i],
+                                      (vals != NULL) ? vals[i] : 0);
+        }
+        return num_dropped;
+    }
+
+    const double* rest_vals = (vals != NULL) ? vals + i : NULL;
+    switch (op)
+    {
+        case DDTABLE_ACCUM_MIN:
+            return num_dropped + accumulate_blocks(ddtable, DDTABLE_ACCUM_MIN,
+                                                   keys + i, rest_vals,
+                                                   num_keys - i);
+        case DDTABLE_ACCUM_MAX:
+            return num_dropped + accumulate_blocks(ddtable, DDTABLE_ACCUM_MAX,
+                                                   keys + i, rest_vals,
+                                                   num_keys - i);
+        case DDTABLE_ACCUM_COUNT:
+            return num_dropped + accumulate_blocks(ddtable,
+                                                   DDTABLE_ACCUM_COUNT,
+                                                   keys + i, rest_vals,
+                                                   num_keys - i);
+        case DDTABLE_ACCUM_ADD:
+        default:
+            return num_dropped + accumulate_blocks(ddtable, DDTABLE_ACCUM_ADD,
+                                                   keys + i, rest_vals,
+                                                   num_keys - i);
+    }
+}
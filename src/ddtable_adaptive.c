@@ -0,0 +1,590 @@
+#if HAVE_DDTABLE_CONFIG_H
+#include "ddtable_config.h"
+#else
+#include "../build/config/ddtable_config.h"
+#endif
+
+#include "ddtable_adaptive.h"
+#include "ddtable_internal.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+//! Calls per sampling window
+#ifndef DDADAPTIVE_WINDOW
+#define DDADAPTIVE_WINDOW 4096
+#endif
+
+//! Old slots moved to the new layout by every call during a migration
+#ifndef DDADAPTIVE_MIGRATE_STEP
+#define DDADAPTIVE_MIGRATE_STEP 16
+#endif
+
+//! Displacements a cuckoo insert tries before giving up on the key
+#ifndef DDADAPTIVE_MAX_KICKS
+#define DDADAPTIVE_MAX_KICKS 128
+#endif
+
+//! Slots per cuckoo bucket: 4 keys and 4 values fill one cache line
+#define DDADAPTIVE_BUCKET 4
+
+//! Smallest capacity, so every layout has at least two buckets
+#define DDADAPTIVE_MIN_SLOTS (2 * DDADAPTIVE_BUCKET)
+
+/* Layout policy. Direct mapping drops about as many new keys as its load
+ * factor, so once a window drops more than DIRECT_MAX_DROPS of its inserts
+ * the table moves to linear probing, or straight to cuckoo if it is
+ * already past PROBE_MAX_LOAD. Linear probing moves on to cuckoo once
+ * read-mostly windows average more than PROBE_MAX_MEAN probes per lookup,
+ * or once it fills to PROBE_FULL_LOAD and starts turning keys away.
+ * Cuckoo only steps back to linear probing, whose inserts are cheaper,
+ * when writes dominate and the load has fallen under CUCKOO_MIN_LOAD; the
+ * gap between the two load thresholds keeps the table from flapping. */
+#define DDADAPTIVE_DIRECT_MAX_DROPS 0.05
+#define DDADAPTIVE_PROBE_MAX_LOAD 0.5
+#define DDADAPTIVE_PROBE_MAX_MEAN 2.0
+#define DDADAPTIVE_CUCKOO_MIN_LOAD 0.35
+
+/* Fill limits. Past them a linear probing miss would scan ever longer runs
+ * and a cuckoo insert would mostly burn its kicks failing, so new keys are
+ * turned away at the cost of a lookup instead. */
+#define DDADAPTIVE_PROBE_FULL_LOAD 0.875
+#define DDADAPTIVE_CUCKOO_FULL_LOAD 0.95
+
+/* One layout's slots. All three use the same memory: two doubles and one
+ * generation stamp per slot. Direct and linear probing interleave key and
+ * value like ddtable; a cuckoo bucket keeps its 4 keys, then its 4 values,
+ * so a lookup compares a bucket's keys within one cache line. */
+struct adaptive_store
+{
+    enum ddadaptive_layout layout;
+    //! Slots minus one, or buckets minus one for cuckoo
+    uint64_t mask;
+    uint64_t num_slots;
+    uint64_t count;
+    double* kv;
+    uint8_t* stamps;
+    uint8_t generation;
+};
+
+struct ddadaptive
+{
+    //! Layout new keys go to
+    struct adaptive_store cur;
+    //! Layout being migrated away from; its kv is NULL when not migrating
+    struct adaptive_store old;
+    //! Next slot of old to move
+    uint64_t migrate_pos;
+    //! What the current sampling window saw
+    uint64_t window_gets;
+    uint64_t window_sets;
+    uint64_t window_probes;
+    uint64_t window_drops;
+    //! Highest load factor since the last clear
+    double peak_load;
+    struct ddadaptive_stats stats;
+};
+
+static inline uint64_t adaptive_hash(const double key)
+{
+    return dd_raw_hash(key, SPOOKY_HASH_SEED);
+}
+
+static void store_relayout(struct adaptive_store* store,
+                           const enum ddadaptive_layout layout)
+{
+    store->layout = layout;
+    store->mask = ((layout == DDADAPTIVE_CUCKOO)
+                   ? store->num_slots / DDADAPTIVE_BUCKET : store->num_slots)
+        - 1;
+}
+
+static int store_init(struct adaptive_store* store,
+                      const enum ddadaptive_layout layout,
+                      const uint64_t num_slots)
+{
+    void* kv = NULL;
+    memset(store, 0, sizeof(struct adaptive_store));
+    if (posix_memalign(&kv, DDTABLE_CACHE_LINE,
+                       num_slots * 2 * sizeof(double)) != 0)
+    {
+        return 1;
+    }
+    store->kv = kv;
+    store->stamps = calloc(num_slots, sizeof(uint8_t));
+    if (store->stamps == NULL)
+    {
+        free(store->kv);
+        store->kv = NULL;
+        return 1;
+    }
+    store->num_slots = num_slots;
+    store->generation = DDTABLE_EMPTY_GEN + 1;
+    store_relayout(store, layout);
+    return 0;
+}
+
+static void store_free(struct adaptive_store* store)
+{
+    free(store->stamps);
+    free(store->kv);
+    store->stamps = NULL;
+    store->kv = NULL;
+}
+
+//! Empties a store by bumping its generation, as ddtable_clear does
+static void store_clear(struct adaptive_store* store)
+{
+    if (store->generation == DDTABLE_MAX_GEN)
+    {
+        memset(store->stamps, DDTABLE_EMPTY_GEN, store->num_slots);
+        store->generation = DDTABLE_EMPTY_GEN + 1;
+    } else {
+        store->generation++;
+    }
+    store->count = 0;
+}
+
+//! Key and value of slot s, wherever the layout keeps them
+static inline double* store_key(const struct adaptive_store* store,
+                                const uint64_t s)
+{
+    if (store->layout == DDADAPTIVE_CUCKOO)
+    {
+        const uint64_t b = s / DDADAPTIVE_BUCKET;
+        return &store->kv[(2 * DDADAPTIVE_BUCKET * b) +
+                          (s % DDADAPTIVE_BUCKET)];
+    }
+    return &store->kv[2 * s];
+}
+
+static inline double* store_val(const struct adaptive_store* store,
+                                const uint64_t s)
+{
+    return store_key(store, s) +
+        ((store->layout == DDADAPTIVE_CUCKOO) ? DDADAPTIVE_BUCKET : 1);
+}
+
+//! The two candidate buckets of a cuckoo key; distinct whenever possible
+static inline void cuckoo_buckets(const uint64_t hash, const uint64_t mask,
+                                  uint64_t* b1, uint64_t* b2)
+{
+    *b1 = hash & mask;
+    *b2 = (hash >> 32) & mask;
+    if (*b2 == *b1)
+    {
+        *b2 = (*b1 + 1) & mask;
+    }
+}
+
+//! First free slot of a cuckoo bucket, or -1 if it is full
+static inline int64_t cuckoo_free_slot(const struct adaptive_store* store,
+                                       const uint64_t b)
+{
+    for (uint64_t j = 0; j < DDADAPTIVE_BUCKET; j++)
+    {
+        if (store->stamps[(b * DDADAPTIVE_BUCKET) + j] != store->generation)
+        {
+            return (b * DDADAPTIVE_BUCKET) + j;
+        }
+    }
+    return -1;
+}
+
+//! Slot holding key, or -1; adds the slots (buckets for cuckoo) inspected
+static inline int64_t store_find(const struct adaptive_store* store,
+                                 const double key, const uint64_t hash,
+                                 uint64_t* probes)
+{
+    const uint8_t gen = store->generation;
+    uint64_t s = hash & store->mask;
+
+    switch (store->layout)
+    {
+        case DDADAPTIVE_CUCKOO:
+        {
+            uint64_t b[2];
+            cuckoo_buckets(hash, store->mask, &b[0], &b[1]);
+            for (int i = 0; i < 2; i++)
+            {
+                const double* keys = &store->kv[2 * DDADAPTIVE_BUCKET * b[i]];
+                ++*probes;
+                for (uint64_t j = 0; j < DDADAPTIVE_BUCKET; j++)
+                {
+                    s = (b[i] * DDADAPTIVE_BUCKET) + j;
+                    if (store->stamps[s] == gen && keys[j] == key)
+                    {
+                        return s;
+                    }
+                }
+            }
+            return -1;
+        }
+        case DDADAPTIVE_LINEAR_PROBE:
+            for (;;)
+            {
+                ++*probes;
+                if (store->stamps[s] != gen)
+                {
+                    return -1;
+                }
+                if (store->kv[2 * s] == key)
+                {
+                    return s;
+                }
+                s = (s + 1) & store->mask;
+            }
+        case DDADAPTIVE_DIRECT:
+        default:
+            ++*probes;
+            return (store->stamps[s] == gen && store->kv[2 * s] == key)
+                ? (int64_t) s : -1;
+    }
+}
+
+static inline void store_put(struct adaptive_store* store, const uint64_t s,
+                             const double key, const double val)
+{
+    store->stamps[s] = store->generation;
+    *store_key(store, s) = key;
+    *store_val(store, s) = val;
+    store->count++;
+}
+
+/* Places a cuckoo key known to be absent, displacing others along a random
+ * walk if both its buckets are full. Every displacement is a swap, so if
+ * the walk runs out of kicks, replaying the swaps backwards restores the
+ * table exactly and only the new key is turned away. */
+static int cuckoo_insert(struct adaptive_store* store, const double key,
+                         const double val, const uint64_t hash)
+{
+    uint64_t path[DDADAPTIVE_MAX_KICKS];
+    uint64_t b1, b2;
+    cuckoo_buckets(hash, store->mask, &b1, &b2);
+
+    int64_t s = cuckoo_free_slot(store, b1);
+    s = (s < 0) ? cuckoo_free_slot(store, b2) : s;
+    if (s >= 0)
+    {
+        store_put(store, s, key, val);
+        return 0;
+    }
+
+    double cur_key = key, cur_val = val;
+    uint64_t b = b1;
+    for (uint64_t k = 0; k < DDADAPTIVE_MAX_KICKS; k++)
+    {
+        path[k] = (b * DDADAPTIVE_BUCKET) + ((k + (hash >> (k % 64))) %
+                                             DDADAPTIVE_BUCKET);
+        double* slot_key = store_key(store, path[k]);
+        double* slot_val = store_val(store, path[k]);
+        const double evicted_key = *slot_key, evicted_val = *slot_val;
+        *slot_key = cur_key;
+        *slot_val = cur_val;
+        cur_key = evicted_key;
+        cur_val = evicted_val;
+
+        uint64_t e1, e2;
+        cuckoo_buckets(adaptive_hash(cur_key), store->mask, &e1, &e2);
+        b = (b == e1) ? e2 : e1;
+        s = cuckoo_free_slot(store, b);
+        if (s >= 0)
+        {
+            store_put(store, s, cur_key, cur_val);
+            return 0;
+        }
+    }
+
+    for (uint64_t k = DDADAPTIVE_MAX_KICKS; k-- > 0;)
+    {
+        double* slot_key = store_key(store, path[k]);
+        double* slot_val = store_val(store, path[k]);
+        const double displaced_key = *slot_key, displaced_val = *slot_val;
+        *slot_key = cur_key;
+        *slot_val = cur_val;
+        cur_key = displaced_key;
+        cur_val = displaced_val;
+    }
+    return 2;
+}
+
+/* Stores a pair. Returns 0 if stored, 1 if the key is already there, or 2
+ * if there is no room for it. */
+static int store_insert(struct adaptive_store* store, const double key,
+                        const double val, const uint64_t hash)
+{
+    uint64_t probes = 0;
+    if (store_find(store, key, hash, &probes) >= 0)
+    {
+        return 1;
+    }
+
+    uint64_t s = hash & store->mask;
+    switch (store->layout)
+    {
+        case DDADAPTIVE_CUCKOO:
+            return (store->count <
+                    store->num_slots * DDADAPTIVE_CUCKOO_FULL_LOAD)
+                ? cuckoo_insert(store, key, val, hash) : 2;
+        case DDADAPTIVE_LINEAR_PROBE:
+            // This also keeps slots empty, so probe sequences terminate
+            if (store->count + 1 >=
+                store->num_slots * DDADAPTIVE_PROBE_FULL_LOAD)
+            {
+                return 2;
+            }
+            while (store->stamps[s] == store->generation)
+            {
+                s = (s + 1) & store->mask;
+            }
+            break;
+        case DDADAPTIVE_DIRECT:
+        default:
+            if (store->stamps[s] == store->generation)
+            {
+                return 2; // Collision
+            }
+            break;
+    }
+    store_put(store, s, key, val);
+    return 0;
+}
+
+static int adaptive_start_migration(ddadaptive_t adaptive,
+                                    const enum ddadaptive_layout layout)
+{
+    if (adaptive->old.kv != NULL)
+    {
+        return 1; // One migration at a time
+    }
+    if (layout == adaptive->cur.layout)
+    {
+        return 0;
+    }
+    if (adaptive->cur.count == 0)
+    {
+        // Nothing to move
+        store_relayout(&adaptive->cur, layout);
+        adaptive->stats.migrations++;
+        return 0;
+    }
+
+    struct adaptive_store next;
+    if (store_init(&next, layout, adaptive->cur.num_slots) != 0)
+    {
+        return 1;
+    }
+    adaptive->old = adaptive->cur;
+    adaptive->cur = next;
+    adaptive->migrate_pos = 0;
+    adaptive->stats.migrations++;
+    return 0;
+}
+
+//! Moves the next few slots of the old layout, if a migration is under way
+static inline void adaptive_migrate_step(ddadaptive_t adaptive)
+{
+    struct adaptive_store* old = &adaptive->old;
+    if (old->kv == NULL)
+    {
+        return;
+    }
+
+    uint64_t end = adaptive->migrate_pos + DDADAPTIVE_MIGRATE_STEP;
+    end = (end < old->num_slots) ? end : old->num_slots;
+    for (uint64_t s = adaptive->migrate_pos; s < end; s++)
+    {
+        if (old->stamps[s] == old->generation)
+        {
+            const double key = *store_key(old, s);
+            old->count--;
+            if (store_insert(&adaptive->cur, key, *store_val(old, s),
+                             adaptive_hash(key)) == 2)
+            {
+                adaptive->stats.drops++;
+            }
+        }
+    }
+    adaptive->migrate_pos = end;
+
+    if (end == old->num_slots)
+    {
+        store_free(old);
+    }
+}
+
+//! Closes a sampling window once it is full, picking the next layout
+static void adaptive_sample(ddadaptive_t adaptive)
+{
+    if (adaptive->window_gets + adaptive->window_sets < DDADAPTIVE_WINDOW)
+    {
+        return;
+    }
+
+    const double load = (double) adaptive->cur.count /
+        adaptive->cur.num_slots;
+    const double reads = (double) adaptive->window_gets /
+        (adaptive->window_gets + adaptive->window_sets);
+    const double drop_rate = adaptive->window_sets
+        ? (double) adaptive->window_drops / adaptive->window_sets : 0;
+    const double mean_probes = adaptive->window_gets
+        ? (double) adaptive->window_probes / adaptive->window_gets : 0;
+    enum ddadaptive_layout next = adaptive->cur.layout;
+
+    switch (adaptive->cur.layout)
+    {
+        case DDADAPTIVE_DIRECT:
+            if (drop_rate > DDADAPTIVE_DIRECT_MAX_DROPS)
+            {
+                next = (load < DDADAPTIVE_PROBE_MAX_LOAD)
+                    ? DDADAPTIVE_LINEAR_PROBE : DDADAPTIVE_CUCKOO;
+            }
+            break;
+        case DDADAPTIVE_LINEAR_PROBE:
+            if ((reads >= 0.5 && mean_probes > DDADAPTIVE_PROBE_MAX_MEAN) ||
+                drop_rate > DDADAPTIVE_DIRECT_MAX_DROPS)
+            {
+                next = DDADAPTIVE_CUCKOO;
+            }
+            break;
+        case DDADAPTIVE_CUCKOO:
+            if (reads < 0.5 && load < DDADAPTIVE_CUCKOO_MIN_LOAD)
+            {
+                next = DDADAPTIVE_LINEAR_PROBE;
+            }
+            break;
+    }
+    adaptive_start_migration(adaptive, next);
+
+    adaptive->window_gets = 0;
+    adaptive->window_sets = 0;
+    adaptive->window_probes = 0;
+    adaptive->window_drops = 0;
+}
+
+ddadaptive_t ddadaptive_new(const uint64_t num_keys)
+{
+    uint64_t num_slots = DDADAPTIVE_MIN_SLOTS;
+    while (num_slots < num_keys)
+    {
+        num_slots <<= 1;
+    }
+
+    ddadaptive_t adaptive = calloc(1, sizeof(struct ddadaptive));
+    if (adaptive == NULL)
+    {
+        return NULL;
+    }
+    if (store_init(&adaptive->cur, DDADAPTIVE_DIRECT, num_slots) != 0)
+    {
+        free(adaptive);
+        return NULL;
+    }
+    return adaptive;
+}
+
+void ddadaptive_free(ddadaptive_t adaptive)
+{
+    if (adaptive != NULL)
+    {
+        store_free(&adaptive->old);
+        store_free(&adaptive->cur);
+        free(adaptive);
+    }
+}
+
+double ddadaptive_get_check_key(ddadaptive_t adaptive, const double key)
+{
+    adaptive_migrate_step(adaptive);
+
+    const uint64_t hash = adaptive_hash(key);
+    uint64_t probes = 0;
+    const struct adaptive_store* store = &adaptive->cur;
+    int64_t s = store_find(store, key, hash, &probes);
+    if (s < 0 && adaptive->old.kv != NULL)
+    {
+        // Not migrated yet
+        store = &adaptive->old;
+        s = store_find(store, key, hash, &probes);
+    }
+
+    const double val = (s >= 0) ? *store_val(store, s)
+        : (double) DDTABLE_NULL_VAL;
+
+    adaptive->stats.gets++;
+    adaptive->stats.hits += (s >= 0);
+    adaptive->stats.probes += probes;
+    adaptive->window_gets++;
+    adaptive->window_probes += probes;
+    // Read the value first: this may start a migration and swap the stores
+    adaptive_sample(adaptive);
+    return val;
+}
+
+int ddadaptive_set_val(ddadaptive_t adaptive, const double key,
+                       const double val)
+{
+    adaptive_migrate_step(adaptive);
+
+    const uint64_t hash = adaptive_hash(key);
+    uint64_t probes = 0;
+    int status = 1;
+    if (adaptive->old.kv == NULL ||
+        store_find(&adaptive->old, key, hash, &probes) < 0)
+    {
+        status = store_insert(&adaptive->cur, key, val, hash);
+    }
+
+    adaptive->stats.sets++;
+    adaptive->window_sets++;
+    if (status == 2)
+    {
+        adaptive->stats.drops++;
+        adaptive->window_drops++;
+    }
+    const double load = (double) adaptive->cur.count /
+        adaptive->cur.num_slots;
+    adaptive->peak_load = (load > adaptive->peak_load) ? load
+        : adaptive->peak_load;
+    adaptive_sample(adaptive);
+
+    return (status != 0);
+}
+
+void ddadaptive_clear(ddadaptive_t adaptive)
+{
+    store_free(&adaptive->old);
+    store_clear(&adaptive->cur);
+
+    // Direct mapping would have dropped about peak_load of the inserts
+    if (adaptive->cur.layout != DDADAPTIVE_DIRECT &&
+        adaptive->peak_load < DDADAPTIVE_DIRECT_MAX_DROPS)
+    {
+        adaptive_start_migration(adaptive, DDADAPTIVE_DIRECT);
+    }
+    adaptive->peak_load = 0;
+}
+
+int ddadaptive_migrate(ddadaptive_t adaptive,
+                       const enum ddadaptive_layout layout)
+{
+    return adaptive_start_migration(adaptive, layout);
+}
+
+enum ddadaptive_layout ddadaptive_layout(const ddadaptive_t adaptive)
+{
+    return adaptive->cur.layout;
+}
+
+void ddadaptive_get_stats(const ddadaptive_t adaptive,
+                          struct ddadaptive_stats* stats)
+{
+    *stats = adaptive->stats;
+    stats->layout = adaptive->cur.layout;
+    stats->migrating = (adaptive->old.kv != NULL);
+    // The old layout counts only the keys it has yet to hand over
+    stats->num_keys = adaptive->cur.count + (stats->migrating
+                                             ? adaptive->old.count : 0);
+    stats->capacity = adaptive->cur.num_slots;
+}
@@ -0,0 +1,82 @@
+#ifndef DDTABLE_ADAPTIVE_H
+#define DDTABLE_ADAPTIVE_H
+
+#ifdef _cplusplus
+extern "C" {
+#endif /* _cplusplus */
+
+#include <stdint.h>
+
+#include "libddtable.h"
+
+/* Table that picks its own layout. It starts direct-mapped like ddtable,
+ * samples its insert collision rate, probe lengths, load and read/write
+ * mix over a window of calls, and moves to linear probing or to bucketed
+ * cuckoo hashing when those suit the workload better. The move happens
+ * online: the new layout is allocated alongside the old one and every call
+ * migrates a few slots, so no single call pays for the whole rehash.
+ * Capacity is fixed at creation; not thread-safe. */
+typedef struct ddadaptive *ddadaptive_t;
+
+enum ddadaptive_layout
+{
+    //! One slot per key, as ddtable: a single probe, colliding keys dropped
+    DDADAPTIVE_DIRECT = 0,
+    //! Open addressing with linear probing; cheap inserts at moderate load
+    DDADAPTIVE_LINEAR_PROBE,
+    //! Two candidate buckets of 4 slots; lookups never probe more than two
+    //! cache lines, however high the load
+    DDADAPTIVE_CUCKOO
+};
+
+/* Counters since creation, plus the current layout. */
+struct ddadaptive_stats
+{
+    enum ddadaptive_layout layout;
+    //! Nonzero while a migration to layout is still under way
+    int migrating;
+    uint64_t num_keys;
+    uint64_t capacity;
+    uint64_t gets;
+    uint64_t hits;
+    uint64_t sets;
+    //! New keys that could not be stored (direct collisions, full table)
+    uint64_t drops;
+    //! Slots inspected by lookups, in total
+    uint64_t probes;
+    uint64_t migrations;
+};
+
+extern ddadaptive_t ddadaptive_new(const uint64_t num_keys);
+
+extern void ddadaptive_free(ddadaptive_t adaptive);
+
+/* Same conventions as ddtable_get_check_key and ddtable_set_val: a miss
+ * reads as DDTABLE_NULL_VAL, and set returns 1 if the key is already
+ * present or could not be stored. */
+extern double ddadaptive_get_check_key(ddadaptive_t adaptive,
+                                       const double key);
+
+extern int ddadaptive_set_val(ddadaptive_t adaptive, const double key,
+                              const double val);
+
+/* Empties the table. An empty table can change layout for free, so it goes
+ * back to direct mapping if the load it saw stayed low enough for it. */
+extern void ddadaptive_clear(ddadaptive_t adaptive);
+
+/* Starts migrating to layout now instead of waiting for the sampler (which
+ * may still move on from it later). Returns 0 on success, or 1 if another
+ * migration is still under way or memory ran out. */
+extern int ddadaptive_migrate(ddadaptive_t adaptive,
+                              const enum ddadaptive_layout layout);
+
+extern enum ddadaptive_layout ddadaptive_layout(const ddadaptive_t adaptive);
+
+extern void ddadaptive_get_stats(const ddadaptive_t adaptive,
+                                 struct ddadaptive_stats* stats);
+
+#ifdef _cplusplus
+}
+#endif /* _cplusplus */
+
+#endif
@@ -0,0 +1,877 @@
+#if HAVE_DDTABLE_CONFIG_H
+#include "ddtable_config.h"
+#else
+#include "../build/config/ddtable_config.h"
+#endif
+
+#include "ddtable_ckpt.h"
+#include "ddtable_internal.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+//! Starts every base image and delta record
+#define DDTABLE_CKPT_MAGIC UINT64_C(0x4444544142434b31) /* "DDTABCK1" */
+
+//! Bytes covered by one dirty bit
+#define DDTABLE_CKPT_BLOCK_BYTES (UINT64_C(1) << DDTABLE_CKPT_BLOCK_SHIFT)
+
+//! Blocks the checkpoint thread copies out per write to the log
+#ifndef DDTABLE_CKPT_CHUNK_BLOCKS
+#define DDTABLE_CKPT_CHUNK_BLOCKS 64
+#endif
+
+//! Longest the background thread sleeps between looking for work (in ms)
+#ifndef DDTABLE_CKPT_POLL_MS
+#define DDTABLE_CKPT_POLL_MS 10
+#endif
+
+//! Buffer used to copy the base image during compaction
+#define DDTABLE_CKPT_COPY_BYTES (1 << 20)
+
+/* Base image file: this header, then the table block as it was in memory
+ * (process-local pointers in it are dropped on restore). */
+struct ckpt_base_hdr
+{
+    uint64_t magic;
+    uint64_t image_bytes;
+    uint64_t block_bytes;
+    //! Last delta record folded into the image (0 for none)
+    uint64_t seq;
+    //! Random, fresh for each ddtable_ckpt_new; its delta records match it
+    uint64_t epoch;
+};
+
+/* Delta log record: this header, num_blocks entries of a block number and
+ * block_bytes of data (zero-padded past the end of the image), then a
+ * trailer of magic ^ seq that marks the record complete. Records of another
+ * epoch belong to an older base (left behind by a crash between writing a
+ * new base and truncating the log) and end the replay. */
+struct ckpt_delta_hdr
+{
+    uint64_t magic;
+    uint64_t seq;
+    uint64_t num_blocks;
+    uint64_t block_bytes;
+    uint64_t epoch;
+};
+
+//! A block the writer copied out itself before modifying it
+struct dd_cow_block
+{
+    struct dd_cow_block* next;
+    uint64_t block;
+    uint8_t data[];
+};
+
+struct ddtable_ckpt
+{
+    //! First, so the table's dirty pointer leads back to its checkpoint
+    struct ddtable_dirty dirty;
+    ddtable_t ddtable;
+    uint64_t image_bytes;
+    char* path;
+    char* delta_path;
+    char* tmp_path;
+    int delta_fd;
+    uint64_t epoch;
+    //! Set by the writer if it couldn't copy a block; voids the checkpoint
+    uint8_t cow_failed;
+    //! Serializes logging and compaction, and guards everything below
+    pthread_mutex_t file_lock;
+    uint64_t seq;
+    uint64_t delta_bytes;
+    struct ddtable_ckpt_stats stats;
+    //! Updated by the writer, outside the lock
+    uint64_t blocks_copied_on_write;
+    uint64_t interval_ms;
+    uint64_t compact_bytes;
+    int has_thread;
+    int stop;
+    pthread_t thread;
+};
+
+static inline struct ddtable_ckpt* ckpt_of(struct ddtable_dirty* dirty)
+{
+    return (struct ddtable_ckpt*) dirty;
+}
+
+static int write_all(const int fd, const void* buf, size_t len)
+{
+    const uint8_t* at = buf;
+    while (len > 0)
+    {
+        const ssize_t n = write(fd, at, len);
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n <= 0)
+        {
+            return -1;
+        }
+        at += n;
+        len -= (size_t) n;
+    }
+    return 0;
+}
+
+static int pread_all(const int fd, void* buf, size_t len, off_t offset)
+{
+    uint8_t* at = buf;
+    while (len > 0)
+    {
+        const ssize_t n = pread(fd, at, len, offset);
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n <= 0)
+        {
+            return -1;
+        }
+        at += n;
+        len -= (size_t) n;
+        offset += n;
+    }
+    return 0;
+}
+
+static int pwrite_all(const int fd, const void* buf, size_t len,
+                      off_t offset)
+{
+    const uint8_t* at = buf;
+    while (len > 0)
+    {
+        const ssize_t n = pwrite(fd, at, len, offset);
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n <= 0)
+        {
+            return -1;
+        }
+        at += n;
+        len -= (size_t) n;
+        offset += n;
+    }
+    return 0;
+}
+
+//! Bytes of block b that lie inside an image of image_bytes
+static inline uint64_t ckpt_block_len(const uint64_t b,
+                                      const uint64_t image_bytes)
+{
+    const uint64_t start = b * DDTABLE_CKPT_BLOCK_BYTES;
+    return (image_bytes - start < DDTABLE_CKPT_BLOCK_BYTES)
+        ? image_bytes - start : DDTABLE_CKPT_BLOCK_BYTES;
+}
+
+//! Copies block b of the table into buf, zero-padding past its end
+static void ckpt_copy_block(const struct ddtable_ckpt* ckpt, const uint64_t b,
+                            uint8_t* buf)
+{
+    const uint64_t len = ckpt_block_len(b, ckpt->image_bytes);
+    memcpy(buf, (const uint8_t*) ckpt->ddtable +
+           (b * DDTABLE_CKPT_BLOCK_BYTES), len);
+    memset(buf + len, 0, DDTABLE_CKPT_BLOCK_BYTES - len);
+}
+
+/* Writer side: freezes the dirty blocks as the next checkpoint by swapping
+ * the (empty) pending bitmap in for them. Returns 1 if the last checkpoint
+ * is still being logged. */
+static int ckpt_begin_dirty(struct ddtable_dirty* dirty)
+{
+    const uint8_t flags = __atomic_load_n(&dirty->flags, __ATOMIC_ACQUIRE);
+    if (flags & DD_DIRTY_ACTIVE)
+    {
+        return 1;
+    }
+
+    const uint64_t num_words = (dirty->num_blocks + 63) / 64;
+    if (flags & DD_DIRTY_RESYNC)
+    {
+        memset(dirty->bits, 0xff, num_words * sizeof(uint64_t));
+        if (dirty->num_blocks % 64)
+        {
+            dirty->bits[num_words - 1] =
+                (UINT64_C(1) << (dirty->num_blocks % 64)) - 1;
+        }
+        dirty->num_dirty = dirty->num_blocks;
+    }
+    if (dirty->num_dirty == 0)
+    {
+        __atomic_fetch_and(&dirty->flags, (uint8_t) ~DD_DIRTY_BEGIN,
+                           __ATOMIC_RELEASE);
+        return 0;
+    }
+
+    uint64_t* frozen = dirty->bits;
+    dirty->bits = dirty->pending;
+    dirty->pending = frozen;
+    dirty->num_pending = dirty->num_dirty;
+    dirty->num_dirty = 0;
+    ckpt_of(dirty)->cow_failed = 0;
+    // Publishes the swap to the checkpoint thread, and drops BEGIN/RESYNC
+    __atomic_store_n(&dirty->flags, DD_DIRTY_ACTIVE, __ATOMIC_RELEASE);
+    return 0;
+}
+
+/* Writer side, mid-checkpoint: before block b is modified, makes sure the
+ * checkpoint has (or will get) its current contents. The writer copies it
+ * itself if it is still pending; if the checkpoint thread claimed it
+ * first, the writer only waits for that one copy to finish. */
+static void ckpt_copy_on_write(struct ddtable_dirty* dirty, const uint64_t b)
+{
+    struct ddtable_ckpt* ckpt = ckpt_of(dirty);
+    uint64_t* word = &dirty->pending[b >> 6];
+    const uint64_t mask = UINT64_C(1) << (b & 63);
+
+    if (__atomic_load_n(word, __ATOMIC_SEQ_CST) & mask)
+    {
+        // Announced before claiming, so the checkpoint thread can't finish
+        // the record between our claim and our push
+        __atomic_add_fetch(&dirty->cow_attempts, 1, __ATOMIC_SEQ_CST);
+        if (__atomic_fetch_and(word, ~mask, __ATOMIC_SEQ_CST) & mask)
+        {
+            struct dd_cow_block* node = malloc(sizeof(struct dd_cow_block) +
+                                               DDTABLE_CKPT_BLOCK_BYTES);
+            if (node != NULL)
+            {
+                node->block = b;
+                ckpt_copy_block(ckpt, b, node->data);
+                node->next = dirty->cow_list;
+                dirty->cow_list = node;
+                __atomic_add_fetch(&ckpt->blocks_copied_on_write, 1,
+                                   __ATOMIC_RELAXED);
+            } else {
+                __atomic_store_n(&ckpt->cow_failed, 1, __ATOMIC_RELAXED);
+            }
+        }
+        __atomic_add_fetch(&dirty->cow_done, 1, __ATOMIC_SEQ_CST);
+    }
+    while (__atomic_load_n(&dirty->copying, __ATOMIC_SEQ_CST) == b)
+    {
+        // The checkpoint thread is copying this very block: one memcpy
+    }
+}
+
+void dd_dirty_slow(const struct ddtable* ddtable, const uint64_t block)
+{
+    struct ddtable_dirty* dirty = ddtable->dirty;
+    uint8_t flags = __atomic_load_n(&dirty->flags, __ATOMIC_ACQUIRE);
+
+    if ((flags & DD_DIRTY_BEGIN) && !(flags & DD_DIRTY_ACTIVE))
+    {
+        ckpt_begin_dirty(dirty);
+        flags = __atomic_load_n(&dirty->flags, __ATOMIC_ACQUIRE);
+    }
+    if (flags & DD_DIRTY_ACTIVE)
+    {
+        ckpt_copy_on_write(dirty, block);
+    }
+
+    uint64_t* word = &dirty->bits[block >> 6];
+    const uint64_t mask = UINT64_C(1) << (block & 63);
+    if (!(*word & mask))
+    {
+        *word |= mask;
+        dirty->num_dirty++;
+    }
+}
+
+//! Appends one block entry to buf; returns the bytes used
+static size_t ckpt_put_entry(uint8_t* buf, const uint64_t b,
+                             const uint8_t* data)
+{
+    memcpy(buf, &b, sizeof(uint64_t));
+    if (data != NULL)
+    {
+        memcpy(buf + sizeof(uint64_t), data, DDTABLE_CKPT_BLOCK_BYTES);
+    }
+    return sizeof(uint64_t) + DDTABLE_CKPT_BLOCK_BYTES;
+}
+
+/* Logs the running checkpoint. Every pending bit is claimed and cleared
+ * even if the log can't be written, so the writer never waits on a
+ * checkpoint that gave up. Caller holds the file lock. */
+static int ckpt_log(struct ddtable_ckpt* ckpt)
+{
+    struct ddtable_dirty* dirty = &ckpt->dirty;
+    const uint64_t num_words = (dirty->num_blocks + 63) / 64;
+    const size_t entry_bytes = sizeof(uint64_t) + DDTABLE_CKPT_BLOCK_BYTES;
+    uint8_t* chunk = malloc(DDTABLE_CKPT_CHUNK_BLOCKS * entry_bytes);
+    size_t chunk_len = 0;
+    uint64_t num_logged = 0;
+
+    const struct ckpt_delta_hdr hdr = {
+        DDTABLE_CKPT_MAGIC, ckpt->seq + 1, dirty->num_pending,
+        DDTABLE_CKPT_BLOCK_BYTES, ckpt->epoch
+    };
+    int ok = (chunk != NULL) &&
+        write_all(ckpt->delta_fd, &hdr, sizeof(hdr)) == 0;
+
+    for (uint64_t w = 0; w < num_words; w++)
+    {
+        uint64_t bits;
+        while ((bits = __atomic_load_n(&dirty->pending[w], __ATOMIC_SEQ_CST)))
+        {
+            const uint64_t b = (w * 64) + __builtin_ctzll(bits);
+            const uint64_t mask = UINT64_C(1) << (b & 63);
+            // Published before the claim, so a writer that loses the
+            // claim knows to wait for the copy
+            __atomic_store_n(&dirty->copying, b, __ATOMIC_SEQ_CST);
+            if (__atomic_fetch_and(&dirty->pending[w], ~mask,
+                                   __ATOMIC_SEQ_CST) & mask)
+            {
+                if (ok)
+                {
+                    ckpt_put_entry(chunk + chunk_len, b, NULL);
+                    ckpt_copy_block(ckpt, b,
+                                    chunk + chunk_len + sizeof(uint64_t));
+                    chunk_len += entry_bytes;
+                    num_logged++;
+                }
+            }
+            __atomic_store_n(&dirty->copying, UINT64_MAX, __ATOMIC_SEQ_CST);
+
+            if (ok && chunk_len == DDTABLE_CKPT_CHUNK_BLOCKS * entry_bytes)
+            {
+                ok = write_all(ckpt->delta_fd, chunk, chunk_len) == 0;
+                chunk_len = 0;
+            }
+        }
+    }
+
+    // Every bit is clear now; wait out writers still copying a block
+    while (__atomic_load_n(&dirty->cow_done, __ATOMIC_SEQ_CST) !=
+           __atomic_load_n(&dirty->cow_attempts, __ATOMIC_SEQ_CST))
+    {
+    }
+    struct dd_cow_block* node = dirty->cow_list;
+    dirty->cow_list = NULL;
+    while (node != NULL)
+    {
+        struct dd_cow_block* next = node->next;
+        if (ok)
+        {
+            if (chunk_len == DDTABLE_CKPT_CHUNK_BLOCKS * entry_bytes)
+            {
+                ok = write_all(ckpt->delta_fd, chunk, chunk_len) == 0;
+                chunk_len = 0;
+            }
+            chunk_len += ckpt_put_entry(chunk + chunk_len, node->block,
+                                        node->data);
+            num_logged++;
+        }
+        free(node);
+        node = next;
+    }
+
+    const uint64_t trailer = DDTABLE_CKPT_MAGIC ^ hdr.seq;
+    ok = ok && !__atomic_load_n(&ckpt->cow_failed, __ATOMIC_RELAXED) &&
+        num_logged == hdr.num_blocks &&
+        write_all(ckpt->delta_fd, chunk, chunk_len) == 0 &&
+        write_all(ckpt->delta_fd, &trailer, sizeof(trailer)) == 0 &&
+        fsync(ckpt->delta_fd) == 0;
+    free(chunk);
+
+    if (ok)
+    {
+        ckpt->seq = hdr.seq;
+        ckpt->delta_bytes += sizeof(hdr) + (num_logged * entry_bytes) +
+            sizeof(trailer);
+        ckpt->stats.checkpoints++;
+        ckpt->stats.blocks_logged += num_logged;
+    } else {
+        // Drop the partial record; what it missed goes into the next one.
+        // If even that fails, restore stops at the torn record.
+        if (ftruncate(ckpt->delta_fd, (off_t) ckpt->delta_bytes) == 0)
+        {
+            lseek(ckpt->delta_fd, (off_t) ckpt->delta_bytes, SEEK_SET);
+        }
+        ckpt->stats.failures++;
+        __atomic_fetch_or(&dirty->flags, DD_DIRTY_RESYNC, __ATOMIC_RELAXED);
+    }
+    __atomic_fetch_and(&dirty->flags, (uint8_t) ~DD_DIRTY_ACTIVE,
+                       __ATOMIC_RELEASE);
+    return ok ? 0 : 1;
+}
+
+/* Calls apply on every block of every complete delta record of epoch after
+ * min_seq, record by record, and stops at the first torn or foreign one. A
+ * record is only applied once its trailer is known to be there. Returns the
+ * last seq applied (min_seq if none), or UINT64_MAX if apply failed. */
+static uint64_t ckpt_replay(const int log_fd, const uint64_t epoch,
+                            const uint64_t min_seq,
+                            int (*apply)(void* arg, const uint64_t block,
+                                         const uint8_t* data),
+                            void* arg)
+{
+    struct stat st;
+    if (fstat(log_fd, &st) != 0)
+    {
+        return min_seq;
+    }
+    const uint64_t log_bytes = (uint64_t) st.st_size;
+    const size_t entry_bytes = sizeof(uint64_t) + DDTABLE_CKPT_BLOCK_BYTES;
+    uint8_t* entry = malloc(entry_bytes);
+    uint64_t last_seq = min_seq;
+    uint64_t offset = 0;
+
+    while (entry != NULL && offset + sizeof(struct ckpt_delta_hdr) <= log_bytes)
+    {
+        struct ckpt_delta_hdr hdr;
+        uint64_t trailer;
+        if (pread_all(log_fd, &hdr, sizeof(hdr), (off_t) offset) != 0 ||
+            hdr.magic != DDTABLE_CKPT_MAGIC ||
+            hdr.block_bytes != DDTABLE_CKPT_BLOCK_BYTES ||
+            hdr.epoch != epoch ||
+            hdr.num_blocks > (log_bytes - offset) / entry_bytes)
+        {
+            break;
+        }
+        const uint64_t body = offset + sizeof(hdr);
+        const uint64_t end = body + (hdr.num_blocks * entry_bytes);
+        if (end + sizeof(trailer) > log_bytes ||
+            pread_all(log_fd, &trailer, sizeof(trailer), (off_t) end) != 0 ||
+            trailer != (DDTABLE_CKPT_MAGIC ^ hdr.seq))
+        {
+            break;
+        }
+
+        if (hdr.seq > min_seq)
+        {
+            for (uint64_t i = 0; i < hdr.num_blocks; i++)
+            {
+                uint64_t b;
+                if (pread_all(log_fd, entry, entry_bytes,
+                              (off_t) (body + (i * entry_bytes))) != 0)
+                {
+                    free(entry);
+                    return UINT64_MAX;
+                }
+                memcpy(&b, entry, sizeof(uint64_t));
+                if (apply(arg, b, entry + sizeof(uint64_t)) != 0)
+                {
+                    free(entry);
+                    return UINT64_MAX;
+                }
+            }
+            last_seq = hdr.seq;
+        }
+        offset = end + sizeof(trailer);
+    }
+    free(entry);
+    return last_seq;
+}
+
+//! Target of a replay into a base image file
+struct ckpt_file_target
+{
+    int fd;
+    uint64_t image_bytes;
+};
+
+static int ckpt_apply_to_file(void* arg, const uint64_t block,
+                              const uint8_t* data)
+{
+    const struct ckpt_file_target* target = arg;
+    if (block * DDTABLE_CKPT_BLOCK_BYTES >= target->image_bytes)
+    {
+        return -1;
+    }
+    return pwrite_all(target->fd, data,
+                      ckpt_block_len(block, target->image_bytes),
+                      (off_t) (sizeof(struct ckpt_base_hdr) +
+                               (block * DDTABLE_CKPT_BLOCK_BYTES)));
+}
+
+//! Target of a replay into a table image in memory
+struct ckpt_mem_target
+{
+    uint8_t* image;
+    uint64_t image_bytes;
+};
+
+static int ckpt_apply_to_mem(void* arg, const uint64_t block,
+                             const uint8_t* data)
+{
+    const struct ckpt_mem_target* target = arg;
+    if (block * DDTABLE_CKPT_BLOCK_BYTES >= target->image_bytes)
+    {
+        return -1;
+    }
+    memcpy(target->image + (block * DDTABLE_CKPT_BLOCK_BYTES), data,
+           ckpt_block_len(block, target->image_bytes));
+    return 0;
+}
+
+//! A random epoch, from /dev/urandom or failing that the clock and pid
+static uint64_t ckpt_new_epoch(void)
+{
+    uint64_t epoch = 0;
+    const int fd = open("/dev/urandom", O_RDONLY);
+    if (fd >= 0)
+    {
+        if (read(fd, &epoch, sizeof(epoch)) != sizeof(epoch))
+        {
+            epoch = 0;
+        }
+        close(fd);
+    }
+    if (epoch == 0)
+    {
+        struct timespec now;
+        clock_gettime(CLOCK_REALTIME, &now);
+        epoch = ((uint64_t) now.tv_sec * 1000000000 + (uint64_t) now.tv_nsec)
+            ^ ((uint64_t) getpid() << 40);
+    }
+    return epoch;
+}
+
+//! Writes the live table as a fresh base image, via tmp_path and a rename
+static int ckpt_write_base(struct ddtable_ckpt* ckpt)
+{
+    const struct ckpt_base_hdr hdr = {
+        DDTABLE_CKPT_MAGIC, ckpt->image_bytes, DDTABLE_CKPT_BLOCK_BYTES, 0,
+        ckpt->epoch
+    };
+    const int fd = open(ckpt->tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+    {
+        return -1;
+    }
+    int ok = write_all(fd, &hdr, sizeof(hdr)) == 0 &&
+        write_all(fd, ckpt->ddtable, ckpt->image_bytes) == 0 &&
+        fsync(fd) == 0;
+    ok = (close(fd) == 0) && ok;
+    return (ok && rename(ckpt->tmp_path, ckpt->path) == 0) ? 0 : -1;
+}
+
+static void* ckpt_thread_main(void* arg)
+{
+    ddtable_ckpt_t ckpt = arg;
+    const uint64_t poll_ms = (ckpt->interval_ms < DDTABLE_CKPT_POLL_MS)
+        ? ckpt->interval_ms : DDTABLE_CKPT_POLL_MS;
+    const struct timespec pause = {
+        (time_t) (poll_ms / 1000), (long) (poll_ms % 1000) * 1000000
+    };
+    uint64_t waited_ms = 0;
+
+    while (!__atomic_load_n(&ckpt->stop, __ATOMIC_ACQUIRE))
+    {
+        nanosleep(&pause, NULL);
+        waited_ms += poll_ms;
+
+        const uint8_t flags = __atomic_load_n(&ckpt->dirty.flags,
+                                              __ATOMIC_ACQUIRE);
+        if (flags & DD_DIRTY_ACTIVE)
+        {
+            ddtable_ckpt_write(ckpt);
+            pthread_mutex_lock(&ckpt->file_lock);
+            const int compact = ckpt->compact_bytes > 0 &&
+                ckpt->delta_bytes >= ckpt->compact_bytes;
+            pthread_mutex_unlock(&ckpt->file_lock);
+            if (compact)
+            {
+                ddtable_ckpt_compact(ckpt);
+            }
+        } else if (waited_ms >= ckpt->interval_ms &&
+                   !(flags & DD_DIRTY_BEGIN)) {
+            // The writer begins it at its next update
+            __atomic_fetch_or(&ckpt->dirty.flags, DD_DIRTY_BEGIN,
+                              __ATOMIC_RELEASE);
+            waited_ms = 0;
+        }
+    }
+    return NULL;
+}
+
+//! path with suffix appended, freshly allocated
+static char* ckpt_path(const char* path, const char* suffix)
+{
+    const size_t len = strlen(path);
+    char* out = malloc(len + strlen(suffix) + 1);
+    if (out != NULL)
+    {
+        memcpy(out, path, len);
+        strcpy(out + len, suffix);
+    }
+    return out;
+}
+
+ddtable_ckpt_t ddtable_ckpt_new(ddtable_t ddtable, const char* path,
+                                const uint64_t interval_ms,
+                                const uint64_t compact_bytes)
+{
+    if (ddtable->shared || ddtable->dirty != NULL)
+    {
+        return NULL;
+    }
+
+    ddtable_ckpt_t ckpt = calloc(1, sizeof(struct ddtable_ckpt));
+    if (ckpt == NULL)
+    {
+        return NULL;
+    }
+    ckpt->ddtable = ddtable;
+    ckpt->image_bytes = ddtable_bytes(ddtable);
+    ckpt->path = ckpt_path(path, "");
+    ckpt->delta_path = ckpt_path(path, ".delta");
+    ckpt->tmp_path = ckpt_path(path, ".tmp");
+    ckpt->delta_fd = -1;
+    ckpt->epoch = ckpt_new_epoch();
+    ckpt->interval_ms = interval_ms;
+    ckpt->compact_bytes = compact_bytes;
+    pthread_mutex_init(&ckpt->file_lock, NULL);
+
+    struct ddtable_dirty* dirty = &ckpt->dirty;
+    dirty->num_blocks = ((ckpt->image_bytes - 1) >> DDTABLE_CKPT_BLOCK_SHIFT)
+        + 1;
+    dirty->bits = calloc((dirty->num_blocks + 63) / 64, sizeof(uint64_t));
+    dirty->pending = calloc((dirty->num_blocks + 63) / 64, sizeof(uint64_t));
+    dirty->copying = UINT64_MAX;
+
+    if (ckpt->path == NULL || ckpt->delta_path == NULL ||
+        ckpt->tmp_path == NULL || dirty->bits == NULL ||
+        dirty->pending == NULL || ckpt_write_base(ckpt) != 0)
+    {
+        ddtable_ckpt_free(ckpt);
+        return NULL;
+    }
+    ckpt->delta_fd = open(ckpt->delta_path, O_WRONLY | O_CREAT | O_TRUNC,
+                          0644);
+    if (ckpt->delta_fd < 0)
+    {
+        ddtable_ckpt_free(ckpt);
+        return NULL;
+    }
+
+    ddtable->dirty = dirty;
+    if (interval_ms > 0)
+    {
+        if (pthread_create(&ckpt->thread, NULL, ckpt_thread_main, ckpt) != 0)
+        {
+            ddtable_ckpt_free(ckpt);
+            return NULL;
+        }
+        ckpt->has_thread = 1;
+    }
+    return ckpt;
+}
+
+void ddtable_ckpt_free(ddtable_ckpt_t ckpt)
+{
+    if (ckpt == NULL)
+    {
+        return;
+    }
+    if (ckpt->has_thread)
+    {
+        __atomic_store_n(&ckpt->stop, 1, __ATOMIC_RELEASE);
+        pthread_join(ckpt->thread, NULL);
+    }
+    if (ckpt->ddtable->dirty == &ckpt->dirty)
+    {
+        // A last checkpoint, so the files end up holding the table as is
+        ddtable_ckpt_run(ckpt);
+        ckpt->ddtable->dirty = NULL;
+    }
+
+    if (ckpt->delta_fd >= 0)
+    {
+        close(ckpt->delta_fd);
+    }
+    pthread_mutex_destroy(&ckpt->file_lock);
+    free(ckpt->dirty.pending);
+    free(ckpt->dirty.bits);
+    free(ckpt->tmp_path);
+    free(ckpt->delta_path);
+    free(ckpt->path);
+    free(ckpt);
+}
+
+int ddtable_ckpt_begin(ddtable_ckpt_t ckpt)
+{
+    return ckpt_begin_dirty(&ckpt->dirty);
+}
+
+int ddtable_ckpt_write(ddtable_ckpt_t ckpt)
+{
+    pthread_mutex_lock(&ckpt->file_lock);
+    int ret = 0;
+    if (__atomic_load_n(&ckpt->dirty.flags, __ATOMIC_ACQUIRE) &
+        DD_DIRTY_ACTIVE)
+    {
+        ret = ckpt_log(ckpt);
+    }
+    pthread_mutex_unlock(&ckpt->file_lock);
+    return ret;
+}
+
+int ddtable_ckpt_run(ddtable_ckpt_t ckpt)
+{
+    if (ddtable_ckpt_begin(ckpt) != 0)
+    {
+        // Finish the one in flight, then take ours
+        ddtable_ckpt_write(ckpt);
+        ddtable_ckpt_begin(ckpt);
+    }
+    return ddtable_ckpt_write(ckpt);
+}
+
+int ddtable_ckpt_compact(ddtable_ckpt_t ckpt)
+{
+    pthread_mutex_lock(&ckpt->file_lock);
+
+    struct ckpt_base_hdr hdr;
+    uint8_t* buf = malloc(DDTABLE_CKPT_COPY_BYTES);
+    const int base_fd = open(ckpt->path, O_RDONLY);
+    const int tmp_fd = open(ckpt->tmp_path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    const int log_fd = open(ckpt->delta_path, O_RDONLY);
+    int ok = buf != NULL && base_fd >= 0 && tmp_fd >= 0 && log_fd >= 0 &&
+        pread_all(base_fd, &hdr, sizeof(hdr), 0) == 0 &&
+        hdr.magic == DDTABLE_CKPT_MAGIC &&
+        hdr.image_bytes == ckpt->image_bytes && hdr.epoch == ckpt->epoch;
+
+    // Copy the old base, then fold the log into the copy
+    const uint64_t total = sizeof(hdr) + ckpt->image_bytes;
+    for (uint64_t off = 0; ok && off < total; off += DDTABLE_CKPT_COPY_BYTES)
+    {
+        const size_t len = (total - off < DDTABLE_CKPT_COPY_BYTES)
+            ? (size_t) (total - off) : DDTABLE_CKPT_COPY_BYTES;
+        ok = pread_all(base_fd, buf, len, (off_t) off) == 0 &&
+            pwrite_all(tmp_fd, buf, len, (off_t) off) == 0;
+    }
+    if (ok)
+    {
+        struct ckpt_file_target target = { tmp_fd, ckpt->image_bytes };
+        hdr.seq = ckpt_replay(log_fd, hdr.epoch, hdr.seq, ckpt_apply_to_file,
+                              &target);
+        ok = hdr.seq != UINT64_MAX &&
+            pwrite_all(tmp_fd, &hdr, sizeof(hdr), 0) == 0 &&
+            fsync(tmp_fd) == 0;
+    }
+
+    free(buf);
+    if (log_fd >= 0)
+    {
+        close(log_fd);
+    }
+    if (base_fd >= 0)
+    {
+        close(base_fd);
+    }
+    if (tmp_fd >= 0)
+    {
+        ok = (close(tmp_fd) == 0) && ok;
+    }
+    // Once the new base is in place the log is redundant; if truncating it
+    // fails, restore skips its records by seq anyway
+    ok = ok && rename(ckpt->tmp_path, ckpt->path) == 0;
+    if (ok && ftruncate(ckpt->delta_fd, 0) == 0 &&
+        lseek(ckpt->delta_fd, 0, SEEK_SET) == 0)
+    {
+        ckpt->delta_bytes = 0;
+    }
+
+    if (ok)
+    {
+        ckpt->stats.compactions++;
+    } else {
+        unlink(ckpt->tmp_path);
+        ckpt->stats.failures++;
+    }
+    pthread_mutex_unlock(&ckpt->file_lock);
+    return ok ? 0 : 1;
+}
+
+void ddtable_ckpt_get_stats(const ddtable_ckpt_t ckpt,
+                           struct ddtable_ckpt_stats* stats)
+{
+    pthread_mutex_lock(&ckpt->file_lock);
+    *stats = ckpt->stats;
+    stats->delta_bytes = ckpt->delta_bytes;
+    pthread_mutex_unlock(&ckpt->file_lock);
+    stats->blocks_copied_on_write =
+        __atomic_load_n(&ckpt->blocks_copied_on_write, __ATOMIC_RELAXED);
+}
+
+ddtable_t ddtable_ckpt_restore(const char* path)
+{
+    struct ckpt_base_hdr hdr;
+    const int base_fd = open(path, O_RDONLY);
+    if (base_fd < 0)
+    {
+        return NULL;
+    }
+    if (pread_all(base_fd, &hdr, sizeof(hdr), 0) != 0 ||
+        hdr.magic != DDTABLE_CKPT_MAGIC ||
+        hdr.block_bytes != DDTABLE_CKPT_BLOCK_BYTES ||
+        hdr.image_bytes < sizeof(struct ddtable) ||
+        hdr.image_bytes > SIZE_MAX)
+    {
+        close(base_fd);
+        return NULL;
+    }
+
+    void* mem = NULL;
+    if (posix_memalign(&mem, DDTABLE_CACHE_LINE, hdr.image_bytes) != 0)
+    {
+        close(base_fd);
+        return NULL;
+    }
+    int ok = pread_all(base_fd, mem, hdr.image_bytes, sizeof(hdr)) == 0;
+    close(base_fd);
+
+    char* delta_path = ckpt_path(path, ".delta");
+    const int log_fd = (delta_path != NULL) ? open(delta_path, O_RDONLY) : -1;
+    if (ok && log_fd >= 0)
+    {
+        struct ckpt_mem_target target = { mem, hdr.image_bytes };
+        ok = ckpt_replay(log_fd, hdr.epoch, hdr.seq, ckpt_apply_to_mem,
+                         &target) != UINT64_MAX;
+    }
+    if (log_fd >= 0)
+    {
+        close(log_fd);
+    }
+    free(delta_path);
+
+    // The image must describe a table of exactly its own size, laid out as
+    // dd_table_init would, so a damaged one can't send lookups out of it
+    ddtable_t ddtable = mem;
+#if DDTABLE_ENFORCE_POW2
+    const uint64_t want_size = ddtable->num_kv_pairs - 1;
+#else
+    const uint64_t want_size = ddtable->num_kv_pairs;
+#endif
+    ok = ok && ddtable->key_width <= DDTABLE_MAX_KEY_WIDTH &&
+        dd_table_bytes(ddtable->num_kv_pairs, ddtable->key_width,
+                       ddtable->val_width) == hdr.image_bytes &&
+        ddtable->size == want_size &&
+        ddtable->stride == dd_stride(ddtable->key_width, ddtable->val_width) &&
+        ddtable->exists_offset + ddtable->num_kv_pairs == hdr.image_bytes &&
+        ddtable->linear_count <= ddtable->num_kv_pairs;
+    if (!ok)
+    {
+        free(mem);
+        return NULL;
+    }
+    ddtable->shared = 0;
+    ddtable->traced = 0;
+    ddtable->cache = NULL;
+    ddtable->order = NULL;
+    ddtable->dirty = NULL;
+    return ddtable;
+}
@@ -0,0 +1,96 @@
+#ifndef DDTABLE_CKPT_H
+#define DDTABLE_CKPT_H
+
+#ifdef _cplusplus
+extern "C" {
+#endif /* _cplusplus */
+
+#include <stdint.h>
+
+#include "libddtable.h"
+
+/* Incremental checkpoints of a table to disk.
+ *
+ * A table is one contiguous block of memory, so its image on disk is that
+ * block. Attaching a checkpoint writes a full base image to path and from
+ * then on tracks which 4KB blocks of the table are written. Each checkpoint
+ * appends only the blocks dirtied since the previous one to a delta log at
+ * path + ".delta"; compaction folds the log back into the base image.
+ *
+ * Beginning a checkpoint swaps the dirty bitmap for an empty one in O(1)
+ * and has to happen on the table's writer thread (between its updates).
+ * The frozen blocks are then copied out and logged by whichever thread
+ * calls ddtable_ckpt_write, while the writer carries on: the writer's only
+ * extra work is copying a block itself the first time it modifies one not
+ * yet logged, so the checkpoint still holds the table exactly as it was
+ * when it began. Readers are never involved. Compaction only touches the
+ * files. Not for shared tables, and the atomic accumulators refuse tables
+ * with a checkpoint attached.
+ *
+ * Slots from ddtable_find and ddtable_upsert are marked dirty when they are
+ * handed out, so write through them before the table's next update (or
+ * ddtable_ckpt_begin): a checkpoint that begins in between may already
+ * have copied the block, and the write would then be in no checkpoint. */
+typedef struct ddtable_ckpt *ddtable_ckpt_t;
+
+struct ddtable_ckpt_stats
+{
+    uint64_t checkpoints;
+    uint64_t blocks_logged;
+    //! Blocks the writer copied before modifying them mid-checkpoint
+    uint64_t blocks_copied_on_write;
+    uint64_t compactions;
+    //! Current size of the delta log
+    uint64_t delta_bytes;
+    //! Checkpoints or compactions that failed on I/O
+    uint64_t failures;
+};
+
+/* Writes ddtable's base image to path, truncates the delta log and starts
+ * tracking. If interval_ms is nonzero, a background thread asks for a
+ * checkpoint every interval_ms (the writer begins it at its next update,
+ * so an idle table costs nothing) and logs it, compacting once the log
+ * exceeds compact_bytes (0 never). With interval_ms 0, call
+ * ddtable_ckpt_run (or begin and write) yourself. Returns NULL on failure.
+ * Call from the writer thread; the table must not change meanwhile. */
+extern ddtable_ckpt_t ddtable_ckpt_new(ddtable_t ddtable, const char* path,
+                                       const uint64_t interval_ms,
+                                       const uint64_t compact_bytes);
+
+/* Stops the background thread, logs a final checkpoint of everything
+ * written so far (including one still in flight) and stops tracking; the
+ * files stay and restore to the table as it is now. Call from the writer
+ * thread, before freeing the table. */
+extern void ddtable_ckpt_free(ddtable_ckpt_t ckpt);
+
+/* Writer thread: freezes the blocks dirtied so far as the next checkpoint.
+ * Returns 0, or 1 if the previous checkpoint is still being written. */
+extern int ddtable_ckpt_begin(ddtable_ckpt_t ckpt);
+
+/* Any thread: logs the checkpoint begun last, durably (fsync). Returns 0 if
+ * it was logged or there was none, 1 on I/O failure (the next checkpoint
+ * then logs the whole table). */
+extern int ddtable_ckpt_write(ddtable_ckpt_t ckpt);
+
+/* Writer thread: begin and write in one call. */
+extern int ddtable_ckpt_run(ddtable_ckpt_t ckpt);
+
+/* Any thread: rewrites the base image with every logged checkpoint folded
+ * in and empties the delta log. The new base replaces the old one with a
+ * rename, so a crash leaves either image intact. Returns 0 on success. */
+extern int ddtable_ckpt_compact(ddtable_ckpt_t ckpt);
+
+extern void ddtable_ckpt_get_stats(const ddtable_ckpt_t ckpt,
+                                   struct ddtable_ckpt_stats* stats);
+
+/* Rebuilds a table from the base image at path plus every complete
+ * checkpoint in its delta log (a record torn by a crash is ignored).
+ * Attachments such as front caches are not saved. Returns NULL on
+ * failure. */
+extern ddtable_t ddtable_ckpt_restore(const char* path);
+
+#ifdef _cplusplus
+}
+#endif /* _cplusplus */
+
+#endif
@@ -0,0 +1,515 @@
+#ifndef DDTABLE_INTERNAL_H
+#define DDTABLE_INTERNAL_H
+
+/* Private layout of struct ddtable, shared by the library's modules. */
+
+#include "libddtable.h"
+#include "spooky-c.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__AVX__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+//! Tiny direct-mapped front cache, checked before the main table
+struct ddtable_cache
+{
+    //! Number of cache entries minus one (entries are a power of 2)
+    uint64_t mask;
+    //! Number of lookups that consulted the cache
+    uint64_t lookups;
+    //! Number of lookups served straight from the cache
+    uint64_t hits;
+    //! Generation stamps, compared against the owning table's generation
+    uint8_t* ddtable_RESTRICT exists;
+    //! Interleaved kv pairs, same layout as the main table
+    double key_vals[];
+};
+
+/* Ordered secondary index over a table's keys, kept in Eytzinger (BFS)
+ * order so a search touches one cache line per three levels. New keys are
+ * logged to a pending batch and merged in at the next query or once the
+ * batch grows large enough. */
+struct ddtable_order
+{
+    //! Keys in the Eytzinger array; keys[1..num_keys] (index 0 unused)
+    uint64_t num_keys;
+    uint64_t capacity;
+    double* keys;
+    //! Value of each key, same positions as keys
+    double* vals;
+    //! Interleaved key/value pairs set since the last merge
+    uint64_t num_pending;
+    uint64_t pending_capacity;
+    double* pending;
+    //! Set once value slots were handed out (ddtable_find/ddtable_upsert);
+    //! from then on queries read values back from the table itself
+    uint8_t reread_vals;
+};
+
+//! log2 of the bytes of table memory covered by one dirty bit
+#ifndef DDTABLE_CKPT_BLOCK_SHIFT
+#define DDTABLE_CKPT_BLOCK_SHIFT 12
+#endif
+
+//! A running checkpoint has blocks left to copy out
+#define DD_DIRTY_ACTIVE 1
+//! The checkpoint thread wants the writer to begin a checkpoint
+#define DD_DIRTY_BEGIN 2
+//! The last checkpoint failed, so the next one must log every block
+#define DD_DIRTY_RESYNC 4
+
+/* Dirty-block tracking of a checkpointed table (see ddtable_ckpt.h), one
+ * bit per block of the table's memory. Only the table's writer touches
+ * bits; beginning a checkpoint swaps it with the empty pending bitmap, and
+ * the checkpoint thread then clears pending bits as it copies blocks out.
+ * A writer about to modify a block still pending copies it first itself. */
+struct ddtable_dirty
+{
+    //! DD_DIRTY_* flags; any set sends updates through dd_dirty_slow
+    uint8_t flags;
+    uint64_t num_blocks;
+    //! Blocks written since the last checkpoint began
+    uint64_t* bits;
+    uint64_t num_dirty;
+    //! Blocks of the running checkpoint not copied out yet
+    uint64_t* pending;
+    uint64_t num_pending;
+    //! Block the checkpoint thread is copying right now, or UINT64_MAX
+    uint64_t copying;
+    //! Copy-on-write attempts by the writer, and how many have finished
+    uint64_t cow_attempts;
+    uint64_t cow_done;
+    //! Blocks the writer copied itself, for the checkpoint thread to log
+    struct dd_cow_block* cow_list;
+};
+
+//! Line size that slot strides and the kv array are aligned to
+#define DDTABLE_CACHE_LINE 64
+
+/* A table is a single position-independent block: this header, then the
+ * kv slots, then one generation stamp per slot. Each slot holds key_width
+ * key doubles followed by val_width value doubles, padded to stride.
+ * Everything in the block is addressed by offset so it can live in memory
+ * shared between processes; only the optional process-local attachments
+ * below are pointers, and they are always NULL for shared tables. */
+struct ddtable
+{
+    //! Absolute number of key-value pairs
+    uint64_t num_kv_pairs;
+    //! Internal size used for hashing
+    uint64_t size;
+    //! Byte offset from the start of the table to the existence stamps
+    uint64_t exists_offset;
+    //! Seed passed to spooky for this table (SPOOKY_HASH_SEED by default)
+    uint64_t seed;
+    //! Doubles per key and per value; both 1 for plain ddtable_new tables,
+    //! and val_width is 0 for key-only sets (see ddtable_set.h)
+    uint32_t key_width;
+    uint32_t val_width;
+    //! Doubles between consecutive slots in key_vals
+    uint32_t stride;
+    //! Keys stored while the table is in linear-scan mode
+    uint32_t linear_count;
+    //! Current generation; a slot is occupied iff its stamp equals this
+    uint8_t generation;
+    //! Nonzero if the block lives in shared memory (see ddtable_shm.h)
+    uint8_t shared;
+    //! Nonzero if operations on this table go to the key-stream trace
+    uint8_t traced;
+    //! Nonzero if a tiny table keeps its keys packed for linear scanning
+    //! (keys in key_vals[0, num_kv_pairs), values right after) instead of
+    //! hashed; once full it drops new keys as collisions
+    uint8_t linear;
+    //! Optional front cache for hot keys (NULL if not attached)
+    struct ddtable_cache* cache;
+    //! Optional ordered index for nearest-key queries (NULL if not attached)
+    struct ddtable_order* order;
+    //! Optional dirty-block tracking for checkpoints (NULL if not attached)
+    struct ddtable_dirty* dirty;
+    //! Single-alloc array for kv pairs, cache-line aligned
+    ddtable_ALIGNED(DDTABLE_CACHE_LINE) double key_vals[];
+};
+
+//! Default NULL value (not a value) for our table
+#define DDTABLE_NULL_VAL 0
+
+//! Checks if x is a power of 2
+#define IS_POW2(x) ((x != 0) && ((x & (~x + 1)) == x))
+
+//! Enforces size must be power of 2 minus 1 (i.e. use & instead of %)
+#ifndef DDTABLE_ENFORCE_POW2
+#define DDTABLE_ENFORCE_POW2 1
+#endif
+
+//! Widest composite key supported by ddtable_new_multi
+#define DDTABLE_MAX_KEY_WIDTH 4
+
+//! Largest table ddtable_new lays out for linear scanning instead of hashing
+#ifndef DDTABLE_LINEAR_MAX_KEYS
+#define DDTABLE_LINEAR_MAX_KEYS 32
+#endif
+
+//! Generation stamp meaning "never written"; live generations start at 1
+#define DDTABLE_EMPTY_GEN 0
+//! Stamp of a slot a concurrent writer has claimed but not yet published
+#define DDTABLE_BUSY_GEN UINT8_MAX
+//! Last usable generation before the stamps must be wiped
+#define DDTABLE_MAX_GEN (DDTABLE_BUSY_GEN - 1)
+
+//! Sets the seed we pass to spooky
+#ifndef SPOOKY_HASH_SEED
+#define SPOOKY_HASH_SEED 0
+#endif
+
+// TODO: Support other hash functions?
+//! Full 64-bit spooky hash of a key, before reducing it to a table index
+static inline uint64_t dd_raw_hash(const double key, const uint64_t seed)
+{
+    return spooky_hash64(&key, sizeof(double), seed);
+}
+
+//! spooky's SC_CONST, needed to replay its short path below
+#define DD_SPOOKY_CONST UINT64_C(0xdeadbeefdeadbeef)
+
+//! One rotate-add-xor step of spooky's short_end, on scalars or on vectors
+#define DD_SHORT_END_STEP(ROT, ADD, XOR, x, y, k) \
+    x = XOR(x, y); y = ROT(y, k); x = ADD(x, y)
+
+#define DD_SHORT_END(ROT, ADD, XOR, h0, h1, h2, h3) \
+    do { \
+        DD_SHORT_END_STEP(ROT, ADD, XOR, h3, h2, 15); \
+        DD_SHORT_END_STEP(ROT, ADD, XOR, h0, h3, 52); \
+        DD_SHORT_END_STEP(ROT, ADD, XOR, h1, h0, 26); \
+        DD_SHORT_END_STEP(ROT, ADD, XOR, h2, h1, 51); \
+        DD_SHORT_END_STEP(ROT, ADD, XOR, h3, h2, 28); \
+        DD_SHORT_END_STEP(ROT, ADD, XOR, h0, h3, 9); \
+        DD_SHORT_END_STEP(ROT, ADD, XOR, h1, h0, 47); \
+        DD_SHORT_END_STEP(ROT, ADD, XOR, h2, h1, 54); \
+        DD_SHORT_END_STEP(ROT, ADD, XOR, h3, h2, 32); \
+        DD_SHORT_END_STEP(ROT, ADD, XOR, h0, h3, 25); \
+        DD_SHORT_END_STEP(ROT, ADD, XOR, h1, h0, 63); \
+    } while (0)
+
+#define DD_ROT64(x, k) (((x) << (k)) | ((x) >> (64 - (k))))
+#define DD_ADD64(x, y) ((x) + (y))
+#define DD_XOR64(x, y) ((x) ^ (y))
+#if defined(__AVX512F__)
+#define DD_ROT512(x, k) _mm512_rol_epi64(x, k)
+#endif
+#if defined(__AVX2__)
+#define DD_ROT256(x, k) \
+    _mm256_or_si256(_mm256_slli_epi64(x, k), _mm256_srli_epi64(x, 64 - (k)))
+#endif
+
+/* dd_raw_hash of num_keys keys at once. An 8-byte message takes spooky's
+ * short path with every input but the key fixed, which comes down to one
+ * short_end round per key; replaying that round lane-wise hashes 8 keys
+ * per AVX-512 vector or 4 per AVX2 vector, with identical results. */
+static inline void dd_raw_hash_block(const double* keys,
+                                     const uint64_t num_keys,
+                                     const uint64_t seed, uint64_t* hashes)
+{
+    uint64_t i = 0;
+
+#if defined(__AVX512F__)
+    for (; i + 8 <= num_keys; i += 8)
+    {
+        __m512i h0 = _mm512_set1_epi64((long long) seed);
+        __m512i h1 = h0;
+        __m512i h2 = _mm512_add_epi64(
+            _mm512_loadu_si512((const void*) (keys + i)),
+            _mm512_set1_epi64((long long) DD_SPOOKY_CONST));
+        __m512i h3 = _mm512_set1_epi64((long long) (UINT64_C(8) << 56));
+        DD_SHORT_END(DD_ROT512, _mm512_add_epi64, _mm512_xor_si512,
+                     h0, h1, h2, h3);
+        _mm512_storeu_si512((void*) (hashes + i), h0);
+    }
+#endif
+#if defined(__AVX2__)
+    for (; i + 4 <= num_keys; i += 4)
+    {
+        __m256i h0 = _mm256_set1_epi64x((long long) seed);
+        __m256i h1 = h0;
+        __m256i h2 = _mm256_add_epi64(
+            _mm256_loadu_si256((const __m256i*) (keys + i)),
+            _mm256_set1_epi64x((long long) DD_SPOOKY_CONST));
+        __m256i h3 = _mm256_set1_epi64x((long long) (UINT64_C(8) << 56));
+        DD_SHORT_END(DD_ROT256, _mm256_add_epi64, _mm256_xor_si256,
+                     h0, h1, h2, h3);
+        _mm256_storeu_si256((__m256i*) (hashes + i), h0);
+    }
+#endif
+    for (; i < num_keys; i++)
+    {
+        uint64_t h0 = seed;
+        uint64_t h1 = seed;
+        uint64_t h2;
+        memcpy(&h2, &keys[i], sizeof(double));
+        h2 += DD_SPOOKY_CONST;
+        uint64_t h3 = UINT64_C(8) << 56;
+        DD_SHORT_END(DD_ROT64, DD_ADD64, DD_XOR64, h0, h1, h2, h3);
+        hashes[i] = h0;
+    }
+}
+
+//! Reduces a raw hash to an index into a table of the given size
+static inline uint64_t dd_index(const uint64_t hash, const uint64_t size)
+{
+    #if DDTABLE_ENFORCE_POW2
+    // Can use faster & instead of % if we enforce power of 2 size.
+    return hash & size;
+    #else
+    return hash % size;
+    #endif
+}
+
+//! Hash function using spooky 64-bit hash with the table's own seed
+static inline uint64_t dd_hash(const double key, const struct ddtable* ddtable)
+{
+    return dd_index(dd_raw_hash(key, ddtable->seed), ddtable->size);
+}
+
+//! Hash of a composite key of key_width doubles
+static inline uint64_t dd_raw_hash_multi(const double* keys,
+                                         const uint32_t key_width,
+                                         const uint64_t seed)
+{
+    return spooky_hash64(keys, key_width * sizeof(double), seed);
+}
+
+//! Compares two composite keys of up to DDTABLE_MAX_KEY_WIDTH doubles
+static inline int dd_keys_equal(const double* a, const double* b,
+                                const uint32_t key_width)
+{
+#if defined(__AVX__)
+    // One 256-bit compare covers every supported width; lanes past the
+    // key width are masked off the load so they never touch memory. The
+    // masks come from a table since building them needs AVX2.
+    static const int64_t lane_masks[DDTABLE_MAX_KEY_WIDTH + 1][4] = {
+        { 0, 0, 0, 0 }, { -1, 0, 0, 0 }, { -1, -1, 0, 0 },
+        { -1, -1, -1, 0 }, { -1, -1, -1, -1 }
+    };
+    const __m256i mask =
+        _mm256_loadu_si256((const __m256i*) lane_masks[key_width]);
+    const __m256d eq = _mm256_cmp_pd(_mm256_maskload_pd(a, mask),
+                                     _mm256_maskload_pd(b, mask), _CMP_EQ_OQ);
+    const int want = (1 << key_width) - 1;
+    return (_mm256_movemask_pd(eq) & want) == want;
+#elif defined(__SSE2__)
+    uint32_t i = 0;
+    for (; i + 2 <= key_width; i += 2)
+    {
+        const __m128d eq = _mm_cmpeq_pd(_mm_loadu_pd(a + i),
+                                        _mm_loadu_pd(b + i));
+        if (_mm_movemask_pd(eq) != 3)
+        {
+            return 0;
+        }
+    }
+    return (i == key_width) || (a[i] == b[i]);
+#else
+    for (uint32_t i = 0; i < key_width; i++)
+    {
+        if (a[i] != b[i])
+        {
+            return 0;
+        }
+    }
+    return 1;
+#endif
+}
+
+/* Slot stride for the given widths. Strides up to a cache line are rounded
+ * to a power of 2 and longer ones to whole lines, so with the aligned
+ * key_vals no slot spans more cache lines than it has to. */
+static inline uint32_t dd_stride(const uint32_t key_width,
+                                 const uint32_t val_width)
+{
+    const uint32_t line = DDTABLE_CACHE_LINE / sizeof(double);
+    const uint32_t width = key_width + val_width;
+    uint32_t stride = 1;
+
+    if (width > line)
+    {
+        return ((width + line - 1) / line) * line;
+    }
+    while (stride < width)
+    {
+        stride <<= 1;
+    }
+    return stride;
+}
+
+//! True for tables created by ddtable_new (one key, one value per slot)
+static inline int dd_is_scalar(const struct ddtable* ddtable)
+{
+    return ddtable->key_width == 1 && ddtable->val_width == 1;
+}
+
+//! Existence stamps of a table, located by offset rather than pointer
+static inline uint8_t* dd_exists(const struct ddtable* ddtable)
+{
+    return (uint8_t*) ddtable + ddtable->exists_offset;
+}
+
+//! Slow path of dd_touch, taken while a checkpoint is starting or running
+extern void dd_dirty_slow(const struct ddtable* ddtable, const uint64_t block);
+
+/* Records that len bytes at addr, inside the table's own block, are about
+ * to be written. Must come before the write, since a checkpoint may still
+ * need the old contents. Free when no checkpoint is attached. */
+static inline void dd_touch(const struct ddtable* ddtable, const void* addr,
+                            const size_t len)
+{
+    struct ddtable_dirty* dirty = ddtable->dirty;
+    if (dirty == NULL)
+    {
+        return;
+    }
+
+    const uintptr_t offset = (uintptr_t) addr - (uintptr_t) ddtable;
+    const uint64_t last = (offset + len - 1) >> DDTABLE_CKPT_BLOCK_SHIFT;
+    for (uint64_t b = offset >> DDTABLE_CKPT_BLOCK_SHIFT; b <= last; b++)
+    {
+        uint64_t* word = &dirty->bits[b >> 6];
+        const uint64_t mask = UINT64_C(1) << (b & 63);
+        if (__atomic_load_n(&dirty->flags, __ATOMIC_ACQUIRE))
+        {
+            dd_dirty_slow(ddtable, b);
+        } else if (!(*word & mask)) {
+            *word |= mask;
+            dirty->num_dirty++;
+        }
+    }
+}
+
+//! dd_touch of slot indx: its key and values, and its stamp
+static inline void dd_touch_slot(const struct ddtable* ddtable,
+                                 const uint64_t indx)
+{
+    if (ddtable->dirty != NULL)
+    {
+        dd_touch(ddtable, &ddtable->key_vals[ddtable->stride * indx],
+                 ddtable->stride * sizeof(double));
+        dd_touch(ddtable, dd_exists(ddtable) + indx, sizeof(uint8_t));
+    }
+}
+
+//! dd_touch of the header, for changes to the generation or linear mode
+static inline void dd_touch_header(const struct ddtable* ddtable)
+{
+    dd_touch(ddtable, ddtable, sizeof(struct ddtable));
+}
+
+//! dd_touch of entry i of a linear-mode table and of its key count
+static inline void dd_touch_linear(const struct ddtable* ddtable,
+                                   const uint32_t i)
+{
+    if (ddtable->dirty != NULL)
+    {
+        dd_touch_header(ddtable);
+        dd_touch(ddtable, &ddtable->key_vals[i], sizeof(double));
+        dd_touch(ddtable, &ddtable->key_vals[ddtable->num_kv_pairs + i],
+                 sizeof(double));
+    }
+}
+
+//! Front cache index; uses the high bits so it is independent of dd_index
+static inline uint64_t dd_cache_index(const uint64_t hash,
+                                      const struct ddtable_cache* cache)
+{
+    return (hash >> 32) & cache->mask;
+}
+
+/* Position of key among a linear-mode table's packed keys, or -1. Keys are
+ * compared a whole vector at a time; key_vals is cache-line aligned, so
+ * every vector load is aligned too. */
+static inline int64_t dd_linear_find(const struct ddtable* ddtable,
+                                     const double key)
+{
+    const double* keys = ddtable->key_vals;
+    const uint32_t count = ddtable->linear_count;
+    uint32_t i = 0;
+
+#if defined(__AVX512F__)
+    const __m512d needle8 = _mm512_set1_pd(key);
+    for (; i + 8 <= count; i += 8)
+    {
+        const unsigned int eq = _mm512_cmp_pd_mask(_mm512_load_pd(keys + i),
+                                                   needle8, _CMP_EQ_OQ);
+        if (eq)
+        {
+            return i + __builtin_ctz(eq);
+        }
+    }
+#endif
+#if defined(__AVX__)
+    const __m256d needle4 = _mm256_set1_pd(key);
+    for (; i + 4 <= count; i += 4)
+    {
+        const int eq = _mm256_movemask_pd(
+            _mm256_cmp_pd(_mm256_load_pd(keys + i), needle4, _CMP_EQ_OQ));
+        if (eq)
+        {
+            return i + __builtin_ctz(eq);
+        }
+    }
+#elif defined(__SSE2__)
+    const __m128d needle2 = _mm_set1_pd(key);
+    for (; i + 2 <= count; i += 2)
+    {
+        const int eq = _mm_movemask_pd(_mm_cmpeq_pd(_mm_load_pd(keys + i),
+                                                    needle2));
+        if (eq)
+        {
+            return i + __builtin_ctz(eq);
+        }
+    }
+#endif
+    for (; i < count; i++)
+    {
+        if (keys[i] == key)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/* Memoizer lookup through the front cache that, unlike ddtable_find,
+ * leaves the slot unexposed: 1 with *val set on a hit (a stored 0.0
+ * included), else 0. *hash is kept for dd_memo_store; handle may be NULL. */
+extern int dd_memo_probe(ddtable_t ddtable, const double key,
+                         const ddtable_hash_t* handle, uint64_t* hash,
+                         double* val);
+
+//! Stores a computed value after a dd_memo_probe miss; 1 on a collision
+extern int dd_memo_store(ddtable_t ddtable, const double key,
+                         const uint64_t hash, const double val);
+
+//! Logs a newly stored pair to the table's ordered index
+extern void dd_order_log(ddtable_t ddtable, const double key,
+                         const double val);
+
+//! Empties the ordered index along with its table
+extern void dd_order_clear(ddtable_t ddtable);
+
+//! Bytes needed for a table of num_keys slots; 0 if it can't be represented
+extern size_t dd_table_bytes(const uint64_t num_keys, const uint32_t key_width,
+                             const uint32_t val_width);
+
+//! Lays out a new, empty table in mem (which must be dd_table_bytes long)
+extern ddtable_t dd_table_init(void* mem, const uint64_t num_keys,
+                               const uint32_t key_width,
+                               const uint32_t val_width);
+
+//! Allocates a private (non-shared) table; NULL if it can't be represented
+extern ddtable_t dd_table_new(const uint64_t num_keys,
+                              const uint32_t key_width,
+                              const uint32_t val_width, const uint64_t seed);
+
+#endif
@@ -0,0 +1,320 @@
+#if HAVE_DDTABLE_CONFIG_H
+#include "ddtable_config.h"
+#else
+#include "../build/config/ddtable_config.h"
+#endif
+
+#include "libddtable.h"
+#include "ddtable_internal.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <assert.h>
+
+//! Smallest pending batch worth merging before a query forces it
+#ifndef DDTABLE_ORDER_MIN_BATCH
+#define DDTABLE_ORDER_MIN_BATCH 256
+#endif
+
+//! Doubles per cache line: one line holds a node's descendants 3 levels down
+#define DDTABLE_ORDER_LINE_KEYS (DDTABLE_CACHE_LINE / sizeof(double))
+
+static int cmp_pending(const void* a, const void* b)
+{
+    const double x = *(const double*) a;
+    const double y = *(const double*) b;
+    return (x > y) - (x < y);
+}
+
+//! Copies the Eytzinger subtree at k out in sorted order
+static uint64_t eytz_read(const struct ddtable_order* order, double* sorted,
+                          uint64_t i, const uint64_t k)
+{
+    if (k <= order->num_keys)
+    {
+        i = eytz_read(order, sorted, i, 2 * k);
+        sorted[2 * i] = order->keys[k];
+        sorted[(2 * i) + 1] = order->vals[k];
+        i = eytz_read(order, sorted, i + 1, (2 * k) + 1);
+    }
+    return i;
+}
+
+//! Fills the Eytzinger subtree at k from sorted pairs, in order
+static uint64_t eytz_write(struct ddtable_order* order, const double* sorted,
+                           uint64_t i, const uint64_t k)
+{
+    if (k <= order->num_keys)
+    {
+        i = eytz_write(order, sorted, i, 2 * k);
+        order->keys[k] = sorted[2 * i];
+        order->vals[k] = sorted[(2 * i) + 1];
+        i = eytz_write(order, sorted, i + 1, (2 * k) + 1);
+    }
+    return i;
+}
+
+static double* order_alloc(const uint64_t count)
+{
+    void* mem = NULL;
+    if (posix_memalign(&mem, DDTABLE_CACHE_LINE, count * sizeof(double)) != 0)
+    {
+        return NULL;
+    }
+    return mem;
+}
+
+/* Merges the pending batch into the index: both sides are turned into
+ * sorted pair arrays, merged (a pending pair replaces an indexed one with
+ * the same key, since it is newer) and laid back out in Eytzinger order.
+ * On allocation failure the batch simply stays pending. */
+static void order_merge(struct ddtable_order* order)
+{
+    const uint64_t num_old = order->num_keys;
+    const uint64_t num_new = order->num_pending;
+    double* old_pairs = malloc((num_old + 1) * 2 * sizeof(double));
+    double* merged = malloc((num_old + num_new) * 2 * sizeof(double));
+    if (old_pairs == NULL || merged == NULL)
+    {
+        free(merged);
+        free(old_pairs);
+        return;
+    }
+
+    eytz_read(order, old_pairs, 0, 1);
+    qsort(order->pending, num_new, 2 * sizeof(double), cmp_pending);
+
+    uint64_t i = 0, j = 0, n = 0;
+    while (i < num_old || j < num_new)
+    {
+        const double* src;
+        if (j == num_new ||
+            (i < num_old && old_pairs[2 * i] < order->pending[2 * j]))
+        {
+            src = &old_pairs[2 * i++];
+        } else {
+            if (i < num_old && old_pairs[2 * i] == order->pending[2 * j])
+            {
+                i++;
+            }
+            src = &order->pending[2 * j++];
+            // Duplicates within the batch: the later set wins
+            while (j < num_new && order->pending[2 * j] == src[0])
+            {
+                src = &order->pending[2 * j++];
+            }
+        }
+        merged[2 * n] = src[0];
+        merged[(2 * n) + 1] = src[1];
+        n++;
+    }
+    free(old_pairs);
+
+    if (n + 1 > order->capacity)
+    {
+        // Grow geometrically, in whole cache lines
+        uint64_t capacity = order->capacity ? order->capacity
+            : DDTABLE_ORDER_LINE_KEYS;
+        while (capacity < n + 1)
+        {
+            capacity *= 2;
+        }
+        double* keys = order_alloc(capacity);
+        double* vals = order_alloc(capacity);
+        if (keys == NULL || vals == NULL)
+        {
+            free(vals);
+            free(keys);
+            free(merged);
+            return;
+        }
+        free(order->keys);
+        free(order->vals);
+        order->keys = keys;
+        order->vals = vals;
+        order->capacity = capacity;
+    }
+
+    order->num_keys = n;
+    eytz_write(order, merged, 0, 1);
+    order->num_pending = 0;
+    free(merged);
+}
+
+/* Branch-free descent: lo ends at the last node whose key is <= key, and
+ * the path bits left after the final right turns give the first key > key.
+ * Returns 0 if the index is empty. */
+static uint64_t order_search(const struct ddtable_order* order,
+                             const double key, uint64_t* hi)
+{
+    const double* keys = order->keys;
+    uint64_t k = 1;
+    uint64_t lo = 0;
+
+    while (k <= order->num_keys)
+    {
+        __builtin_prefetch(&keys[DDTABLE_ORDER_LINE_KEYS * k]);
+        const uint64_t right = (keys[k] <= key);
+        lo = right ? k : lo;
+        k = (2 * k) + right;
+    }
+    *hi = k >> __builtin_ffsll(~k);
+    return lo;
+}
+
+/* Current value of an indexed key, read back from the table once callers
+ * may have written values in place. Every indexed key is still stored. */
+static double order_table_val(const struct ddtable* ddtable, const double key)
+{
+    if (ddtable->linear)
+    {
+        const int64_t i = dd_linear_find(ddtable, key);
+        assert(i >= 0);
+        return ddtable->key_vals[ddtable->num_kv_pairs + i];
+    }
+    const uint64_t indx = dd_hash(key, ddtable);
+    assert(dd_exists(ddtable)[indx] == ddtable->generation &&
+           ddtable->key_vals[2 * indx] == key);
+    return ddtable->key_vals[(2 * indx) + 1];
+}
+
+void dd_order_log(ddtable_t ddtable, const double key, const double val)
+{
+    struct ddtable_order* order = ddtable->order;
+    if (isnan(key))
+    {
+        return; // Has no place in the order
+    }
+
+    if (order->num_pending == order->pending_capacity)
+    {
+        const uint64_t capacity = order->pending_capacity
+            ? 2 * order->pending_capacity : DDTABLE_ORDER_MIN_BATCH;
+        double* pending = realloc(order->pending,
+                                  capacity * 2 * sizeof(double));
+        if (pending == NULL)
+        {
+            return; // The key just won't be found by nearest-key queries
+        }
+        order->pending = pending;
+        order->pending_capacity = capacity;
+    }
+    order->pending[2 * order->num_pending] = key;
+    order->pending[(2 * order->num_pending) + 1] = val;
+    order->num_pending++;
+
+    // Merge in batches proportional to the index, so merging stays O(1)
+    // amortized per key without letting the batch grow unbounded
+    if (order->num_pending >= DDTABLE_ORDER_MIN_BATCH &&
+        order->num_pending >= order->num_keys / 4)
+    {
+        order_merge(order);
+    }
+}
+
+void dd_order_clear(ddtable_t ddtable)
+{
+    ddtable->order->num_keys = 0;
+    ddtable->order->num_pending = 0;
+}
+
+int ddtable_attach_order(ddtable_t ddtable)
+{
+    if (ddtable->shared || !dd_is_scalar(ddtable))
+    {
+        return 1;
+    }
+    if (ddtable->order != NULL)
+    {
+        return 0;
+    }
+
+    struct ddtable_order* order = calloc(1, sizeof(struct ddtable_order));
+    if (order == NULL)
+    {
+        return 1;
+    }
+    ddtable->order = order;
+
+    // Index what the table already holds
+    if (ddtable->linear)
+    {
+        for (uint32_t i = 0; i < ddtable->linear_count; i++)
+        {
+            dd_order_log(ddtable, ddtable->key_vals[i],
+                         ddtable->key_vals[ddtable->num_kv_pairs + i]);
+        }
+    } else {
+        const uint8_t* exists = dd_exists(ddtable);
+        for (uint64_t i = 0; i < ddtable->num_kv_pairs; i++)
+        {
+            if (exists[i] == ddtable->generation)
+            {
+                dd_order_log(ddtable, ddtable->key_vals[2 * i],
+                             ddtable->key_vals[(2 * i) + 1]);
+            }
+        }
+    }
+
+    return 0;
+}
+
+void ddtable_detach_order(ddtable_t ddtable)
+{
+    struct ddtable_order* order = ddtable->order;
+    if (order != NULL)
+    {
+        free(order->pending);
+        free(order->vals);
+        free(order->keys);
+        free(order);
+        ddtable->order = NULL;
+    }
+}
+
+int ddtable_get_bracket(const ddtable_t ddtable, const double key,
+                        double* lo_key, double* lo_val,
+                        double* hi_key, double* hi_val)
+{
+    struct ddtable_order* order = ddtable->order;
+    uint64_t lo = 0, hi = 0;
+
+    if (order != NULL && !isnan(key))
+    {
+        if (order->num_pending > 0)
+        {
+            order_merge(order);
+        }
+        lo = order_search(order, key, &hi);
+        if (lo != 0 && order->keys[lo] == key)
+        {
+            hi = lo;
+        }
+    }
+
+    *lo_key = lo ? order->keys[lo] : NAN;
+    *lo_val = lo ? order->vals[lo] : (double) DDTABLE_NULL_VAL;
+    *hi_key = hi ? order->keys[hi] : NAN;
+    *hi_val = hi ? order->vals[hi] : (double) DDTABLE_NULL_VAL;
+    if (order != NULL && order->reread_vals)
+    {
+        *lo_val = lo ? order_table_val(ddtable, *lo_key) : *lo_val;
+        *hi_val = hi ? order_table_val(ddtable, *hi_key) : *hi_val;
+    }
+    return (lo == 0 || hi == 0);
+}
+
+int ddtable_get_nearest(const ddtable_t ddtable, const double key,
+                        double* near_key, double* val)
+{
+    double lo_key, lo_val, hi_key, hi_val;
+    ddtable_get_bracket(ddtable, key, &lo_key, &lo_val, &hi_key, &hi_val);
+
+    // NaN compares false, so a missing side never wins
+    const int use_hi = isnan(lo_key) || (hi_key - key < key - lo_key);
+    *near_key = use_hi ? hi_key : lo_key;
+    *val = use_hi ? hi_val : lo_val;
+    return isnan(*near_key);
+}
@@ -0,0 +1,906 @@
+#if HAVE_DDTABLE_CONFIG_H
+#include "ddtable_config.h"
+#else
+#include "../build/config/ddtable_config.h"
+#endif
+
+#include "libddtable.h"
+#include "ddtable_internal.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <unistd.h>
+
+//! Slots per partition region; 16K slots is ~272KB of kv pairs and stamps,
+//! which keeps each region's random writes inside L2
+#ifndef DDTABLE_REGION_SLOTS
+#define DDTABLE_REGION_SLOTS (1 << 14)
+#endif
+
+//! Below this many keys, thread startup costs more than it saves
+#ifndef DDTABLE_PARALLEL_MIN_KEYS
+#define DDTABLE_PARALLEL_MIN_KEYS 65536
+#endif
+
+//! Keys hashed together, and probe slots prefetched a block ahead
+#ifndef DDTABLE_HASH_BLOCK
+#define DDTABLE_HASH_BLOCK 16
+#endif
+
+//! Upper bound on worker threads, mostly to bound per-thread histograms
+#define DDTABLE_MAX_THREADS 256
+
+//! Slots per build row in a hash join's tables; at load 1/4 about one key
+//! in nine loses its slot and goes on to the next table
+#ifndef DDTABLE_JOIN_HEADROOM
+#define DDTABLE_JOIN_HEADROOM 4
+#endif
+
+//! Tables a hash join builds at most; each holds ~1/9 the keys of the last
+#define DDTABLE_JOIN_MAX_LEVELS 16
+
+//! A key/value pair tagged with its destination slot
+struct slot_rec
+{
+    uint64_t indx;
+    double key;
+    double val;
+};
+
+//! Shared state of one partitioned build
+struct build_job
+{
+    ddtable_t ddtable;
+    const double* keys;
+    const double* vals;
+    uint64_t num_keys;
+    unsigned int num_threads;
+    //! log2 of the slots per region
+    unsigned int region_shift;
+    uint64_t num_regions;
+    //! Per-thread region histograms, then per-thread scatter cursors
+    uint64_t* counts;
+    //! Start of each region's run in sorted (num_regions + 1 entries)
+    uint64_t* region_start;
+    //! Destination slot of every input key
+    uint64_t* indices;
+    //! Records grouped by region, input order preserved within a region
+    struct slot_rec* sorted;
+};
+
+//! Shared state of one hash join's probe side
+struct join_job
+{
+    //! Built tables, mapping each build key to its row: the first holds all
+    //! build rows, each later one the keys that lost their slot before it
+    const struct ddtable* levels[DDTABLE_JOIN_MAX_LEVELS];
+    unsigned int num_levels;
+    const double* build_vals;
+    const double* probe_keys;
+    uint64_t num_probe;
+    uint64_t* out_idx;
+    double* out_vals;
+    unsigned int num_threads;
+    //! Matches each thread wrote at the start of its own probe range
+    uint64_t counts[DDTABLE_MAX_THREADS];
+};
+
+//! Shared state of one partitioned merge
+struct merge_job
+{
+    ddtable_t dst;
+    const ddtable_t* srcs;
+    unsigned int num_srcs;
+    //! Sources' slots numbered consecutively: source s starts at src_start[s]
+    uint64_t* src_start;
+    uint64_t total_slots;
+    enum ddtable_merge_policy policy;
+    ddtable_combine_fn combine;
+    void* arg;
+    unsigned int num_threads;
+    unsigned int region_shift;
+    uint64_t num_regions;
+    uint64_t* counts;
+    uint64_t* region_start;
+    //! Destination slot of every source slot, UINT64_MAX if it is empty
+    uint64_t* indices;
+    struct slot_rec* sorted;
+};
+
+//! One thread's view of a job: which job, and which share of it
+struct dd_worker
+{
+    void* job;
+    unsigned int id;
+};
+
+static unsigned int dd_num_threads(unsigned int threads)
+{
+    if (threads == 0)
+    {
+        const long online = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = (online > 0) ? (unsigned int) online : 1;
+    }
+    return (threads > DDTABLE_MAX_THREADS) ? DDTABLE_MAX_THREADS : threads;
+}
+
+//! Contiguous [begin, end) share of n items for thread id
+static void dd_thread_range(const uint64_t n, const unsigned int num_threads,
+                            const unsigned int id,
+                            uint64_t* begin, uint64_t* end)
+{
+    *begin = (n * id) / num_threads;
+    *end = (n * (id + 1)) / num_threads;
+}
+
+/* Runs fn once per worker id and waits for all of them. Every id's share
+ * is independent, so if a thread can't be started its share simply runs
+ * on the calling thread instead. */
+static void dd_parallel_run(void* (*fn)(void*), void* job,
+                            const unsigned int num_threads)
+{
+    pthread_t tids[DDTABLE_MAX_THREADS];
+    struct dd_worker workers[DDTABLE_MAX_THREADS];
+    int started[DDTABLE_MAX_THREADS];
+
+    for (unsigned int t = 0; t < num_threads; t++)
+    {
+        workers[t].job = job;
+        workers[t].id = t;
+        started[t] = (t > 0) &&
+            (pthread_create(&tids[t], NULL, fn, &workers[t]) == 0);
+    }
+    for (unsigned int t = 0; t < num_threads; t++)
+    {
+        if (!started[t])
+        {
+            fn(&workers[t]);
+        }
+    }
+    for (unsigned int t = 1; t < num_threads; t++)
+    {
+        if (started[t])
+        {
+            pthread_join(tids[t], NULL);
+        }
+    }
+}
+
+//! Number of slots per region for a table, as a shift
+static unsigned int dd_region_shift(const ddtable_t ddtable)
+{
+    unsigned int shift = 0;
+    while ((UINT64_C(1) << shift) < DDTABLE_REGION_SLOTS &&
+           (UINT64_C(1) << shift) < ddtable->num_kv_pairs)
+    {
+        shift++;
+    }
+    return shift;
+}
+
+/* Turns per-thread histograms into scatter cursors. Ordering runs by
+ * (region, thread) keeps the original input order inside each region, so
+ * the first of several colliding keys still wins as it would serially. */
+static void dd_prefix_sum(uint64_t* counts, uint64_t* region_start,
+                          const uint64_t num_regions,
+                          const unsigned int num_threads)
+{
+    uint64_t offset = 0;
+    for (uint64_t r = 0; r < num_regions; r++)
+    {
+        region_start[r] = offset;
+        for (unsigned int t = 0; t < num_threads; t++)
+        {
+            const uint64_t c = counts[t * num_regions + r];
+            counts[t * num_regions + r] = offset;
+            offset += c;
+        }
+    }
+    region_start[num_regions] = offset;
+}
+
+//! Phase 1: hash a chunk of keys in one tight pass, histogramming regions
+static void* build_hash_phase(void* arg)
+{
+    const struct dd_worker* worker = arg;
+    struct build_job* job = worker->job;
+    uint64_t* counts = &job->counts[worker->id * job->num_regions];
+    uint64_t begin, end;
+
+    dd_thread_range(job->num_keys, job->num_threads, worker->id, &begin, &end);
+    for (uint64_t base = begin; base < end; base += DDTABLE_HASH_BLOCK)
+    {
+        const uint64_t n = (end - base < DDTABLE_HASH_BLOCK)
+            ? end - base : DDTABLE_HASH_BLOCK;
+        dd_raw_hash_block(&job->keys[base], n, job->ddtable->seed,
+                          &job->indices[base]);
+        for (uint64_t i = base; i < base + n; i++)
+        {
+            const uint64_t indx = dd_index(job->indices[i],
+                                           job->ddtable->size);
+            job->indices[i] = indx;
+            counts[indx >> job->region_shift]++;
+        }
+    }
+    return NULL;
+}
+
+//! Phase 2: scatter the same chunk into per-region runs
+static void* build_scatter_phase(void* arg)
+{
+    const struct dd_worker* worker = arg;
+    struct build_job* job = worker->job;
+    uint64_t* cursors = &job->counts[worker->id * job->num_regions];
+    uint64_t begin, end;
+
+    dd_thread_range(job->num_keys, job->num_threads, worker->id, &begin, &end);
+    for (uint64_t i = begin; i < end; i++)
+    {
+        const uint64_t indx = job->indices[i];
+        struct slot_rec* rec =
+            &job->sorted[cursors[indx >> job->region_shift]++];
+        rec->indx = indx;
+        rec->key = job->keys[i];
+        rec->val = (job->vals != NULL) ? job->vals[i] : (double) i;
+    }
+    return NULL;
+}
+
+//! Phase 3: fill whole regions; no two threads ever share a slot
+static void* build_fill_phase(void* arg)
+{
+    const struct dd_worker* worker = arg;
+    struct build_job* job = worker->job;
+    const ddtable_t ddtable = job->ddtable;
+    uint8_t* exists = dd_exists(ddtable);
+    const uint8_t gen = ddtable->generation;
+
+    for (uint64_t r = worker->id; r < job->num_regions; r += job->num_threads)
+    {
+        for (uint64_t i = job->region_start[r];
+             i < job->region_start[r + 1]; i++)
+        {
+            const struct slot_rec* rec = &job->sorted[i];
+            if (exists[rec->indx] != gen)
+            {
+                exists[rec->indx] = gen;
+                ddtable->key_vals[2 * rec->indx] = rec->key;
+                ddtable->key_vals[(2 * rec->indx) + 1] = rec->val;
+            }
+        }
+    }
+    return NULL;
+}
+
+/* Fills an empty table with num_keys pairs as ddtable_build_from_arrays
+ * does; with vals NULL, each key maps to its row number instead. */
+static void dd_build_into(ddtable_t ddtable, const double* keys,
+                          const double* vals, const uint64_t num_keys,
+                          unsigned int threads)
+{
+    struct build_job job;
+    job.ddtable = ddtable;
+    job.keys = keys;
+    job.vals = vals;
+    job.num_keys = num_keys;
+    job.num_threads = dd_num_threads(threads);
+    job.region_shift = dd_region_shift(ddtable);
+    job.num_regions = ((ddtable->num_kv_pairs - 1) >> job.region_shift) + 1;
+    job.counts = NULL;
+    job.region_start = NULL;
+    job.indices = NULL;
+    job.sorted = NULL;
+
+    if (job.num_threads > 1 && num_keys >= DDTABLE_PARALLEL_MIN_KEYS)
+    {
+        job.counts = calloc(job.num_threads * job.num_regions,
+                            sizeof(uint64_t));
+        job.region_start = malloc((job.num_regions + 1) * sizeof(uint64_t));
+        job.indices = malloc(num_keys * sizeof(uint64_t));
+        job.sorted = malloc(num_keys * sizeof(struct slot_rec));
+    }
+
+    if (job.counts != NULL && job.region_start != NULL &&
+        job.indices != NULL && job.sorted != NULL)
+    {
+        dd_parallel_run(build_hash_phase, &job, job.num_threads);
+        dd_prefix_sum(job.counts, job.region_start, job.num_regions,
+                      job.num_threads);
+        dd_parallel_run(build_scatter_phase, &job, job.num_threads);
+        dd_parallel_run(build_fill_phase, &job, job.num_threads);
+    } else {
+        // Small inputs (or no memory for the partitions): plain inserts
+        for (uint64_t i = 0; i < num_keys; i++)
+        {
+            ddtable_set_val(ddtable, keys[i],
+                            (vals != NULL) ? vals[i] : (double) i);
+        }
+    }
+
+    free(job.sorted);
+    free(job.indices);
+    free(job.region_start);
+    free(job.counts);
+}
+
+ddtable_t ddtable_build_from_arrays(const double* keys, const double* vals,
+                                    const uint64_t num_keys,
+                                    unsigned int threads)
+{
+    ddtable_t ddtable = ddtable_new(num_keys);
+    if (ddtable != NULL)
+    {
+        dd_build_into(ddtable, keys, vals, num_keys, threads);
+    }
+    return ddtable;
+}
+
+//! Records probe row i matching build row, at position w of the output
+static inline void join_emit(const struct join_job* job, const uint64_t w,
+                             const uint64_t i, const uint64_t row)
+{
+    job->out_idx[2 * w] = i;
+    job->out_idx[(2 * w) + 1] = row;
+    if (job->out_vals != NULL)
+    {
+        job->out_vals[w] = job->build_vals[row];
+    }
+}
+
+//! Build row of key in one of a join's tables; 0 if it isn't stored there
+static inline int join_find(const struct ddtable* ddtable, const double key,
+                            uint64_t* row)
+{
+    if (ddtable->linear)
+    {
+        const int64_t pos = dd_linear_find(ddtable, key);
+        if (pos < 0)
+        {
+            return 0;
+        }
+        *row = (uint64_t) ddtable->key_vals[ddtable->num_kv_pairs + pos];
+        return 1;
+    }
+    const uint64_t indx = dd_hash(key, ddtable);
+    if (dd_exists(ddtable)[indx] != ddtable->generation ||
+        ddtable->key_vals[2 * indx] != key)
+    {
+        return 0;
+    }
+    *row = (uint64_t) ddtable->key_vals[(2 * indx) + 1];
+    return 1;
+}
+
+//! Looks a key missing from the first table up in the later ones
+static inline int join_find_spilled(const struct join_job* job,
+                                    const double key, uint64_t* row)
+{
+    for (unsigned int l = 1; l < job->num_levels; l++)
+    {
+        if (join_find(job->levels[l], key, row))
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* Probes one contiguous range of probe keys, writing its matches from the
+ * start of the range on (a key matches at most one row, so ranges can't
+ * overlap). Hashing a block is pipelined with matching the previous one,
+ * so each block's slots are prefetched while the last block is compared. */
+static void* join_probe_phase(void* arg)
+{
+    const struct dd_worker* worker = arg;
+    struct join_job* job = worker->job;
+    const struct ddtable* ddtable = job->levels[0];
+    const double* keys = job->probe_keys;
+    uint64_t begin, end;
+    uint64_t w;
+    uint64_t row;
+
+    dd_thread_range(job->num_probe, job->num_threads, worker->id,
+                    &begin, &end);
+    w = begin;
+
+    if (ddtable->linear)
+    {
+        for (uint64_t i = begin; i < end; i++)
+        {
+            if (join_find(ddtable, keys[i], &row) ||
+                join_find_spilled(job, keys[i], &row))
+            {
+                join_emit(job, w++, i, row);
+            }
+        }
+        job->counts[worker->id] = w - begin;
+        return NULL;
+    }
+
+    const uint8_t* exists = dd_exists(ddtable);
+    const uint8_t gen = ddtable->generation;
+    uint64_t indices[2][DDTABLE_HASH_BLOCK];
+    uint64_t cur = 0;
+
+    for (uint64_t base = begin; base < end; base += DDTABLE_HASH_BLOCK)
+    {
+        const uint64_t n = (end - base < DDTABLE_HASH_BLOCK)
+            ? end - base : DDTABLE_HASH_BLOCK;
+        if (base == begin)
+        {
+            dd_raw_hash_block(&keys[base], n, ddtable->seed, indices[cur]);
+            for (uint64_t j = 0; j < n; j++)
+            {
+                indices[cur][j] = dd_index(indices[cur][j], ddtable->size);
+            }
+        }
+
+        // Hash the next block and start its loads before matching this one
+        const uint64_t next = base + n;
+        const uint64_t next_n = (end - next < DDTABLE_HASH_BLOCK)
+            ? end - next : DDTABLE_HASH_BLOCK;
+        dd_raw_hash_block(&keys[next], next_n, ddtable->seed,
+                          indices[cur ^ 1]);
+        for (uint64_t j = 0; j < next_n; j++)
+        {
+            const uint64_t indx = dd_index(indices[cur ^ 1][j],
+                                           ddtable->size);
+            indices[cur ^ 1][j] = indx;
+            __builtin_prefetch(&ddtable->key_vals[2 * indx], 0);
+            __builtin_prefetch(&exists[indx], 0);
+        }
+
+        for (uint64_t j = 0; j < n; j++)
+        {
+            const uint64_t indx = indices[cur][j];
+            if (exists[indx] == gen &&
+                ddtable->key_vals[2 * indx] == keys[base + j])
+            {
+                row = (uint64_t) ddtable->key_vals[(2 * indx) + 1];
+                join_emit(job, w++, base + j, row);
+            } else if (job->num_levels > 1 &&
+                       join_find_spilled(job, keys[base + j], &row)) {
+                join_emit(job, w++, base + j, row);
+            }
+        }
+        cur ^= 1;
+    }
+    job->counts[worker->id] = w - begin;
+    return NULL;
+}
+
+static void join_free(struct join_job* job)
+{
+    for (unsigned int l = 0; l < job->num_levels; l++)
+    {
+        ddtable_free((ddtable_t) job->levels[l]);
+    }
+}
+
+/* Builds the join's tables, mapping keys to build rows. Each table has
+ * DDTABLE_JOIN_HEADROOM slots per row it is given, and the rows whose key
+ * lost its slot to another key go on to the next, built with another seed
+ * so they scatter differently, until every key is stored. The first row of
+ * a key wins in every table, so a key's first row is the one found.
+ * Returns 0 on success, or -1 (with nothing left allocated) if out of
+ * memory. */
+static int join_build(struct join_job* job, const double* build_keys,
+                      const uint64_t num_build, unsigned int threads)
+{
+    const double* keys = build_keys;
+    double* spill_keys = NULL;
+    double* spill_rows = NULL;
+    uint64_t n = num_build;
+    int failed = 0;
+
+    job->num_levels = 0;
+    while (n > 0 && job->num_levels < DDTABLE_JOIN_MAX_LEVELS)
+    {
+        const unsigned int level = job->num_levels;
+        ddtable_t ddtable = (level == 0)
+            ? ddtable_new(DDTABLE_JOIN_HEADROOM * n)
+            : ddtable_new_seeded(DDTABLE_JOIN_HEADROOM * n,
+                                 SPOOKY_HASH_SEED + level);
+        if (ddtable == NULL)
+        {
+            failed = 1;
+            break;
+        }
+        dd_build_into(ddtable, keys, (level == 0) ? NULL : spill_rows, n,
+                      threads);
+        job->levels[job->num_levels++] = ddtable;
+
+        // Compact the rows that lost their slot (NaN never matches anyway)
+        uint64_t num_spilled = 0;
+        uint64_t row;
+        for (uint64_t i = 0; i < n; i++)
+        {
+            if (keys[i] != keys[i] || join_find(ddtable, keys[i], &row))
+            {
+                continue;
+            }
+            if (spill_keys == NULL)
+            {
+                spill_keys = malloc(n * sizeof(double));
+                spill_rows = malloc(n * sizeof(double));
+                if (spill_keys == NULL || spill_rows == NULL)
+                {
+                    failed = 1;
+                    break;
+                }
+            }
+            spill_keys[num_spilled] = keys[i];
+            spill_rows[num_spilled] = (level == 0) ? (double) i
+                : spill_rows[i];
+            num_spilled++;
+        }
+        if (failed)
+        {
+            break;
+        }
+        keys = spill_keys;
+        n = num_spilled;
+    }
+
+    free(spill_rows);
+    free(spill_keys);
+    if (failed)
+    {
+        join_free(job);
+        return -1;
+    }
+    return 0;
+}
+
+uint64_t ddtable_hash_join(const double* build_keys, const double* build_vals,
+                           const uint64_t num_build, const double* probe_keys,
+                           const uint64_t num_probe, uint64_t* out_idx,
+                           double* out_vals, unsigned int threads)
+{
+    if (num_build == 0 || num_probe == 0)
+    {
+        return 0;
+    }
+
+    struct join_job job;
+    if (join_build(&job, build_keys, num_build, threads) != 0)
+    {
+        return UINT64_MAX;
+    }
+    job.build_vals = build_vals;
+    job.probe_keys = probe_keys;
+    job.num_probe = num_probe;
+    job.out_idx = out_idx;
+    job.out_vals = (build_vals != NULL) ? out_vals : NULL;
+    job.num_threads = (num_probe >= DDTABLE_PARALLEL_MIN_KEYS)
+        ? dd_num_threads(threads) : 1;
+    dd_parallel_run(join_probe_phase, &job, job.num_threads);
+
+    // Close the gaps between the threads' runs, keeping probe order
+    uint64_t num_matches = job.counts[0];
+    for (unsigned int t = 1; t < job.num_threads; t++)
+    {
+        uint64_t begin, end;
+        dd_thread_range(num_probe, job.num_threads, t, &begin, &end);
+        memmove(&out_idx[2 * num_matches], &out_idx[2 * begin],
+                job.counts[t] * 2 * sizeof(uint64_t));
+        if (job.out_vals != NULL)
+        {
+            memmove(&out_vals[num_matches], &out_vals[begin],
+                    job.counts[t] * sizeof(double));
+        }
+        num_matches += job.counts[t];
+    }
+
+    join_free(&job);
+    return num_matches;
+}
+
+//! Reads slot i of a source table; 0 if the slot holds no entry
+static inline int merge_src_entry(const struct ddtable* src, const uint64_t i,
+                                  double* key, double* val)
+{
+    if (src->linear)
+    {
+        if (i >= src->linear_count)
+        {
+            return 0;
+        }
+        *key = src->key_vals[i];
+        *val = src->key_vals[src->num_kv_pairs + i];
+        return 1;
+    }
+    if (dd_exists(src)[i] != src->generation)
+    {
+        return 0;
+    }
+    *key = src->key_vals[2 * i];
+    *val = src->key_vals[(2 * i) + 1];
+    return 1;
+}
+
+//! Destination slot of a source entry
+static inline uint64_t merge_dst_index(const struct ddtable* dst,
+                                       const struct ddtable* src,
+                                       const uint64_t i, const double key)
+{
+    // Same shape and seed: the slot carries over without rehashing
+    if (!src->linear && src->size == dst->size && src->seed == dst->seed)
+    {
+        return i;
+    }
+    return dd_hash(key, dst);
+}
+
+//! Merges one entry into its destination slot according to the policy
+static inline void merge_apply(const struct merge_job* job,
+                               const uint64_t indx, const double key,
+                               const double val)
+{
+    const ddtable_t dst = job->dst;
+    uint8_t* exists = dd_exists(dst);
+    double* slot = &dst->key_vals[2 * indx];
+
+    if (exists[indx] != dst->generation)
+    {
+        exists[indx] = dst->generation;
+        slot[0] = key;
+        slot[1] = val;
+    } else if (slot[0] == key) {
+        switch (job->policy)
+        {
+        case DDTABLE_MERGE_KEEP_FIRST:
+            break;
+        case DDTABLE_MERGE_KEEP_LAST:
+            slot[1] = val;
+            break;
+        case DDTABLE_MERGE_COMBINE:
+            slot[1] = job->combine(key, slot[1], val, job->arg);
+            break;
+        }
+    }
+    // A different key in the slot is a plain collision: the occupant stays
+}
+
+/* merge_apply for a linear-mode dst: the key is looked up among the packed
+ * keys and appended while there is room. A full dst drops new keys, as
+ * ddtable_set_val does. */
+static void merge_apply_linear(const struct merge_job* job, const double key,
+                               const double val)
+{
+    const ddtable_t dst = job->dst;
+    const int64_t i = dd_linear_find(dst, key);
+    if (i < 0)
+    {
+        if (dst->linear_count < dst->num_kv_pairs)
+        {
+            dst->key_vals[dst->linear_count] = key;
+            dst->key_vals[dst->num_kv_pairs + dst->linear_count] = val;
+            dst->linear_count++;
+        }
+        return;
+    }
+
+    double* slot_val = &dst->key_vals[dst->num_kv_pairs + i];
+    switch (job->policy)
+    {
+    case DDTABLE_MERGE_KEEP_FIRST:
+        break;
+    case DDTABLE_MERGE_KEEP_LAST:
+        *slot_val = val;
+        break;
+    case DDTABLE_MERGE_COMBINE:
+        *slot_val = job->combine(key, *slot_val, val, job->arg);
+        break;
+    }
+}
+
+//! Source whose slots contain global slot number g
+static unsigned int merge_src_of(const struct merge_job* job, const uint64_t g)
+{
+    unsigned int s = 0;
+    while (s + 1 < job->num_srcs && job->src_start[s + 1] <= g)
+    {
+        s++;
+    }
+    return s;
+}
+
+//! Phase 1: hash a chunk of source slots, histogramming regions
+static void* merge_hash_phase(void* arg)
+{
+    const struct dd_worker* worker = arg;
+    struct merge_job* job = worker->job;
+    uint64_t* counts = &job->counts[worker->id * job->num_regions];
+    uint64_t begin, end;
+
+    dd_thread_range(job->total_slots, job->num_threads, worker->id,
+                    &begin, &end);
+    unsigned int s = merge_src_of(job, begin);
+    for (uint64_t g = begin; g < end; g++)
+    {
+        while (g >= job->src_start[s + 1])
+        {
+            s++;
+        }
+        const ddtable_t src = job->srcs[s];
+        const uint64_t i = g - job->src_start[s];
+        double key, val;
+        if (merge_src_entry(src, i, &key, &val))
+        {
+            const uint64_t indx = merge_dst_index(job->dst, src, i, key);
+            job->indices[g] = indx;
+            counts[indx >> job->region_shift]++;
+        } else {
+            job->indices[g] = UINT64_MAX;
+        }
+    }
+    return NULL;
+}
+
+//! Phase 2: scatter the same chunk into per-region runs
+static void* merge_scatter_phase(void* arg)
+{
+    const struct dd_worker* worker = arg;
+    struct merge_job* job = worker->job;
+    uint64_t* cursors = &job->counts[worker->id * job->num_regions];
+    uint64_t begin, end;
+
+    dd_thread_range(job->total_slots, job->num_threads, worker->id,
+                    &begin, &end);
+    unsigned int s = merge_src_of(job, begin);
+    for (uint64_t g = begin; g < end; g++)
+    {
+        while (g >= job->src_start[s + 1])
+        {
+            s++;
+        }
+        const uint64_t indx = job->indices[g];
+        if (indx == UINT64_MAX)
+        {
+            continue;
+        }
+        struct slot_rec* rec =
+            &job->sorted[cursors[indx >> job->region_shift]++];
+        rec->indx = indx;
+        merge_src_entry(job->srcs[s], g - job->src_start[s],
+                        &rec->key, &rec->val);
+    }
+    return NULL;
+}
+
+//! Phase 3: merge whole regions, in source order within each region
+static void* merge_fill_phase(void* arg)
+{
+    const struct dd_worker* worker = arg;
+    struct merge_job* job = worker->job;
+
+    for (uint64_t r = worker->id; r < job->num_regions; r += job->num_threads)
+    {
+        for (uint64_t i = job->region_start[r];
+             i < job->region_start[r + 1]; i++)
+        {
+            const struct slot_rec* rec = &job->sorted[i];
+            merge_apply(job, rec->indx, rec->key, rec->val);
+        }
+    }
+    return NULL;
+}
+
+int ddtable_merge(ddtable_t dst, const ddtable_t* srcs,
+                  const unsigned int num_srcs, unsigned int threads,
+                  const enum ddtable_merge_policy policy,
+                  ddtable_combine_fn combine, void* arg)
+{
+    if (!dd_is_scalar(dst) ||
+        (policy == DDTABLE_MERGE_COMBINE && combine == NULL))
+    {
+        return 1;
+    }
+    for (unsigned int s = 0; s < num_srcs; s++)
+    {
+        if (srcs[s] == dst || !dd_is_scalar(srcs[s]))
+        {
+            return 1;
+        }
+    }
+    if (num_srcs == 0)
+    {
+        return 0;
+    }
+
+    struct merge_job job;
+    job.src_start = malloc((num_srcs + 1) * sizeof(uint64_t));
+    if (job.src_start == NULL)
+    {
+        return 1;
+    }
+
+    // Workers can't track what they write, so count every block written
+    dd_touch(dst, dst->key_vals, ddtable_bytes(dst) -
+             offsetof(struct ddtable, key_vals));
+
+    job.dst = dst;
+    job.srcs = srcs;
+    job.num_srcs = num_srcs;
+    job.total_slots = 0;
+    for (unsigned int s = 0; s < num_srcs; s++)
+    {
+        job.src_start[s] = job.total_slots;
+        job.total_slots += srcs[s]->num_kv_pairs;
+    }
+    job.src_start[num_srcs] = job.total_slots;
+    job.policy = policy;
+    job.combine = combine;
+    job.arg = arg;
+    job.num_threads = dd_num_threads(threads);
+    job.region_shift = dd_region_shift(dst);
+    job.num_regions = ((dst->num_kv_pairs - 1) >> job.region_shift) + 1;
+    job.counts = NULL;
+    job.region_start = NULL;
+    job.indices = NULL;
+    job.sorted = NULL;
+
+    // A linear dst holds a few dozen keys at most, so it merges serially
+    if (job.num_threads > 1 && job.total_slots >= DDTABLE_PARALLEL_MIN_KEYS &&
+        !dst->linear)
+    {
+        job.counts = calloc(job.num_threads * job.num_regions,
+                            sizeof(uint64_t));
+        job.region_start = malloc((job.num_regions + 1) * sizeof(uint64_t));
+        job.indices = malloc(job.total_slots * sizeof(uint64_t));
+        job.sorted = malloc(job.total_slots * sizeof(struct slot_rec));
+    }
+
+    if (job.counts != NULL && job.region_start != NULL &&
+        job.indices != NULL && job.sorted != NULL)
+    {
+        dd_parallel_run(merge_hash_phase, &job, job.num_threads);
+        dd_prefix_sum(job.counts, job.region_start, job.num_regions,
+                      job.num_threads);
+        dd_parallel_run(merge_scatter_phase, &job, job.num_threads);
+        dd_parallel_run(merge_fill_phase, &job, job.num_threads);
+    } else {
+        for (unsigned int s = 0; s < num_srcs; s++)
+        {
+            for (uint64_t i = 0; i < srcs[s]->num_kv_pairs; i++)
+            {
+                double key, val;
+                if (!merge_src_entry(srcs[s], i, &key, &val))
+                {
+                    continue;
+                }
+                if (dst->linear)
+                {
+                    merge_apply_linear(&job, key, val);
+                } else {
+                    merge_apply(&job, merge_dst_index(dst, srcs[s], i, key),
+                                key, val);
+                }
+            }
+        }
+    }
+
+    free(job.sorted);
+    free(job.indices);
+    free(job.region_start);
+    free(job.counts);
+    free(job.src_start);
+
+    // Values may have been replaced, which the process-local attachments
+    // assume never happens: drop the cached copies and reindex
+    if (policy != DDTABLE_MERGE_KEEP_FIRST && dst->cache != NULL)
+    {
+        memset(dst->cache->exists, DDTABLE_EMPTY_GEN,
+               (dst->cache->mask + 1) * sizeof(uint8_t));
+    }
+    if (dst->order != NULL)
+    {
+        ddtable_detach_order(dst);
+        return ddtable_attach_order(dst);
+    }
+
+    return 0;
+}
@@ -0,0 +1,196 @@
+#if HAVE_DDTABLE_CONFIG_H
+#include "ddtable_config.h"
+#else
+#include "../build/config/ddtable_config.h"
+#endif
+
+#include "ddtable_perf.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#ifdef DDTABLE_PERF
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+static const char* const ddtable_perf_names[DDTABLE_PERF_NUM_EVENTS] = {
+    "cycles", "instructions", "L1d-misses", "LLC-misses", "dTLB-misses",
+    "branch-misses"
+};
+
+struct ddtable_perf
+{
+    //! One counter per event, -1 where the event couldn't be opened
+    int fds[DDTABLE_PERF_NUM_EVENTS];
+};
+
+#ifdef DDTABLE_PERF
+
+//! Generic cache event code: which cache, read accesses, misses
+#define DD_PERF_CACHE_MISS(cache)                       \
+    ((cache) | (PERF_COUNT_HW_CACHE_OP_READ << 8) |     \
+     (PERF_COUNT_HW_CACHE_RESULT_MISS << 16))
+
+static const struct
+{
+    uint32_t type;
+    uint64_t config;
+} ddtable_perf_events[DDTABLE_PERF_NUM_EVENTS] = {
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+    { PERF_TYPE_HW_CACHE, DD_PERF_CACHE_MISS(PERF_COUNT_HW_CACHE_L1D) },
+    { PERF_TYPE_HW_CACHE, DD_PERF_CACHE_MISS(PERF_COUNT_HW_CACHE_LL) },
+    { PERF_TYPE_HW_CACHE, DD_PERF_CACHE_MISS(PERF_COUNT_HW_CACHE_DTLB) },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES }
+};
+
+//! Counter value as read with the enabled/running times
+struct perf_read_format
+{
+    uint64_t value;
+    uint64_t time_enabled;
+    uint64_t time_running;
+};
+
+static int perf_open_event(const enum ddtable_perf_event event)
+{
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = ddtable_perf_events[event].type;
+    attr.config = ddtable_perf_events[event].config;
+    attr.disabled = 1;
+    // User space only, which also works under perf_event_paranoid=2
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED |
+        PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+    // This thread, on whichever CPU it runs
+    return (int) syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+#endif /* DDTABLE_PERF */
+
+ddtable_perf_t ddtable_perf_open(void)
+{
+#ifdef DDTABLE_PERF
+    ddtable_perf_t perf = malloc(sizeof(struct ddtable_perf));
+    if (perf == NULL)
+    {
+        return NULL;
+    }
+
+    int num_open = 0;
+    for (int e = 0; e < DDTABLE_PERF_NUM_EVENTS; e++)
+    {
+        perf->fds[e] = perf_open_event(e);
+        num_open += (perf->fds[e] >= 0);
+    }
+    if (num_open == 0)
+    {
+        free(perf);
+        return NULL;
+    }
+    return perf;
+#else
+    return NULL;
+#endif
+}
+
+void ddtable_perf_close(ddtable_perf_t perf)
+{
+#ifdef DDTABLE_PERF
+    if (perf != NULL)
+    {
+        for (int e = 0; e < DDTABLE_PERF_NUM_EVENTS; e++)
+        {
+            if (perf->fds[e] >= 0)
+            {
+                close(perf->fds[e]);
+            }
+        }
+        free(perf);
+    }
+#else
+    (void) perf;
+#endif
+}
+
+void ddtable_perf_start(ddtable_perf_t perf)
+{
+#ifdef DDTABLE_PERF
+    for (int e = 0; perf != NULL && e < DDTABLE_PERF_NUM_EVENTS; e++)
+    {
+        if (perf->fds[e] >= 0)
+        {
+            ioctl(perf->fds[e], PERF_EVENT_IOC_RESET, 0);
+            ioctl(perf->fds[e], PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+#else
+    (void) perf;
+#endif
+}
+
+void ddtable_perf_stop(ddtable_perf_t perf, struct ddtable_perf_counts* counts)
+{
+#ifdef DDTABLE_PERF
+    // Disable everything first so reading doesn't count itself
+    for (int e = 0; perf != NULL && e < DDTABLE_PERF_NUM_EVENTS; e++)
+    {
+        if (perf->fds[e] >= 0)
+        {
+            ioctl(perf->fds[e], PERF_EVENT_IOC_DISABLE, 0);
+        }
+    }
+    for (int e = 0; perf != NULL && e < DDTABLE_PERF_NUM_EVENTS; e++)
+    {
+        struct perf_read_format r;
+        if (perf->fds[e] < 0 ||
+            read(perf->fds[e], &r, sizeof(r)) != (ssize_t) sizeof(r) ||
+            r.time_running == 0)
+        {
+            continue;
+        }
+        // Extrapolate if the counter only ran part of the time
+        const double scale = (double) r.time_enabled / r.time_running;
+        counts->values[e] += (uint64_t) (r.value * scale + 0.5);
+        counts->valid |= UINT32_C(1) << e;
+    }
+#else
+    (void) perf;
+    (void) counts;
+#endif
+}
+
+const char* ddtable_perf_event_name(const enum ddtable_perf_event event)
+{
+    return (event < DDTABLE_PERF_NUM_EVENTS) ? ddtable_perf_names[event]
+        : "unknown";
+}
+
+void ddtable_perf_report(const struct ddtable_perf_counts* counts,
+                         const uint64_t num_ops, const char* label,
+                         FILE* out)
+{
+    fprintf(out, "%s", label);
+    for (int e = 0; e < DDTABLE_PERF_NUM_EVENTS; e++)
+    {
+        if (counts->valid & (UINT32_C(1) << e))
+        {
+            fprintf(out, "\t%s/op: %.2f", ddtable_perf_names[e],
+                    num_ops ? (double) counts->values[e] / num_ops : 0.0);
+        }
+    }
+    if (counts->valid == 0)
+    {
+        fprintf(out, "\t(no counters)");
+    }
+    fputc('\n', out);
+}
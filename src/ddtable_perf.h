@@ -0,0 +1,72 @@
+#ifndef DDTABLE_PERF_H
+#define DDTABLE_PERF_H
+
+#ifdef _cplusplus
+extern "C" {
+#endif /* _cplusplus */
+
+#include <stdio.h>
+#include <stdint.h>
+
+/* Hardware counters measured around table operations (Linux
+ * perf_event_open, user space only). */
+enum ddtable_perf_event
+{
+    DDTABLE_PERF_CYCLES = 0,
+    DDTABLE_PERF_INSTRUCTIONS,
+    DDTABLE_PERF_L1D_MISSES,
+    DDTABLE_PERF_LLC_MISSES,
+    DDTABLE_PERF_DTLB_MISSES,
+    DDTABLE_PERF_BRANCH_MISSES,
+    DDTABLE_PERF_NUM_EVENTS
+};
+
+/* Counts collected by one or more start/stop scopes. Events the kernel or
+ * CPU doesn't offer are left out of valid. */
+struct ddtable_perf_counts
+{
+    uint64_t values[DDTABLE_PERF_NUM_EVENTS];
+    //! Bit (1 << event) is set for every event actually counted
+    uint32_t valid;
+};
+
+/* Counter set for the calling thread. */
+typedef struct ddtable_perf *ddtable_perf_t;
+
+/* Opens whichever counters are available to the calling thread. Returns
+ * NULL if none are (no kernel support, perf_event_paranoid too strict, a
+ * container without the syscall, or a build without DDTABLE_PERF), so
+ * callers can fall back to wall-clock numbers. */
+extern ddtable_perf_t ddtable_perf_open(void);
+
+extern void ddtable_perf_close(ddtable_perf_t perf);
+
+/* Starts counting from zero. */
+extern void ddtable_perf_start(ddtable_perf_t perf);
+
+/* Stops counting and adds the counts (scaled up if the kernel had to
+ * multiplex counters) to counts. */
+extern void ddtable_perf_stop(ddtable_perf_t perf,
+                              struct ddtable_perf_counts* counts);
+
+extern const char* ddtable_perf_event_name(const enum ddtable_perf_event event);
+
+/* Prints each valid counter divided by num_ops on one line after label. */
+extern void ddtable_perf_report(const struct ddtable_perf_counts* counts,
+                                const uint64_t num_ops, const char* label,
+                                FILE* out);
+
+/* Counts the statement or block that follows into counts, e.g.
+ *     DDTABLE_PERF_SCOPE(perf, &counts) { ... lookups ... }
+ * A NULL perf makes the scope a plain block. Leaving the block early with
+ * break, goto or return skips the stop. */
+#define DDTABLE_PERF_SCOPE(perf, counts)                               \
+    for (int ddtable_perf_once_ = (ddtable_perf_start(perf), 1);       \
+         ddtable_perf_once_;                                           \
+         ddtable_perf_once_ = (ddtable_perf_stop((perf), (counts)), 0))
+
+#ifdef _cplusplus
+}
+#endif /* _cplusplus */
+
+#endif
@@ -0,0 +1,384 @@
+#if HAVE_DDTABLE_CONFIG_H
+#include "ddtable_config.h"
+#else
+#include "../build/config/ddtable_config.h"
+#endif
+
+#include "ddtable_registry.h"
+#include "ddtable_internal.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <time.h>
+
+//! Calls between automatic rebalances when the caller doesn't choose
+#ifndef DDTABLE_REGISTRY_DEFAULT_EPOCH
+#define DDTABLE_REGISTRY_DEFAULT_EPOCH (1 << 20)
+#endif
+
+//! Smallest table the registry keeps before evicting one outright
+#ifndef DDTABLE_REGISTRY_MIN_KEYS
+#define DDTABLE_REGISTRY_MIN_KEYS 64
+#endif
+
+struct registry_entry
+{
+    char* name;
+    ddtable_memo_fn fn;
+    void* arg;
+    //! NULL while evicted
+    ddtable_t table;
+    //! Size the table has (or would be readmitted at)
+    uint64_t num_keys;
+    uint64_t calls;
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t collisions;
+    //! Total measured recompute time of the misses, in nanoseconds
+    double miss_ns;
+    //! Hit rate when last evicted, used to judge readmission
+    double last_hit_rate;
+    //! Set once the entry grew during the current rebalance
+    int grown;
+};
+
+struct ddtable_registry
+{
+    uint64_t budget_bytes;
+    //! Sum of ddtable_bytes over all live tables
+    uint64_t bytes;
+    uint64_t epoch_calls;
+    uint64_t calls_since_rebalance;
+    struct registry_entry* entries;
+    int num_entries;
+};
+
+static inline double registry_now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (ts.tv_sec * 1e9) + ts.tv_nsec;
+}
+
+static inline double entry_cost_ns(const struct registry_entry* e)
+{
+    return e->misses ? e->miss_ns / e->misses : 0;
+}
+
+static inline uint64_t entry_bytes(const struct registry_entry* e)
+{
+    return (e->table != NULL) ? ddtable_bytes(e->table) : 0;
+}
+
+//! Recompute time saved per byte of table
+static double entry_density(const struct registry_entry* e)
+{
+    const uint64_t bytes = entry_bytes(e);
+    return bytes ? (e->hits * entry_cost_ns(e)) / bytes : 0;
+}
+
+/* Recompute time per extra byte that doubling the table would have saved,
+ * assuming the entries lost to collisions would have been hit as often. */
+static double entry_grow_density(const struct registry_entry* e)
+{
+    const uint64_t bytes = entry_bytes(e);
+    return bytes ? (e->collisions * entry_cost_ns(e)) / bytes : 0;
+}
+
+//! Swaps the entry's table for a rehashed copy sized for num_keys
+static int registry_resize(ddtable_registry_t registry,
+                           struct registry_entry* e, const uint64_t num_keys)
+{
+    ddtable_t new_ht = ddtable_resize(e->table, num_keys);
+    if (new_ht == NULL)
+    {
+        return 1;
+    }
+    registry->bytes -= ddtable_bytes(e->table);
+    ddtable_free(e->table);
+    e->table = new_ht;
+    e->num_keys = num_keys;
+    registry->bytes += ddtable_bytes(new_ht);
+    return 0;
+}
+
+//! Halves the entry's table, or evicts it once it is at the minimum size
+static void registry_shrink(ddtable_registry_t registry,
+                            struct registry_entry* e)
+{
+    if (e->num_keys > DDTABLE_REGISTRY_MIN_KEYS &&
+        registry_resize(registry, e, e->num_keys / 2) == 0)
+    {
+        return;
+    }
+
+    e->last_hit_rate = e->calls ? (double) e->hits / e->calls : 0;
+    registry->bytes -= ddtable_bytes(e->table);
+    ddtable_free(e->table);
+    e->table = NULL;
+    e->num_keys = DDTABLE_REGISTRY_MIN_KEYS;
+}
+
+//! Live entry with the lowest density, other than skip; NULL if none
+static struct registry_entry* registry_victim(ddtable_registry_t registry,
+                                              const struct registry_entry* skip)
+{
+    struct registry_entry* victim = NULL;
+    for (int i = 0; i < registry->num_entries; i++)
+    {
+        struct registry_entry* e = &registry->entries[i];
+        if (e->table != NULL && e != skip &&
+            (victim == NULL || entry_density(e) < entry_density(victim)))
+        {
+            victim = e;
+        }
+    }
+    return victim;
+}
+
+ddtable_registry_t ddtable_registry_new(const uint64_t budget_bytes,
+                                        const uint64_t epoch_calls)
+{
+    ddtable_registry_t registry = calloc(1, sizeof(struct ddtable_registry));
+    if (registry != NULL)
+    {
+        registry->budget_bytes = budget_bytes;
+        registry->epoch_calls = epoch_calls ? epoch_calls
+            : DDTABLE_REGISTRY_DEFAULT_EPOCH;
+    }
+    return registry;
+}
+
+void ddtable_registry_free(ddtable_registry_t registry)
+{
+    if (registry == NULL)
+    {
+        return;
+    }
+    for (int i = 0; i < registry->num_entries; i++)
+    {
+        ddtable_free(registry->entries[i].table);
+        free(registry->entries[i].name);
+    }
+    free(registry->entries);
+    free(registry);
+}
+
+int ddtable_registry_add(ddtable_registry_t registry, const char* name,
+                         ddtable_memo_fn fn, void* arg,
+                         const uint64_t num_keys)
+{
+    struct registry_entry* entries =
+        realloc(registry->entries,
+                (registry->num_entries + 1) * sizeof(struct registry_entry));
+    if (entries == NULL)
+    {
+        return -1;
+    }
+    registry->entries = entries;
+
+    struct registry_entry* e = &entries[registry->num_entries];
+    memset(e, 0, sizeof(struct registry_entry));
+    e->name = malloc(strlen(name) + 1);
+    if (e->name == NULL)
+    {
+        return -1;
+    }
+    strcpy(e->name, name);
+    e->fn = fn;
+    e->arg = arg;
+    // Until it has history, assume a new table is worth readmitting
+    e->last_hit_rate = 1.0;
+
+    // Start as large as requested, as far as the budget allows
+    e->num_keys = (num_keys > DDTABLE_REGISTRY_MIN_KEYS) ? num_keys
+        : DDTABLE_REGISTRY_MIN_KEYS;
+    while (e->num_keys > DDTABLE_REGISTRY_MIN_KEYS &&
+           registry->bytes + dd_table_bytes(e->num_keys, 1, 1) >
+           registry->budget_bytes)
+    {
+        e->num_keys /= 2;
+    }
+    if (registry->bytes + dd_table_bytes(e->num_keys, 1, 1) <=
+        registry->budget_bytes)
+    {
+        e->table = ddtable_new(e->num_keys);
+        registry->bytes += (e->table != NULL) ? ddtable_bytes(e->table) : 0;
+    }
+
+    return registry->num_entries++;
+}
+
+//! Memoized call through table id; handle is NULL to hash the key normally
+static inline double registry_call(ddtable_registry_t registry, const int id,
+                                   const double key,
+                                   const ddtable_hash_t* handle)
+{
+    struct registry_entry* e = &registry->entries[id];
+    e->calls++;
+
+    // One probe tells a cached 0.0 from a miss, and its hash is reused to
+    // store what fn computes
+    uint64_t hash = 0;
+    double val = (double) DDTABLE_NULL_VAL;
+    if (e->table != NULL && dd_memo_probe(e->table, key, handle, &hash, &val))
+    {
+        e->hits++;
+    } else {
+        const double start = registry_now_ns();
+        val = e->fn(key, e->arg);
+        e->miss_ns += registry_now_ns() - start;
+        e->misses++;
+        if (e->table != NULL && dd_memo_store(e->table, key, hash, val))
+        {
+            e->collisions++;
+        }
+    }
+
+    if (++registry->calls_since_rebalance >= registry->epoch_calls)
+    {
+        ddtable_registry_rebalance(registry);
+    }
+    return val;
+}
+
+double ddtable_registry_call(ddtable_registry_t registry, const int id,
+                             const double key)
+{
+    return registry_call(registry, id, key, NULL);
+}
+
+double ddtable_registry_call_with_hash(ddtable_registry_t registry,
+                                       const int id,
+                                       const ddtable_hash_t* handle)
+{
+    return registry_call(registry, id, handle->key, handle);
+}
+
+void ddtable_registry_rebalance(ddtable_registry_t registry)
+{
+    // Get back under budget by giving up the least valuable bytes first
+    while (registry->bytes > registry->budget_bytes)
+    {
+        struct registry_entry* victim = registry_victim(registry, NULL);
+        if (victim == NULL)
+        {
+            break;
+        }
+        registry_shrink(registry, victim);
+    }
+
+    // Readmit evicted tables that used to hit, if there is room
+    for (int i = 0; i < registry->num_entries; i++)
+    {
+        struct registry_entry* e = &registry->entries[i];
+        const uint64_t bytes = dd_table_bytes(e->num_keys, 1, 1);
+        if (e->table == NULL && e->last_hit_rate > 0 && e->calls > 0 &&
+            registry->bytes + bytes <= registry->budget_bytes)
+        {
+            e->table = ddtable_new(e->num_keys);
+            registry->bytes += (e->table != NULL) ? ddtable_bytes(e->table)
+                : 0;
+        }
+    }
+
+    /* Double the tables with the most recompute time lost to collisions per
+     * byte, taking bytes from tables that currently save less per byte. */
+    for (int i = 0; i < registry->num_entries; i++)
+    {
+        registry->entries[i].grown = 0;
+    }
+    for (;;)
+    {
+        struct registry_entry* best = NULL;
+        for (int i = 0; i < registry->num_entries; i++)
+        {
+            struct registry_entry* e = &registry->entries[i];
+            if (e->table != NULL && !e->grown && e->collisions > 0 &&
+                (best == NULL ||
+                 entry_grow_density(e) > entry_grow_density(best)))
+            {
+                best = e;
+            }
+        }
+        if (best == NULL)
+        {
+            break;
+        }
+        best->grown = 1;
+
+        const uint64_t extra = ddtable_bytes(best->table);
+        while (registry->bytes + extra > registry->budget_bytes)
+        {
+            struct registry_entry* victim = registry_victim(registry, best);
+            if (victim == NULL ||
+                entry_density(victim) >= entry_grow_density(best))
+            {
+                break;
+            }
+            registry_shrink(registry, victim);
+        }
+        if (registry->bytes + extra <= registry->budget_bytes)
+        {
+            registry_resize(registry, best, best->num_keys * 2);
+        }
+    }
+
+    // Decay so the next epoch weighs recent behavior more
+    for (int i = 0; i < registry->num_entries; i++)
+    {
+        struct registry_entry* e = &registry->entries[i];
+        e->calls /= 2;
+        e->hits /= 2;
+        e->misses /= 2;
+        e->collisions /= 2;
+        e->miss_ns /= 2;
+    }
+    registry->calls_since_rebalance = 0;
+}
+
+uint64_t ddtable_registry_bytes(const ddtable_registry_t registry)
+{
+    return registry->bytes;
+}
+
+int ddtable_registry_get_stats(const ddtable_registry_t registry,
+                               const int id,
+                               struct ddtable_registry_stats* stats)
+{
+    if (id < 0 || id >= registry->num_entries)
+    {
+        return 1;
+    }
+    const struct registry_entry* e = &registry->entries[id];
+    stats->name = e->name;
+    stats->num_slots = (e->table != NULL) ? e->table->num_kv_pairs : 0;
+    stats->bytes = entry_bytes(e);
+    stats->calls = e->calls;
+    stats->hits = e->hits;
+    stats->collisions = e->collisions;
+    stats->avg_cost_ns = entry_cost_ns(e);
+    stats->saved_ns = e->hits * stats->avg_cost_ns;
+    stats->value_density = entry_density(e);
+    return 0;
+}
+
+void ddtable_registry_dump(const ddtable_registry_t registry, FILE* out)
+{
+    fprintf(out, "# budget %"PRIu64" used %"PRIu64"\n",
+            registry->budget_bytes, registry->bytes);
+    fprintf(out, "name\tslots\tbytes\tcalls\thits\tcollisions"
+            "\tavg_cost_ns\tsaved_ns\tvalue_density\n");
+    for (int i = 0; i < registry->num_entries; i++)
+    {
+        struct ddtable_registry_stats s;
+        ddtable_registry_get_stats(registry, i, &s);
+        fprintf(out, "%s\t%"PRIu64"\t%"PRIu64"\t%"PRIu64"\t%"PRIu64
+                "\t%"PRIu64"\t%.1f\t%.0f\t%.4f\n", s.name, s.num_slots,
+                s.bytes, s.calls, s.hits, s.collisions, s.avg_cost_ns,
+                s.saved_ns, s.value_density);
+    }
+}
@@ -0,0 +1,82 @@
+#ifndef DDTABLE_REGISTRY_H
+#define DDTABLE_REGISTRY_H
+
+#ifdef _cplusplus
+extern "C" {
+#endif /* _cplusplus */
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "libddtable.h"
+
+/* Registry of memo tables sharing one global byte budget. Every registered
+ * function gets its own ddtable; the registry times recomputes on misses,
+ * and at each rebalance it shrinks or evicts the tables that save the least
+ * recompute time per byte and grows the ones losing the most to collisions,
+ * never exceeding the budget. Like ddtable itself it is not thread-safe. */
+typedef struct ddtable_registry *ddtable_registry_t;
+
+/* Per-table counters, decayed by half at every rebalance so they track the
+ * recent workload. */
+struct ddtable_registry_stats
+{
+    const char* name;
+    //! 0 while the table is evicted (calls then go straight to the function)
+    uint64_t num_slots;
+    uint64_t bytes;
+    uint64_t calls;
+    uint64_t hits;
+    //! Misses whose result could not be stored because the slot was taken
+    uint64_t collisions;
+    //! Mean measured recompute time of a miss
+    double avg_cost_ns;
+    //! Recompute time the table saved: hits * avg_cost_ns
+    double saved_ns;
+    //! saved_ns per byte of table, the quantity the budget is spent on
+    double value_density;
+};
+
+/* budget_bytes bounds the sum of ddtable_bytes over all registered tables.
+ * Rebalancing happens every epoch_calls calls through the registry (0 picks
+ * a default), or whenever ddtable_registry_rebalance is called. */
+extern ddtable_registry_t ddtable_registry_new(const uint64_t budget_bytes,
+                                               const uint64_t epoch_calls);
+
+extern void ddtable_registry_free(ddtable_registry_t registry);
+
+/* Registers fn under name with a table initially sized for num_keys (shrunk
+ * if the budget can't take it). Returns the table's id, or -1 on failure. */
+extern int ddtable_registry_add(ddtable_registry_t registry, const char* name,
+                                ddtable_memo_fn fn, void* arg,
+                                const uint64_t num_keys);
+
+/* Returns fn(key) for table id, from its table when cached. */
+extern double ddtable_registry_call(ddtable_registry_t registry, const int id,
+                                    const double key);
+
+/* Same, reusing a key hashed once with ddtable_hash_key, e.g. when one
+ * input is passed to several registered functions. */
+extern double ddtable_registry_call_with_hash(ddtable_registry_t registry,
+                                              const int id,
+                                              const ddtable_hash_t* handle);
+
+/* Redistributes the budget among the tables now. */
+extern void ddtable_registry_rebalance(ddtable_registry_t registry);
+
+extern uint64_t ddtable_registry_bytes(const ddtable_registry_t registry);
+
+extern int ddtable_registry_get_stats(const ddtable_registry_t registry,
+                                      const int id,
+                                      struct ddtable_registry_stats* stats);
+
+/* Writes one tab-separated line per table (with a header line) for
+ * scraping into dashboards. */
+extern void ddtable_registry_dump(const ddtable_registry_t registry,
+                                  FILE* out);
+
+#ifdef _cplusplus
+}
+#endif /* _cplusplus */
+
+#endif
@@ -0,0 +1,140 @@
+#if HAVE_DDTABLE_CONFIG_H
+#include "ddtable_config.h"
+#else
+#include "../build/config/ddtable_config.h"
+#endif
+
+#include "ddtable_set.h"
+#include "ddtable_internal.h"
+
+#include <stdlib.h>
+#include <stdint.h>
+
+//! Keys hashed and prefetched ahead of being compared in batch lookups
+#ifndef DDSET_PREFETCH_BLOCK
+#define DDSET_PREFETCH_BLOCK 16
+#endif
+
+/* A set is a table with a zero-width value: key_vals holds one double per
+ * slot (or the packed keys alone in linear mode). struct ddset is never
+ * defined; the handle is just a typed alias of the table. */
+static inline struct ddtable* set_table(const ddset_t set)
+{
+    return (struct ddtable*) set;
+}
+
+//! Inserts into a hashed set
+static inline int set_insert_hashed(struct ddtable* ddtable, const double key)
+{
+    const uint64_t indx = dd_hash(key, ddtable);
+    uint8_t* exists = dd_exists(ddtable);
+
+    if (exists[indx] == ddtable->generation)
+    {
+        return (ddtable->key_vals[indx] == key) ? 1 : 2;
+    }
+    exists[indx] = ddtable->generation;
+    ddtable->key_vals[indx] = key;
+    return 0;
+}
+
+ddset_t ddset_new(const uint64_t num_keys)
+{
+    ddtable_t ddtable = dd_table_new(num_keys, 1, 0, SPOOKY_HASH_SEED);
+    if (ddtable != NULL && ddtable->num_kv_pairs <= DDTABLE_LINEAR_MAX_KEYS)
+    {
+        ddtable->linear = 1;
+    }
+    return (ddset_t) ddtable;
+}
+
+void ddset_free(ddset_t set)
+{
+    ddtable_free(set_table(set));
+}
+
+void ddset_clear(ddset_t set)
+{
+    ddtable_clear(set_table(set));
+}
+
+int ddset_insert(ddset_t set, const double key)
+{
+    struct ddtable* ddtable = set_table(set);
+
+    if (ddtable->linear)
+    {
+        if (dd_linear_find(ddtable, key) >= 0)
+        {
+            return 1;
+        }
+        if (ddtable->linear_count < ddtable->num_kv_pairs)
+        {
+            ddtable->key_vals[ddtable->linear_count++] = key;
+            return 0;
+        }
+        return 2; // Full: dropped, as on a hashed collision
+    }
+    return set_insert_hashed(ddtable, key);
+}
+
+int ddset_contains(const ddset_t set, const double key)
+{
+    const struct ddtable* ddtable = set_table(set);
+
+    if (ddtable->linear)
+    {
+        return dd_linear_find(ddtable, key) >= 0;
+    }
+    const uint64_t indx = dd_hash(key, ddtable);
+    return dd_exists(ddtable)[indx] == ddtable->generation &&
+        ddtable->key_vals[indx] == key;
+}
+
+uint64_t ddset_contains_batch(const ddset_t set, const double* keys,
+                              const uint64_t num_keys, uint8_t* found)
+{
+    const struct ddtable* ddtable = set_table(set);
+    const uint8_t* exists = dd_exists(ddtable);
+    const uint8_t gen = ddtable->generation;
+    uint64_t num_found = 0;
+
+    if (ddtable->linear)
+    {
+        for (uint64_t i = 0; i < num_keys; i++)
+        {
+            found[i] = (dd_linear_find(ddtable, keys[i]) >= 0);
+            num_found += found[i];
+        }
+        return num_found;
+    }
+
+    // Hash a block at once and prefetch its slots, then compare once
+    // they've landed
+    uint64_t indices[DDSET_PREFETCH_BLOCK];
+    for (uint64_t base = 0; base < num_keys; base += DDSET_PREFETCH_BLOCK)
+    {
+        const uint64_t n = (num_keys - base < DDSET_PREFETCH_BLOCK)
+            ? num_keys - base : DDSET_PREFETCH_BLOCK;
+        dd_raw_hash_block(keys + base, n, ddtable->seed, indices);
+        for (uint64_t j = 0; j < n; j++)
+        {
+            indices[j] = dd_index(indices[j], ddtable->size);
+            __builtin_prefetch(&ddtable->key_vals[indices[j]]);
+            __builtin_prefetch(&exists[indices[j]]);
+        }
+        for (uint64_t j = 0; j < n; j++)
+        {
+            const uint64_t indx = indices[j];
+            found[base + j] = (exists[indx] == gen) &
+                (ddtable->key_vals[indx] == keys[base + j]);
+            num_found += found[base + j];
+        }
+    }
+    return num_found;
+}
+
+uint64_t ddset_bytes(const ddset_t set)
+{
+    return ddtable_bytes(set_table(set));
+}
@@ -0,0 +1,227 @@
+#if HAVE_DDTABLE_CONFIG_H
+#include "ddtable_config.h"
+#else
+#include "../build/config/ddtable_config.h"
+#endif
+
+#include "ddtable_shm.h"
+#include "ddtable_internal.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+//! Written last by the creator; attachers wait until they see it
+#define DDTABLE_SHM_MAGIC UINT64_C(0x4444544142534831) /* "DDTABSH1" */
+
+//! How long attachers wait for a concurrent creator to finish (in ms)
+#ifndef DDTABLE_SHM_ATTACH_TIMEOUT_MS
+#define DDTABLE_SHM_ATTACH_TIMEOUT_MS 5000
+#endif
+
+//! Segment header, followed by the table block; one cache line long so the
+//! table's kv array keeps its alignment in the page-aligned mapping
+struct ddtable_shm_hdr
+{
+    //! DDTABLE_SHM_MAGIC once the table below is initialized
+    uint64_t magic;
+    //! Total mapped size of the segment, header included
+    uint64_t bytes;
+    uint8_t pad[64 - (2 * sizeof(uint64_t))];
+};
+
+static inline struct ddtable_shm_hdr* shm_hdr(const ddtable_t ddtable)
+{
+    return (struct ddtable_shm_hdr*) ddtable - 1;
+}
+
+static void shm_sleep_ms(const long ms)
+{
+    const struct timespec ts = { 0, ms * 1000000L };
+    nanosleep(&ts, NULL);
+}
+
+//! Lays out a table in a freshly mapped (zeroed) segment and publishes it
+static ddtable_t shm_init(struct ddtable_shm_hdr* hdr, const size_t bytes,
+                          const uint64_t num_keys)
+{
+    ddtable_t ddtable = dd_table_init(hdr + 1, num_keys, 1, 1);
+    ddtable->shared = 1;
+    hdr->bytes = bytes;
+    __atomic_store_n(&hdr->magic, DDTABLE_SHM_MAGIC, __ATOMIC_RELEASE);
+    return ddtable;
+}
+
+//! Maps an existing segment, waiting for its creator to finish if needed
+static ddtable_t shm_map_existing(const int fd)
+{
+    struct stat st;
+    int waited_ms = 0;
+
+    // The creator may not have sized the segment yet
+    while (fstat(fd, &st) == 0 && st.st_size == 0)
+    {
+        if (waited_ms++ >= DDTABLE_SHM_ATTACH_TIMEOUT_MS)
+        {
+            return NULL;
+        }
+        shm_sleep_ms(1);
+    }
+    if (st.st_size < (off_t) sizeof(struct ddtable_shm_hdr))
+    {
+        return NULL;
+    }
+
+    struct ddtable_shm_hdr* hdr = mmap(NULL, st.st_size,
+                                       PROT_READ | PROT_WRITE, MAP_SHARED,
+                                       fd, 0);
+    if (hdr == MAP_FAILED)
+    {
+        perror("Failure to map shared ddtable: ");
+        return NULL;
+    }
+
+    while (__atomic_load_n(&hdr->magic, __ATOMIC_ACQUIRE) != DDTABLE_SHM_MAGIC)
+    {
+        if (waited_ms++ >= DDTABLE_SHM_ATTACH_TIMEOUT_MS)
+        {
+            munmap(hdr, st.st_size);
+            return NULL;
+        }
+        shm_sleep_ms(1);
+    }
+
+    return (ddtable_t) (hdr + 1);
+}
+
+ddtable_t ddtable_shm_open(const char* name, const uint64_t num_keys)
+{
+    const size_t ht_bytes = dd_table_bytes(num_keys, 1, 1);
+    if (ht_bytes == 0)
+    {
+        return NULL;
+    }
+    const size_t bytes = sizeof(struct ddtable_shm_hdr) + ht_bytes;
+
+    int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd < 0)
+    {
+        // Somebody else created it first: attach to theirs
+        return (errno == EEXIST) ? ddtable_shm_attach(name) : NULL;
+    }
+
+    ddtable_t ddtable = NULL;
+    if (ftruncate(fd, bytes) == 0)
+    {
+        struct ddtable_shm_hdr* hdr = mmap(NULL, bytes,
+                                           PROT_READ | PROT_WRITE,
+                                           MAP_SHARED, fd, 0);
+        if (hdr != MAP_FAILED)
+        {
+            ddtable = shm_init(hdr, bytes, num_keys);
+        }
+    }
+    if (ddtable == NULL)
+    {
+        perror("Failure to create shared ddtable: ");
+        shm_unlink(name);
+    }
+    close(fd);
+
+    return ddtable;
+}
+
+ddtable_t ddtable_shm_attach(const char* name)
+{
+    const int fd = shm_open(name, O_RDWR, 0600);
+    if (fd < 0)
+    {
+        return NULL;
+    }
+    ddtable_t ddtable = shm_map_existing(fd);
+    close(fd);
+    return ddtable;
+}
+
+ddtable_t ddtable_shm_new_anon(const uint64_t num_keys)
+{
+    const size_t ht_bytes = dd_table_bytes(num_keys, 1, 1);
+    if (ht_bytes == 0)
+    {
+        return NULL;
+    }
+    const size_t bytes = sizeof(struct ddtable_shm_hdr) + ht_bytes;
+
+    struct ddtable_shm_hdr* hdr = mmap(NULL, bytes, PROT_READ | PROT_WRITE,
+                                       MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (hdr == MAP_FAILED)
+    {
+        perror("Failure to create shared ddtable: ");
+        return NULL;
+    }
+    return shm_init(hdr, bytes, num_keys);
+}
+
+void ddtable_shm_detach(ddtable_t ddtable)
+{
+    if (ddtable != NULL)
+    {
+        struct ddtable_shm_hdr* hdr = shm_hdr(ddtable);
+        munmap(hdr, hdr->bytes);
+    }
+}
+
+int ddtable_shm_unlink(const char* name)
+{
+    return shm_unlink(name);
+}
+
+double ddtable_shm_get_check_key(const ddtable_t ddtable, const double key)
+{
+    const uint64_t indx = dd_hash(key, ddtable);
+    const uint8_t gen = __atomic_load_n(&ddtable->generation,
+                                        __ATOMIC_RELAXED);
+
+    // The acquire pairs with the release in ddtable_shm_set_val, so a
+    // published stamp guarantees the kv pair behind it is complete.
+    if (__atomic_load_n(&dd_exists(ddtable)[indx], __ATOMIC_ACQUIRE) == gen &&
+        ddtable->key_vals[2 * indx] == key)
+    {
+        return ddtable->key_vals[(2 * indx) + 1];
+    }
+    return (double) DDTABLE_NULL_VAL;
+}
+
+int ddtable_shm_set_val(ddtable_t ddtable, const double key, const double val)
+{
+    const uint64_t indx = dd_hash(key, ddtable);
+    const uint8_t gen = __atomic_load_n(&ddtable->generation,
+                                        __ATOMIC_RELAXED);
+    uint8_t* stamp = &dd_exists(ddtable)[indx];
+    uint8_t cur = __atomic_load_n(stamp, __ATOMIC_RELAXED);
+
+    // Claim the slot by moving its stamp to BUSY; whoever wins the CAS owns
+    // it, everybody else sees a collision just like ddtable_set_val.
+    do
+    {
+        if (cur == gen || cur == DDTABLE_BUSY_GEN)
+        {
+            return 1; // Collision
+        }
+    } while (!__atomic_compare_exchange_n(stamp, &cur, DDTABLE_BUSY_GEN, 0,
+                                          __ATOMIC_ACQUIRE,
+                                          __ATOMIC_RELAXED));
+
+    ddtable->key_vals[2 * indx] = key;
+    ddtable->key_vals[(2 * indx) + 1] = val;
+    __atomic_store_n(stamp, gen, __ATOMIC_RELEASE);
+
+    return 0;
+}
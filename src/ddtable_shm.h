@@ -0,0 +1,48 @@
+#ifndef DDTABLE_SHM_H
+#define DDTABLE_SHM_H
+
+#ifdef _cplusplus
+extern "C" {
+#endif /* _cplusplus */
+
+#include <stdint.h>
+
+#include "libddtable.h"
+
+/* Tables living in memory shared between processes (POSIX only).
+ *
+ * Any process mapping the segment may read with ddtable_shm_get_check_key
+ * and insert with ddtable_shm_set_val concurrently. The plain ddtable_*
+ * accessors also work on a shared table, but they are not safe against
+ * concurrent inserts, and ddtable_clear must only be called while no other
+ * process is touching the table. Front caches can't be attached. */
+
+/* Attaches to the named segment, creating and sizing it for num_keys keys
+ * first if it doesn't exist yet. Returns NULL on failure. */
+extern ddtable_t ddtable_shm_open(const char* name, const uint64_t num_keys);
+
+/* Attaches to an existing named segment. Returns NULL on failure. */
+extern ddtable_t ddtable_shm_attach(const char* name);
+
+/* Creates an unnamed shared table, inherited by children across fork(). */
+extern ddtable_t ddtable_shm_new_anon(const uint64_t num_keys);
+
+/* Unmaps the table from this process; the segment itself survives. */
+extern void ddtable_shm_detach(ddtable_t ddtable);
+
+/* Removes the segment name; mappings stay valid until detached. */
+extern int ddtable_shm_unlink(const char* name);
+
+extern double ddtable_shm_get_check_key(const ddtable_t ddtable,
+                                        const double key);
+
+/* Inserts key -> val unless the slot is taken (returns 1, like
+ * ddtable_set_val). Safe against concurrent inserts from any process. */
+extern int ddtable_shm_set_val(ddtable_t ddtable, const double key,
+                               const double val);
+
+#ifdef _cplusplus
+}
+#endif /* _cplusplus */
+
+#endif
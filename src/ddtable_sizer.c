@@ -0,0 +1,244 @@
+#if HAVE_DDTABLE_CONFIG_H
+#include "ddtable_config.h"
+#else
+#include "../build/config/ddtable_config.h"
+#endif
+
+#include "libddtable.h"
+#include "ddtable_internal.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <math.h>
+
+//! HyperLogLog precision: 2^12 one-byte registers, ~1.6% standard error
+#define DDTABLE_HLL_BITS 12
+#define DDTABLE_HLL_REGISTERS (1 << DDTABLE_HLL_BITS)
+
+//! HLL hashes with its own seed so it is independent of any table seed
+#define DDTABLE_HLL_SEED UINT64_C(0x9E3779B97F4A7C15)
+
+//! Keys kept (reservoir-sampled) to evaluate candidate seeds
+#ifndef DDTABLE_SIZER_SAMPLE
+#define DDTABLE_SIZER_SAMPLE 4096
+#endif
+
+//! Number of seeds tried, SPOOKY_HASH_SEED first
+#ifndef DDTABLE_SIZER_NUM_SEEDS
+#define DDTABLE_SIZER_NUM_SEEDS 8
+#endif
+
+//! Fraction of slots we aim to fill; direct mapping loses ~21% at 0.5
+#ifndef DDTABLE_TARGET_LOAD
+#define DDTABLE_TARGET_LOAD 0.5
+#endif
+
+struct ddtable_sizer
+{
+    //! Number of keys seen so far (duplicates included)
+    uint64_t num_seen;
+    //! State of the xorshift generator driving the reservoir
+    uint64_t rng;
+    //! Reservoir sample of the keys seen
+    double sample[DDTABLE_SIZER_SAMPLE];
+    //! HyperLogLog registers: max leading-zero rank per bucket
+    uint8_t registers[DDTABLE_HLL_REGISTERS];
+};
+
+//! splitmix64, used to derive candidate seeds
+static uint64_t mix64(uint64_t x)
+{
+    x += UINT64_C(0x9E3779B97F4A7C15);
+    x = (x ^ (x >> 30)) * UINT64_C(0xBF58476D1CE4E5B9);
+    x = (x ^ (x >> 27)) * UINT64_C(0x94D049BB133111EB);
+    return x ^ (x >> 31);
+}
+
+//! xorshift64* step for reservoir sampling
+static uint64_t sizer_rand(ddtable_sizer_t sizer)
+{
+    sizer->rng ^= sizer->rng >> 12;
+    sizer->rng ^= sizer->rng << 25;
+    sizer->rng ^= sizer->rng >> 27;
+    return sizer->rng * UINT64_C(0x2545F4914F6CDD1D);
+}
+
+//! Orders keys by bit pattern, which also gives NaNs a stable place
+static int cmp_key_bits(const void* a, const void* b)
+{
+    uint64_t x, y;
+    memcpy(&x, a, sizeof(x));
+    memcpy(&y, b, sizeof(y));
+    return (x > y) - (x < y);
+}
+
+ddtable_sizer_t ddtable_sizer_new(void)
+{
+    ddtable_sizer_t sizer = calloc(1, sizeof(struct ddtable_sizer));
+    if (sizer != NULL)
+    {
+        sizer->rng = DDTABLE_HLL_SEED;
+    }
+    return sizer;
+}
+
+void ddtable_sizer_free(ddtable_sizer_t sizer)
+{
+    free(sizer);
+}
+
+void ddtable_sizer_add(ddtable_sizer_t sizer, const double key)
+{
+    const uint64_t hash = spooky_hash64(&key, sizeof(double), DDTABLE_HLL_SEED);
+    const uint64_t bucket = hash >> (64 - DDTABLE_HLL_BITS);
+    // Sentinel bit bounds the rank when the remaining bits are all zero
+    const uint64_t rest = (hash << DDTABLE_HLL_BITS) |
+        (UINT64_C(1) << (DDTABLE_HLL_BITS - 1));
+    const uint8_t rank = (uint8_t) __builtin_clzll(rest) + 1;
+
+    if (rank > sizer->registers[bucket])
+    {
+        sizer->registers[bucket] = rank;
+    }
+
+    if (sizer->num_seen < DDTABLE_SIZER_SAMPLE)
+    {
+        sizer->sample[sizer->num_seen] = key;
+    } else {
+        const uint64_t j = sizer_rand(sizer) % (sizer->num_seen + 1);
+        if (j < DDTABLE_SIZER_SAMPLE)
+        {
+            sizer->sample[j] = key;
+        }
+    }
+    sizer->num_seen++;
+}
+
+uint64_t ddtable_sizer_estimate(const ddtable_sizer_t sizer)
+{
+    const double m = DDTABLE_HLL_REGISTERS;
+    const double alpha = 0.7213 / (1 + (1.079 / m));
+    double sum = 0;
+    unsigned int num_zeros = 0;
+
+    for (unsigned int j = 0; j < DDTABLE_HLL_REGISTERS; j++)
+    {
+        sum += ldexp(1.0, -sizer->registers[j]);
+        num_zeros += (sizer->registers[j] == 0);
+    }
+
+    double estimate = alpha * m * m / sum;
+    // Small cardinalities: linear counting is far more accurate
+    if (estimate <= 2.5 * m && num_zeros > 0)
+    {
+        estimate = m * log(m / num_zeros);
+    }
+    return (uint64_t) (estimate + 0.5);
+}
+
+/* Picks the candidate seed that loses the fewest sampled keys to
+ * collisions in a table scaled down to the sample at the same load. */
+static uint64_t sizer_best_seed(const ddtable_sizer_t sizer,
+                                const uint64_t num_distinct,
+                                const uint64_t num_slots)
+{
+    const uint64_t num_sample = (sizer->num_seen < DDTABLE_SIZER_SAMPLE)
+        ? sizer->num_seen : DDTABLE_SIZER_SAMPLE;
+    double* keys = (num_sample > 0) ? malloc(num_sample * sizeof(double))
+        : NULL;
+    if (keys == NULL)
+    {
+        return SPOOKY_HASH_SEED;
+    }
+
+    // Deduplicate so repeated keys don't count as collisions
+    memcpy(keys, sizer->sample, num_sample * sizeof(double));
+    qsort(keys, num_sample, sizeof(double), cmp_key_bits);
+    uint64_t num_keys = 0;
+    for (uint64_t i = 0; i < num_sample; i++)
+    {
+        if (num_keys == 0 || cmp_key_bits(&keys[num_keys - 1], &keys[i]) != 0)
+        {
+            keys[num_keys++] = keys[i];
+        }
+    }
+
+    uint64_t mask = num_slots - 1;
+    const double scale = (double) num_keys / (num_distinct ? num_distinct : 1);
+    while (mask > 0 && (mask + 1) / 2 >= (uint64_t) (scale * num_slots))
+    {
+        mask >>= 1;
+    }
+
+    uint8_t* taken = malloc(mask + 1);
+    uint64_t best_seed = SPOOKY_HASH_SEED;
+    uint64_t best_collisions = UINT64_MAX;
+
+    for (unsigned int s = 0; taken != NULL && s < DDTABLE_SIZER_NUM_SEEDS; s++)
+    {
+        const uint64_t seed = s ? mix64(s) : SPOOKY_HASH_SEED;
+        uint64_t num_collisions = 0;
+        memset(taken, 0, mask + 1);
+        for (uint64_t i = 0; i < num_keys; i++)
+        {
+            const uint64_t indx = dd_raw_hash(keys[i], seed) & mask;
+            num_collisions += taken[indx];
+            taken[indx] = 1;
+        }
+        if (num_collisions < best_collisions)
+        {
+            best_collisions = num_collisions;
+            best_seed = seed;
+        }
+    }
+
+#ifndef NDEBUG
+    fprintf(stderr, "Sizer picked seed %"PRIu64" with %"PRIu64
+            " collisions over %"PRIu64" sampled keys\n",
+            best_seed, best_collisions, num_keys);
+#endif
+
+    free(taken);
+    free(keys);
+    return best_seed;
+}
+
+ddtable_t ddtable_sizer_new_table(const ddtable_sizer_t sizer)
+{
+    uint64_t num_distinct = ddtable_sizer_estimate(sizer);
+    if (num_distinct == 0)
+    {
+        num_distinct = 1;
+    }
+
+    const uint64_t num_keys = (uint64_t) ceil(num_distinct /
+                                              DDTABLE_TARGET_LOAD);
+    // Same rounding ddtable_new applies with DDTABLE_ENFORCE_POW2
+    uint64_t num_slots = 1;
+    while (num_slots < num_keys)
+    {
+        num_slots <<= 1;
+    }
+
+    return ddtable_new_seeded(num_keys,
+                              sizer_best_seed(sizer, num_distinct, num_slots));
+}
+
+ddtable_t ddtable_new_from_sample(const double* keys, const uint64_t num_keys)
+{
+    ddtable_sizer_t sizer = ddtable_sizer_new();
+    if (sizer == NULL)
+    {
+        return NULL;
+    }
+    for (uint64_t i = 0; i < num_keys; i++)
+    {
+        ddtable_sizer_add(sizer, keys[i]);
+    }
+    ddtable_t ddtable = ddtable_sizer_new_table(sizer);
+    ddtable_sizer_free(sizer);
+    return ddtable;
+}
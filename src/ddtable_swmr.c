@@ -0,0 +1,270 @@
+#if HAVE_DDTABLE_CONFIG_H
+#include "ddtable_config.h"
+#else
+#include "../build/config/ddtable_config.h"
+#endif
+
+#include "ddtable_swmr.h"
+#include "ddtable_internal.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+//! Number of seqlock stripes; slot i is guarded by stripe i % STRIPES
+#ifndef DDTABLE_SWMR_STRIPES
+#define DDTABLE_SWMR_STRIPES 64
+#endif
+
+//! One seqlock per cache line, so a write only disturbs readers of its stripe
+struct swmr_seqlock
+{
+    uint32_t seq;
+    uint8_t pad[64 - sizeof(uint32_t)];
+};
+
+struct ddtable_swmr
+{
+    //! Striped per-slot sequence counters; odd while a write is in flight
+    struct swmr_seqlock locks[DDTABLE_SWMR_STRIPES];
+    //! Currently published table version
+    ddtable_t current;
+    //! Versions replaced by ddtable_swmr_grow, awaiting reclamation
+    ddtable_t* retired;
+    uint64_t num_retired;
+};
+
+static inline uint32_t* swmr_seq(const ddtable_swmr_t swmr, const uint64_t indx)
+{
+    return (uint32_t*) &swmr->locks[indx % DDTABLE_SWMR_STRIPES].seq;
+}
+
+//! Marks a stripe as being written; readers retry until swmr_write_end
+static inline void swmr_write_begin(uint32_t* seq)
+{
+    __atomic_store_n(seq, *seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static inline void swmr_write_end(uint32_t* seq)
+{
+    __atomic_store_n(seq, *seq + 1, __ATOMIC_RELEASE);
+}
+
+ddtable_swmr_t ddtable_swmr_new(const uint64_t num_keys)
+{
+    ddtable_swmr_t swmr = calloc(1, sizeof(struct ddtable_swmr));
+    if (swmr == NULL)
+    {
+        return NULL;
+    }
+    // Readers index slots directly, so skip ddtable_new's linear-scan mode
+    swmr->current = dd_table_new(num_keys, 1, 1, SPOOKY_HASH_SEED);
+    if (swmr->current == NULL)
+    {
+        free(swmr);
+        return NULL;
+    }
+    return swmr;
+}
+
+void ddtable_swmr_free(ddtable_swmr_t swmr)
+{
+    if (swmr != NULL)
+    {
+        ddtable_swmr_reclaim(swmr);
+        ddtable_free(swmr->current);
+        free(swmr);
+    }
+}
+
+double ddtable_swmr_get_check_key(const ddtable_swmr_t swmr, const double key)
+{
+    const ddtable_t ddtable = __atomic_load_n(&swmr->current,
+                                              __ATOMIC_ACQUIRE);
+    const uint64_t indx = dd_hash(key, ddtable);
+    const uint8_t* stamp = &dd_exists(ddtable)[indx];
+    const double* kv = &ddtable->key_vals[2 * indx];
+    const uint32_t* seq = swmr_seq(swmr, indx);
+
+    for (;;)
+    {
+        const uint32_t start = __atomic_load_n(seq, __ATOMIC_ACQUIRE);
+        if (start & 1)
+        {
+            continue; // Writer is mid-update on this stripe
+        }
+
+        const uint8_t gen = __atomic_load_n(&ddtable->generation,
+                                            __ATOMIC_RELAXED);
+        const uint8_t cur = __atomic_load_n(stamp, __ATOMIC_RELAXED);
+        double slot_key, slot_val;
+        __atomic_load(&kv[0], &slot_key, __ATOMIC_RELAXED);
+        __atomic_load(&kv[1], &slot_val, __ATOMIC_RELAXED);
+
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(seq, __ATOMIC_RELAXED) == start)
+        {
+            return (cur == gen && slot_key == key)
+                ? slot_val : (double) DDTABLE_NULL_VAL;
+        }
+    }
+}
+
+//! Writes a pair into slot indx under its stripe's seqlock; 1 if taken
+static inline int swmr_set_at(ddtable_swmr_t swmr, ddtable_t ddtable,
+                              const uint64_t indx, const double key,
+                              const double val)
+{
+    uint8_t* stamp = &dd_exists(ddtable)[indx];
+
+    if (*stamp == ddtable->generation)
+    {
+        return 1; // Collision
+    }
+
+    uint32_t* seq = swmr_seq(swmr, indx);
+    swmr_write_begin(seq);
+    __atomic_store(&ddtable->key_vals[2 * indx], (double*) &key,
+                   __ATOMIC_RELAXED);
+    __atomic_store(&ddtable->key_vals[(2 * indx) + 1], (double*) &val,
+                   __ATOMIC_RELAXED);
+    __atomic_store_n(stamp, ddtable->generation, __ATOMIC_RELAXED);
+    swmr_write_end(seq);
+
+    return 0;
+}
+
+int ddtable_swmr_set_val(ddtable_swmr_t swmr, const double key,
+                         const double val)
+{
+    ddtable_t ddtable = swmr->current;
+    return swmr_set_at(swmr, ddtable, dd_hash(key, ddtable), key, val);
+}
+
+//! Pair of a batch insert, tagged with its slot and its place in the batch
+struct swmr_pending
+{
+    uint64_t indx;
+    uint64_t seq;
+    double key;
+    double val;
+};
+
+static int cmp_swmr_pending(const void* a, const void* b)
+{
+    const struct swmr_pending* x = a;
+    const struct swmr_pending* y = b;
+    if (x->indx != y->indx)
+    {
+        return (x->indx > y->indx) - (x->indx < y->indx);
+    }
+    return (x->seq > y->seq) - (x->seq < y->seq);
+}
+
+uint64_t ddtable_swmr_set_batch(ddtable_swmr_t swmr, const double* keys,
+                                const double* vals, const uint64_t num_keys)
+{
+    ddtable_t ddtable = swmr->current;
+    uint64_t num_collisions = 0;
+    struct swmr_pending* pending = malloc(num_keys *
+                                          sizeof(struct swmr_pending));
+
+    if (pending == NULL)
+    {
+        // Same result, just without the locality
+        for (uint64_t i = 0; i < num_keys; i++)
+        {
+            num_collisions += ddtable_swmr_set_val(swmr, keys[i], vals[i]);
+        }
+        return num_collisions;
+    }
+
+    for (uint64_t i = 0; i < num_keys; i++)
+    {
+        pending[i].indx = dd_hash(keys[i], ddtable);
+        pending[i].seq = i;
+        pending[i].key = keys[i];
+        pending[i].val = vals[i];
+    }
+    // Ties keep batch order, so the first of several pairs for a slot wins
+    qsort(pending, num_keys, sizeof(struct swmr_pending), cmp_swmr_pending);
+    for (uint64_t i = 0; i < num_keys; i++)
+    {
+        num_collisions += swmr_set_at(swmr, ddtable, pending[i].indx,
+                                      pending[i].key, pending[i].val);
+    }
+
+    free(pending);
+    return num_collisions;
+}
+
+void ddtable_swmr_clear(ddtable_swmr_t swmr)
+{
+    ddtable_t ddtable = swmr->current;
+
+    if (ddtable->generation != DDTABLE_MAX_GEN)
+    {
+        // Readers that already loaded the old generation still see a
+        // consistent pre-clear slot; any reuse of a slot bumps its stripe.
+        __atomic_store_n(&ddtable->generation, ddtable->generation + 1,
+                         __ATOMIC_RELEASE);
+        return;
+    }
+
+    // Wiping the stamps touches every slot, so hold every stripe
+    for (unsigned int i = 0; i < DDTABLE_SWMR_STRIPES; i++)
+    {
+        swmr_write_begin(swmr_seq(swmr, i));
+    }
+    ddtable_clear(ddtable);
+    for (unsigned int i = 0; i < DDTABLE_SWMR_STRIPES; i++)
+    {
+        swmr_write_end(swmr_seq(swmr, i));
+    }
+}
+
+int ddtable_swmr_grow(ddtable_swmr_t swmr, const uint64_t num_keys)
+{
+    const ddtable_t old_ht = swmr->current;
+    ddtable_t* retired = realloc(swmr->retired,
+                                 (swmr->num_retired + 1) * sizeof(ddtable_t));
+    if (retired == NULL)
+    {
+        return 1;
+    }
+    swmr->retired = retired;
+
+    ddtable_t new_ht = dd_table_new(num_keys, 1, 1, SPOOKY_HASH_SEED);
+    if (new_ht == NULL)
+    {
+        return 1;
+    }
+
+    // Only this thread writes, so the old version is stable while we copy
+    const uint8_t* exists = dd_exists(old_ht);
+    for (uint64_t i = 0; i < old_ht->num_kv_pairs; i++)
+    {
+        if (exists[i] == old_ht->generation)
+        {
+            ddtable_set_val(new_ht, old_ht->key_vals[2 * i],
+                            old_ht->key_vals[(2 * i) + 1]);
+        }
+    }
+
+    __atomic_store_n(&swmr->current, new_ht, __ATOMIC_RELEASE);
+    swmr->retired[swmr->num_retired++] = old_ht;
+
+    return 0;
+}
+
+void ddtable_swmr_reclaim(ddtable_swmr_t swmr)
+{
+    for (uint64_t i = 0; i < swmr->num_retired; i++)
+    {
+        ddtable_free(swmr->retired[i]);
+    }
+    free(swmr->retired);
+    swmr->retired = NULL;
+    swmr->num_retired = 0;
+}
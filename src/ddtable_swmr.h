@@ -0,0 +1,56 @@
+#ifndef DDTABLE_SWMR_H
+#define DDTABLE_SWMR_H
+
+#ifdef _cplusplus
+extern "C" {
+#endif /* _cplusplus */
+
+#include <stdint.h>
+
+#include "libddtable.h"
+
+/* Single-writer/many-reader table.
+ *
+ * One thread at a time may call the writer functions (set, clear, grow,
+ * reclaim); any number of threads may call ddtable_swmr_get_check_key
+ * concurrently with it. Readers take no locks and perform no atomic
+ * read-modify-write: each slot is guarded by a striped seqlock that readers
+ * only load, and growing publishes a whole new table version RCU-style. */
+typedef struct ddtable_swmr *ddtable_swmr_t;
+
+extern ddtable_swmr_t ddtable_swmr_new(const uint64_t num_keys);
+
+/* Frees the table and every retired version; no readers may remain. */
+extern void ddtable_swmr_free(ddtable_swmr_t swmr);
+
+/* Reader side: lock-free, RMW-free lookup. */
+extern double ddtable_swmr_get_check_key(const ddtable_swmr_t swmr,
+                                         const double key);
+
+/* Writer side. Same collision semantics as ddtable_set_val. */
+extern int ddtable_swmr_set_val(ddtable_swmr_t swmr, const double key,
+                                const double val);
+
+/* Writer side: inserts num_keys pairs in slot order, so consecutive writes
+ * land on neighbouring cache lines, with the same outcome as inserting them
+ * one by one in array order. Returns how many collided. */
+extern uint64_t ddtable_swmr_set_batch(ddtable_swmr_t swmr, const double* keys,
+                                       const double* vals,
+                                       const uint64_t num_keys);
+
+extern void ddtable_swmr_clear(ddtable_swmr_t swmr);
+
+/* Rehashes into a new table sized for num_keys and publishes it. The old
+ * version is retired, not freed, since readers may still be using it.
+ * Returns 0 on success. */
+extern int ddtable_swmr_grow(ddtable_swmr_t swmr, const uint64_t num_keys);
+
+/* Frees retired versions. Call only once every reader that might have
+ * loaded an old version has finished its lookup (a grace period). */
+extern void ddtable_swmr_reclaim(ddtable_swmr_t swmr);
+
+#ifdef _cplusplus
+}
+#endif /* _cplusplus */
+
+#endif
@@ -0,0 +1,533 @@
+#if HAVE_DDTABLE_CONFIG_H
+#include "ddtable_config.h"
+#else
+#include "../build/config/ddtable_config.h"
+#endif
+
+#include "ddtable_tiered.h"
+#include "ddtable_internal.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+//! Evictions batched into one segment when the caller doesn't choose
+#ifndef DDTIERED_DEFAULT_SPILL_BATCH
+#define DDTIERED_DEFAULT_SPILL_BATCH 65536
+#endif
+
+//! Bloom filter sizing: ~10 bits and 7 probes per key is ~1% false positives
+#define DDTIERED_BLOOM_BITS_PER_KEY 10
+#define DDTIERED_BLOOM_PROBES 7
+#define DDTIERED_BLOOM_SEED UINT64_C(0xB10057EDB10057ED)
+
+//! Identifies a segment file and its format version
+static const char ddtiered_magic[8] = {'D','D','C','O','L','D','0','1'};
+
+//! On-disk segment entry; keys are kept as raw bits, sorted ascending
+struct seg_entry
+{
+    uint64_t key_bits;
+    double val;
+};
+
+struct seg_header
+{
+    char magic[8];
+    uint64_t count;
+};
+
+//! One immutable, sorted run of evicted entries, mapped read-only
+struct cold_segment
+{
+    char* path;
+    void* map;
+    size_t map_bytes;
+    const struct seg_entry* entries;
+    uint64_t count;
+    //! Bloom filter over the segment's keys; bloom_mask + 1 bits
+    uint64_t* bloom;
+    uint64_t bloom_mask;
+};
+
+struct ddtiered
+{
+    //! In-RAM hot tier
+    ddtable_t hot;
+    //! Directory segment files are created in
+    char* cold_dir;
+    //! Evicted entries not yet written out: open addressing, linear probing
+    uint64_t spill_batch;
+    uint64_t pending_mask;
+    uint64_t num_pending;
+    uint64_t* pending_keys;
+    double* pending_vals;
+    uint8_t* pending_used;
+    //! Segments, oldest first; each more than twice the size of the next
+    struct cold_segment* segments;
+    uint64_t num_segments;
+    struct ddtiered_stats stats;
+};
+
+static inline uint64_t key_bits(const double key)
+{
+    uint64_t bits;
+    memcpy(&bits, &key, sizeof(bits));
+    return bits;
+}
+
+static inline double bits_key(const uint64_t bits)
+{
+    double key;
+    memcpy(&key, &bits, sizeof(key));
+    return key;
+}
+
+//! Double hashing: probe i of a key is h1 + i * h2
+static inline uint64_t bloom_hash(const uint64_t bits)
+{
+    return spooky_hash64(&bits, sizeof(bits), DDTIERED_BLOOM_SEED);
+}
+
+static void bloom_add(struct cold_segment* seg, const uint64_t bits)
+{
+    const uint64_t h = bloom_hash(bits);
+    const uint64_t h2 = (h >> 32) | 1;
+    for (unsigned int i = 0; i < DDTIERED_BLOOM_PROBES; i++)
+    {
+        const uint64_t bit = (h + (i * h2)) & seg->bloom_mask;
+        seg->bloom[bit / 64] |= UINT64_C(1) << (bit % 64);
+    }
+}
+
+static int bloom_maybe_contains(const struct cold_segment* seg,
+                                const uint64_t bits)
+{
+    if (seg->bloom == NULL)
+    {
+        return 1;
+    }
+    const uint64_t h = bloom_hash(bits);
+    const uint64_t h2 = (h >> 32) | 1;
+    for (unsigned int i = 0; i < DDTIERED_BLOOM_PROBES; i++)
+    {
+        const uint64_t bit = (h + (i * h2)) & seg->bloom_mask;
+        if (!(seg->bloom[bit / 64] & (UINT64_C(1) << (bit % 64))))
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+//! Branch-light lower-bound search of a segment's sorted keys
+static const struct seg_entry* segment_find(const struct cold_segment* seg,
+                                            const uint64_t bits)
+{
+    const struct seg_entry* base = seg->entries;
+    uint64_t n = seg->count;
+
+    while (n > 1)
+    {
+        const uint64_t half = n / 2;
+        base = (base[half].key_bits <= bits) ? base + half : base;
+        n -= half;
+    }
+    return (n == 1 && base->key_bits == bits) ? base : NULL;
+}
+
+//! Entries the pending map takes at most (3/4 of it), so probes stay short
+//! and always end at a free slot
+static inline uint64_t pending_limit(const ddtiered_t tiered)
+{
+    return tiered->pending_mask - (tiered->pending_mask >> 2);
+}
+
+static uint64_t* pending_slot(const ddtiered_t tiered, const uint64_t bits,
+                              uint64_t* indx)
+{
+    uint64_t i = bloom_hash(bits) & tiered->pending_mask;
+    while (tiered->pending_used[i] && tiered->pending_keys[i] != bits)
+    {
+        i = (i + 1) & tiered->pending_mask;
+    }
+    *indx = i;
+    return &tiered->pending_keys[i];
+}
+
+static int cmp_seg_entry(const void* a, const void* b)
+{
+    const uint64_t x = ((const struct seg_entry*) a)->key_bits;
+    const uint64_t y = ((const struct seg_entry*) b)->key_bits;
+    return (x > y) - (x < y);
+}
+
+/* Writes count sorted entries (following hdr in one malloc'd buffer, which
+ * is freed) to a new segment file in cold_dir, then maps it and builds its
+ * Bloom filter into seg. Returns 0 on success. */
+static int segment_write(const ddtiered_t tiered, struct seg_header* hdr,
+                         const uint64_t count, struct cold_segment* seg)
+{
+    const size_t map_bytes = sizeof(struct seg_header) +
+        (count * sizeof(struct seg_entry));
+    const size_t path_len = strlen(tiered->cold_dir) + sizeof("/ddtiered-XXXXXX");
+    seg->path = malloc(path_len);
+    if (seg->path == NULL)
+    {
+        free(hdr);
+        return 1;
+    }
+    memcpy(hdr->magic, ddtiered_magic, sizeof(ddtiered_magic));
+    hdr->count = count;
+
+    snprintf(seg->path, path_len, "%s/ddtiered-XXXXXX", tiered->cold_dir);
+    const int fd = mkstemp(seg->path);
+    int failed = (fd < 0);
+    for (size_t off = 0; !failed && off < map_bytes;)
+    {
+        const ssize_t w = write(fd, (const char*) hdr + off, map_bytes - off);
+        failed = (w <= 0);
+        off += (w > 0) ? (size_t) w : 0;
+    }
+    free(hdr);
+
+    seg->map = failed ? MAP_FAILED
+        : mmap(NULL, map_bytes, PROT_READ, MAP_SHARED, fd, 0);
+    if (fd >= 0)
+    {
+        close(fd);
+    }
+    if (seg->map == MAP_FAILED)
+    {
+        perror("Failure to write ddtiered segment: ");
+        if (fd >= 0)
+        {
+            unlink(seg->path);
+        }
+        free(seg->path);
+        return 1;
+    }
+    seg->map_bytes = map_bytes;
+    seg->entries = (const struct seg_entry*)
+        ((const struct seg_header*) seg->map + 1);
+    seg->count = count;
+
+    uint64_t bloom_bits = 64;
+    while (bloom_bits < count * DDTIERED_BLOOM_BITS_PER_KEY)
+    {
+        bloom_bits <<= 1;
+    }
+    seg->bloom_mask = bloom_bits - 1;
+    seg->bloom = calloc(bloom_bits / 64, sizeof(uint64_t));
+    // Without a filter every lookup simply has to probe the segment
+    for (uint64_t i = 0; seg->bloom != NULL && i < count; i++)
+    {
+        bloom_add(seg, seg->entries[i].key_bits);
+    }
+    return 0;
+}
+
+static void segment_free(struct cold_segment* seg)
+{
+    munmap(seg->map, seg->map_bytes);
+    unlink(seg->path);
+    free(seg->path);
+    free(seg->bloom);
+}
+
+/* Merges the newest two segments into one, the newer's entry winning for a
+ * key in both, so a miss checks O(log n) filters rather than one per flush.
+ * Returns 0 on success; on failure both segments stay as they were. */
+static int segment_merge_last(ddtiered_t tiered)
+{
+    struct cold_segment* older = &tiered->segments[tiered->num_segments - 2];
+    struct cold_segment* newer = &tiered->segments[tiered->num_segments - 1];
+    struct seg_header* hdr = malloc(sizeof(struct seg_header) +
+                                    ((older->count + newer->count) *
+                                     sizeof(struct seg_entry)));
+    if (hdr == NULL)
+    {
+        return 1;
+    }
+
+    struct seg_entry* entries = (struct seg_entry*) (hdr + 1);
+    uint64_t i = 0, j = 0, n = 0;
+    while (i < older->count || j < newer->count)
+    {
+        if (j == newer->count ||
+            (i < older->count &&
+             older->entries[i].key_bits < newer->entries[j].key_bits))
+        {
+            entries[n++] = older->entries[i++];
+            continue;
+        }
+        if (i < older->count &&
+            older->entries[i].key_bits == newer->entries[j].key_bits)
+        {
+            i++; // Superseded by the newer eviction
+        }
+        entries[n++] = newer->entries[j++];
+    }
+
+    struct cold_segment merged;
+    if (segment_write(tiered, hdr, n, &merged) != 0)
+    {
+        return 1;
+    }
+    tiered->stats.cold_entries -= older->count + newer->count - n;
+    segment_free(older);
+    segment_free(newer);
+    *older = merged;
+    tiered->num_segments--;
+    tiered->stats.num_segments--;
+    tiered->stats.compactions++;
+    return 0;
+}
+
+int ddtiered_flush(ddtiered_t tiered)
+{
+    if (tiered->num_pending == 0)
+    {
+        return 0;
+    }
+
+    struct cold_segment* segments =
+        realloc(tiered->segments,
+                (tiered->num_segments + 1) * sizeof(struct cold_segment));
+    if (segments == NULL)
+    {
+        return 1;
+    }
+    tiered->segments = segments;
+
+    // Pending keys are unique, so sorting gives the final segment order
+    const uint64_t count = tiered->num_pending;
+    struct seg_header* hdr = malloc(sizeof(struct seg_header) +
+                                    (count * sizeof(struct seg_entry)));
+    if (hdr == NULL)
+    {
+        return 1;
+    }
+    struct seg_entry* entries = (struct seg_entry*) (hdr + 1);
+    uint64_t n = 0;
+    for (uint64_t i = 0; i <= tiered->pending_mask; i++)
+    {
+        if (tiered->pending_used[i])
+        {
+            entries[n].key_bits = tiered->pending_keys[i];
+            entries[n].val = tiered->pending_vals[i];
+            n++;
+        }
+    }
+    qsort(entries, count, sizeof(struct seg_entry), cmp_seg_entry);
+    if (segment_write(tiered, hdr, count, &segments[tiered->num_segments]))
+    {
+        return 1;
+    }
+
+    tiered->num_segments++;
+    tiered->stats.num_segments++;
+    tiered->stats.cold_entries += count;
+
+    memset(tiered->pending_used, 0, tiered->pending_mask + 1);
+    tiered->num_pending = 0;
+
+    // Size-tiered compaction: merge while the newest segment has caught up
+    // with half the one before it. A failed merge only leaves one more
+    // segment to check, so it isn't reported.
+    while (tiered->num_segments >= 2 &&
+           tiered->segments[tiered->num_segments - 2].count <=
+           2 * tiered->segments[tiered->num_segments - 1].count)
+    {
+        if (segment_merge_last(tiered) != 0)
+        {
+            break;
+        }
+    }
+    return 0;
+}
+
+/* Queues an entry evicted from the hot tier, spilling a full batch. If
+ * flushes keep failing, the map fills up to pending_limit and further
+ * evictions are refused (-1) until a flush succeeds; a failed flush with
+ * the entry queued is retried later and not reported. */
+static int tiered_evict(ddtiered_t tiered, const double key, const double val)
+{
+    const uint64_t bits = key_bits(key);
+    uint64_t i;
+    pending_slot(tiered, bits, &i);
+
+    if (!tiered->pending_used[i] &&
+        tiered->num_pending >= pending_limit(tiered))
+    {
+        if (ddtiered_flush(tiered) != 0)
+        {
+            return -1;
+        }
+        pending_slot(tiered, bits, &i);
+    }
+
+    // A newer eviction of the same key replaces the queued one
+    if (!tiered->pending_used[i])
+    {
+        tiered->pending_used[i] = 1;
+        tiered->pending_keys[i] = bits;
+        tiered->num_pending++;
+    }
+    tiered->pending_vals[i] = val;
+
+    if (tiered->num_pending >= tiered->spill_batch)
+    {
+        ddtiered_flush(tiered);
+    }
+    return 0;
+}
+
+//! Puts key -> val in its hot slot, evicting a different occupant
+static int tiered_place_hot(ddtiered_t tiered, const double key,
+                            const double val)
+{
+    const ddtable_t hot = tiered->hot;
+    const uint64_t indx = dd_hash(key, hot);
+    uint8_t* exists = dd_exists(hot);
+
+    // The occupant stays if the cold tier can't take it
+    if (exists[indx] == hot->generation &&
+        tiered_evict(tiered, hot->key_vals[2 * indx],
+                     hot->key_vals[(2 * indx) + 1]) != 0)
+    {
+        return -1;
+    }
+    exists[indx] = hot->generation;
+    hot->key_vals[2 * indx] = key;
+    hot->key_vals[(2 * indx) + 1] = val;
+    return 0;
+}
+
+ddtiered_t ddtiered_new(const uint64_t hot_keys, const char* cold_dir,
+                        uint64_t spill_batch)
+{
+    if (spill_batch == 0)
+    {
+        spill_batch = DDTIERED_DEFAULT_SPILL_BATCH;
+    }
+
+    ddtiered_t tiered = calloc(1, sizeof(struct ddtiered));
+    if (tiered == NULL)
+    {
+        return NULL;
+    }
+
+    // Keep the pending map at most half full
+    uint64_t pending_slots = 2;
+    while (pending_slots < 2 * spill_batch)
+    {
+        pending_slots <<= 1;
+    }
+    // Always hashed: eviction works on the occupant of a key's slot
+    tiered->hot = dd_table_new(hot_keys, 1, 1, SPOOKY_HASH_SEED);
+    tiered->cold_dir = malloc(strlen(cold_dir) + 1);
+    tiered->spill_batch = spill_batch;
+    tiered->pending_mask = pending_slots - 1;
+    tiered->pending_keys = malloc(pending_slots * sizeof(uint64_t));
+    tiered->pending_vals = malloc(pending_slots * sizeof(double));
+    tiered->pending_used = calloc(pending_slots, sizeof(uint8_t));
+
+    if (tiered->hot == NULL || tiered->cold_dir == NULL ||
+        tiered->pending_keys == NULL || tiered->pending_vals == NULL ||
+        tiered->pending_used == NULL)
+    {
+        ddtiered_free(tiered);
+        return NULL;
+    }
+    strcpy(tiered->cold_dir, cold_dir);
+
+    return tiered;
+}
+
+void ddtiered_free(ddtiered_t tiered)
+{
+    if (tiered == NULL)
+    {
+        return;
+    }
+    for (uint64_t s = 0; s < tiered->num_segments; s++)
+    {
+        segment_free(&tiered->segments[s]);
+    }
+    free(tiered->segments);
+    free(tiered->pending_used);
+    free(tiered->pending_vals);
+    free(tiered->pending_keys);
+    free(tiered->cold_dir);
+    ddtable_free(tiered->hot);
+    free(tiered);
+}
+
+double ddtiered_get_check_key(ddtiered_t tiered, const double key)
+{
+    const ddtable_t hot = tiered->hot;
+    const uint64_t indx = dd_hash(key, hot);
+
+    if (dd_exists(hot)[indx] == hot->generation &&
+        hot->key_vals[2 * indx] == key)
+    {
+        tiered->stats.hot_hits++;
+        return hot->key_vals[(2 * indx) + 1];
+    }
+
+    // Recently evicted entries are still in RAM
+    const uint64_t bits = key_bits(key);
+    uint64_t i;
+    pending_slot(tiered, bits, &i);
+    if (tiered->pending_used[i])
+    {
+        tiered->stats.hot_hits++;
+        return tiered->pending_vals[i];
+    }
+
+    // Newest segment first, so the latest eviction of a key wins
+    for (uint64_t s = tiered->num_segments; s-- > 0;)
+    {
+        const struct cold_segment* seg = &tiered->segments[s];
+        if (!bloom_maybe_contains(seg, bits))
+        {
+            tiered->stats.bloom_skips++;
+            continue;
+        }
+
+        tiered->stats.segment_probes++;
+        const struct seg_entry* entry = segment_find(seg, bits);
+        if (entry != NULL)
+        {
+            const double val = entry->val;
+            tiered->stats.cold_hits++;
+            tiered_place_hot(tiered, bits_key(entry->key_bits), val);
+            return val;
+        }
+    }
+
+    tiered->stats.misses++;
+    return (double) DDTABLE_NULL_VAL;
+}
+
+int ddtiered_set_val(ddtiered_t tiered, const double key, const double val)
+{
+    const ddtable_t hot = tiered->hot;
+    const uint64_t indx = dd_hash(key, hot);
+
+    if (dd_exists(hot)[indx] == hot->generation &&
+        hot->key_vals[2 * indx] == key)
+    {
+        return 1; // Already cached
+    }
+    return tiered_place_hot(tiered, key, val);
+}
+
+void ddtiered_get_stats(const ddtiered_t tiered, struct ddtiered_stats* stats)
+{
+    *stats = tiered->stats;
+}
@@ -0,0 +1,62 @@
+#ifndef DDTABLE_TIERED_H
+#define DDTABLE_TIERED_H
+
+#ifdef _cplusplus
+extern "C" {
+#endif /* _cplusplus */
+
+#include <stdint.h>
+
+#include "libddtable.h"
+
+/* Two-tier table: a normal in-RAM ddtable holds hot keys, and entries
+ * evicted from it spill to sorted, mmap'd, append-only segment files on
+ * local disk. Each segment has an in-memory Bloom filter, so most misses
+ * never touch the disk, and cold hits are promoted back into RAM. */
+typedef struct ddtiered *ddtiered_t;
+
+/* Counters for the tiers, cumulative since creation except for the current
+ * num_segments and cold_entries. */
+struct ddtiered_stats
+{
+    uint64_t hot_hits;
+    uint64_t cold_hits;
+    uint64_t misses;
+    //! Segment lookups avoided because the Bloom filter ruled them out
+    uint64_t bloom_skips;
+    //! Segment lookups that had to binary-search the mapped file
+    uint64_t segment_probes;
+    uint64_t num_segments;
+    uint64_t cold_entries;
+    //! Segment pairs merged into one
+    uint64_t compactions;
+};
+
+/* hot_keys sizes the in-RAM table; evicted entries are batched spill_batch
+ * at a time (0 picks a default) into segment files created in cold_dir. */
+extern ddtiered_t ddtiered_new(const uint64_t hot_keys, const char* cold_dir,
+                               uint64_t spill_batch);
+
+/* Frees the table and deletes its segment files. */
+extern void ddtiered_free(ddtiered_t tiered);
+
+extern double ddtiered_get_check_key(ddtiered_t tiered, const double key);
+
+/* Inserts into the hot tier, evicting whatever occupied the slot to the
+ * cold tier. Returns 1 if the key is already hot (like ddtable_set_val),
+ * or -1 if the key was not stored because segment writes keep failing and
+ * the evictions waiting for them have filled their buffer. */
+extern int ddtiered_set_val(ddtiered_t tiered, const double key,
+                            const double val);
+
+/* Writes any pending evictions out as a segment. Returns 0 on success. */
+extern int ddtiered_flush(ddtiered_t tiered);
+
+extern void ddtiered_get_stats(const ddtiered_t tiered,
+                               struct ddtiered_stats* stats);
+
+#ifdef _cplusplus
+}
+#endif /* _cplusplus */
+
+#endif
@@ -0,0 +1,214 @@
+#if HAVE_DDTABLE_CONFIG_H
+#include "ddtable_config.h"
+#else
+#include "../build/config/ddtable_config.h"
+#endif
+
+#include "ddtable_trace.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+//! On-disk size of one record: op byte followed by the raw key bits
+#define DDTABLE_TRACE_REC_BYTES (sizeof(uint8_t) + sizeof(double))
+
+//! Records buffered per thread before they are written out
+#ifndef DDTABLE_TRACE_BUF_RECS
+#define DDTABLE_TRACE_BUF_RECS 4096
+#endif
+
+//! File header identifying the trace format and version
+static const char ddtable_trace_magic[8] = {'D','D','T','R','A','C','E','1'};
+
+//! Per-thread record buffer; only its owning thread ever touches it
+struct trace_buf
+{
+    size_t used;
+    unsigned char data[DDTABLE_TRACE_BUF_RECS * DDTABLE_TRACE_REC_BYTES];
+};
+
+//! Shared trace file descriptor, -1 when tracing is off
+static int trace_fd = -1;
+
+//! Lets thread exit flush and release its buffer
+static pthread_key_t trace_key;
+static pthread_once_t trace_key_once = PTHREAD_ONCE_INIT;
+
+static ddtable_THREAD_LOCAL struct trace_buf* trace_tls_buf = NULL;
+
+//! Writes out a buffer in a single append so threads never interleave records
+static void trace_buf_flush(struct trace_buf* buf)
+{
+    const int fd = __atomic_load_n(&trace_fd, __ATOMIC_ACQUIRE);
+    size_t off = 0;
+
+    while (fd >= 0 && off < buf->used)
+    {
+        const ssize_t n = write(fd, buf->data + off, buf->used - off);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            perror("Failure to write ddtable trace: ");
+            break;
+        }
+        off += (size_t) n;
+    }
+    buf->used = 0;
+}
+
+static void trace_buf_destroy(void* buf)
+{
+    trace_buf_flush(buf);
+    free(buf);
+}
+
+static void trace_key_create(void)
+{
+    pthread_key_create(&trace_key, trace_buf_destroy);
+}
+
+static struct trace_buf* trace_get_buf(void)
+{
+    if (trace_tls_buf == NULL)
+    {
+        trace_tls_buf = malloc(sizeof(struct trace_buf));
+        if (trace_tls_buf == NULL)
+        {
+            return NULL;
+        }
+        trace_tls_buf->used = 0;
+        pthread_once(&trace_key_once, trace_key_create);
+        pthread_setspecific(trace_key, trace_tls_buf);
+    }
+    return trace_tls_buf;
+}
+
+int ddtable_trace_open(const char* path)
+{
+    const int fd = open(path, O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (fd < 0)
+    {
+        perror("Failure to open ddtable trace: ");
+        return 1;
+    }
+
+    // Fresh files get a header; existing traces are appended to
+    struct stat st;
+    if (fstat(fd, &st) != 0 ||
+        (st.st_size == 0 &&
+         write(fd, ddtable_trace_magic, sizeof(ddtable_trace_magic))
+         != (ssize_t) sizeof(ddtable_trace_magic)))
+    {
+        close(fd);
+        return 1;
+    }
+
+    const int old_fd = __atomic_exchange_n(&trace_fd, fd, __ATOMIC_ACQ_REL);
+    if (old_fd >= 0)
+    {
+        close(old_fd);
+    }
+    return 0;
+}
+
+void ddtable_trace_flush(void)
+{
+    if (trace_tls_buf != NULL)
+    {
+        trace_buf_flush(trace_tls_buf);
+    }
+}
+
+void ddtable_trace_close(void)
+{
+    ddtable_trace_flush();
+    const int fd = __atomic_exchange_n(&trace_fd, -1, __ATOMIC_ACQ_REL);
+    if (fd >= 0)
+    {
+        close(fd);
+    }
+}
+
+void ddtable_trace_record(const enum ddtable_trace_op op, const double key)
+{
+    struct trace_buf* buf = trace_get_buf();
+    if (buf == NULL)
+    {
+        return;
+    }
+
+    unsigned char* rec = buf->data + buf->used;
+    rec[0] = (uint8_t) op;
+    memcpy(rec + 1, &key, sizeof(double));
+    buf->used += DDTABLE_TRACE_REC_BYTES;
+
+    if (buf->used == sizeof(buf->data))
+    {
+        trace_buf_flush(buf);
+    }
+}
+
+int ddtable_trace_load(const char* path,
+                       struct ddtable_trace_rec** recs,
+                       size_t* num_recs)
+{
+    FILE* fp = fopen(path, "rb");
+    if (fp == NULL)
+    {
+        perror("Failure to open ddtable trace: ");
+        return 1;
+    }
+
+    char magic[sizeof(ddtable_trace_magic)];
+    if (fread(magic, 1, sizeof(magic), fp) != sizeof(magic) ||
+        memcmp(magic, ddtable_trace_magic, sizeof(magic)) != 0)
+    {
+        fputs("Not a ddtable trace file\n", stderr);
+        fclose(fp);
+        return 1;
+    }
+
+    size_t capacity = DDTABLE_TRACE_BUF_RECS;
+    size_t n = 0;
+    struct ddtable_trace_rec* out = malloc(capacity * sizeof(*out));
+    unsigned char raw[DDTABLE_TRACE_REC_BYTES];
+
+    while (out != NULL && fread(raw, 1, sizeof(raw), fp) == sizeof(raw))
+    {
+        if (n == capacity)
+        {
+            capacity *= 2;
+            struct ddtable_trace_rec* grown =
+                realloc(out, capacity * sizeof(*out));
+            if (grown == NULL)
+            {
+                free(out);
+                out = NULL;
+                break;
+            }
+            out = grown;
+        }
+        out[n].op = raw[0];
+        memcpy(&out[n].key, raw + 1, sizeof(double));
+        n++;
+    }
+    fclose(fp);
+
+    if (out == NULL)
+    {
+        return 1;
+    }
+    *recs = out;
+    *num_recs = n;
+    return 0;
+}
@@ -0,0 +1,56 @@
+#ifndef DDTABLE_TRACE_H
+#define DDTABLE_TRACE_H
+
+#ifdef _cplusplus
+extern "C" {
+#endif /* _cplusplus */
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "libddtable.h"
+
+/* Operations recorded in a key-stream trace. */
+enum ddtable_trace_op
+{
+    DDTABLE_TRACE_GET = 0,
+    DDTABLE_TRACE_GET_CHECK = 1,
+    DDTABLE_TRACE_SET = 2,
+    DDTABLE_TRACE_CLEAR = 3
+};
+
+/* One decoded trace entry. On disk each entry is 9 bytes: op, then key. */
+struct ddtable_trace_rec
+{
+    uint8_t op;
+    double key;
+};
+
+/* Opens (appending to) the process-wide trace file. Returns 0 on success. */
+extern int ddtable_trace_open(const char* path);
+
+/* Flushes the calling thread's buffer and closes the trace file. Other
+ * threads' buffers are flushed when they fill, exit, or call
+ * ddtable_trace_flush. */
+extern void ddtable_trace_close(void);
+
+extern void ddtable_trace_flush(void);
+
+/* Starts/stops recording operations on the given table. Returns nonzero if
+ * the library was built without DDTABLE_TRACE. */
+extern int ddtable_trace_table(ddtable_t ddtable, const int enable);
+
+/* Appends one record to the calling thread's buffer. */
+extern void ddtable_trace_record(const enum ddtable_trace_op op,
+                                 const double key);
+
+/* Reads a whole trace file into a malloc'd array. Returns 0 on success. */
+extern int ddtable_trace_load(const char* path,
+                              struct ddtable_trace_rec** recs,
+                              size_t* num_recs);
+
+#ifdef _cplusplus
+}
+#endif /* _cplusplus */
+
+#endif
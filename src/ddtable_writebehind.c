@@ -0,0 +1,305 @@
+#if HAVE_DDTABLE_CONFIG_H
+#include "ddtable_config.h"
+#else
+#include "../build/config/ddtable_config.h"
+#endif
+
+#include "ddtable_writebehind.h"
+#include "ddtable_internal.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+
+//! Pairs per thread ring when the caller doesn't choose
+#ifndef DDTABLE_WB_DEFAULT_RING
+#define DDTABLE_WB_DEFAULT_RING 4096
+#endif
+
+//! Most producer threads one context can serve
+#ifndef DDTABLE_WB_MAX_THREADS
+#define DDTABLE_WB_MAX_THREADS 64
+#endif
+
+/* Single-producer/single-consumer ring of pairs. The producer and the
+ * applier each own one index, on a cache line of its own, and only read
+ * the other's, so queueing is one acquire load and one release store. */
+struct wb_ring
+{
+    //! Next pair the producer writes; written by the owning thread only
+    ddtable_ALIGNED(DDTABLE_CACHE_LINE) uint64_t tail;
+    uint64_t queued;
+    uint64_t full;
+    //! Next pair the applier reads; written under the apply lock only
+    ddtable_ALIGNED(DDTABLE_CACHE_LINE) uint64_t head;
+    ddtable_ALIGNED(DDTABLE_CACHE_LINE) pthread_t owner;
+    uint64_t mask;
+    //! Interleaved key/value pairs
+    double* pairs;
+};
+
+struct ddtable_wb
+{
+    ddtable_swmr_t swmr;
+    //! Distinguishes this context from earlier ones at the same address
+    uint64_t id;
+    uint64_t ring_capacity;
+    //! Rings are only ever added; num_rings is published with a release
+    struct wb_ring* rings[DDTABLE_WB_MAX_THREADS];
+    uint32_t num_rings;
+    pthread_mutex_t register_lock;
+    //! Serializes appliers (the background thread and ddtable_wb_flush),
+    //! making them together the swmr table's single writer
+    pthread_mutex_t apply_lock;
+    double* batch_keys;
+    double* batch_vals;
+    uint64_t batch_capacity;
+    uint64_t applied;
+    uint64_t collisions;
+    uint64_t batches;
+    uint64_t interval_us;
+    int has_thread;
+    int stop;
+    pthread_t thread;
+};
+
+static uint64_t wb_next_id = 1;
+
+//! Ring of the context the calling thread last queued to
+static ddtable_THREAD_LOCAL uint64_t wb_tls_id = 0;
+static ddtable_THREAD_LOCAL struct wb_ring* wb_tls_ring = NULL;
+
+//! Finds or creates the calling thread's ring; NULL if there can't be one
+static struct wb_ring* wb_thread_ring(ddtable_wb_t wb)
+{
+    if (wb_tls_id == wb->id)
+    {
+        return wb_tls_ring;
+    }
+
+    const pthread_t self = pthread_self();
+    struct wb_ring* ring = NULL;
+    pthread_mutex_lock(&wb->register_lock);
+    for (uint32_t i = 0; i < wb->num_rings && ring == NULL; i++)
+    {
+        if (pthread_equal(wb->rings[i]->owner, self))
+        {
+            ring = wb->rings[i]; // Queued here before another context
+        }
+    }
+    if (ring == NULL && wb->num_rings < DDTABLE_WB_MAX_THREADS)
+    {
+        void* mem = NULL;
+        if (posix_memalign(&mem, DDTABLE_CACHE_LINE,
+                           sizeof(struct wb_ring)) == 0)
+        {
+            ring = mem;
+            memset(ring, 0, sizeof(struct wb_ring));
+            ring->owner = self;
+            ring->mask = wb->ring_capacity - 1;
+            ring->pairs = malloc(wb->ring_capacity * 2 * sizeof(double));
+            if (ring->pairs == NULL)
+            {
+                free(ring);
+                ring = NULL;
+            } else {
+                wb->rings[wb->num_rings] = ring;
+                __atomic_store_n(&wb->num_rings, wb->num_rings + 1,
+                                 __ATOMIC_RELEASE);
+            }
+        }
+    }
+    pthread_mutex_unlock(&wb->register_lock);
+
+    if (ring != NULL)
+    {
+        wb_tls_id = wb->id;
+        wb_tls_ring = ring;
+    }
+    return ring;
+}
+
+/* Drains every ring into one batch and applies it in slot order. Each
+ * ring's head is only advanced once its pairs are copied out, so producers
+ * can't overwrite pairs still being read. Caller holds the apply lock. */
+static uint64_t wb_apply(ddtable_wb_t wb)
+{
+    const uint32_t num_rings = __atomic_load_n(&wb->num_rings,
+                                               __ATOMIC_ACQUIRE);
+    const uint64_t capacity = num_rings * wb->ring_capacity;
+    if (capacity > wb->batch_capacity)
+    {
+        double* keys = realloc(wb->batch_keys, capacity * sizeof(double));
+        if (keys != NULL)
+        {
+            wb->batch_keys = keys;
+        }
+        double* vals = realloc(wb->batch_vals, capacity * sizeof(double));
+        if (vals != NULL)
+        {
+            wb->batch_vals = vals;
+        }
+        if (keys == NULL || vals == NULL)
+        {
+            return 0; // Try again next time; the rings keep the pairs
+        }
+        wb->batch_capacity = capacity;
+    }
+
+    uint64_t n = 0;
+    for (uint32_t r = 0; r < num_rings; r++)
+    {
+        struct wb_ring* ring = wb->rings[r];
+        const uint64_t head = ring->head;
+        const uint64_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+        for (uint64_t i = head; i != tail; i++)
+        {
+            const uint64_t at = i & ring->mask;
+            wb->batch_keys[n] = ring->pairs[2 * at];
+            wb->batch_vals[n] = ring->pairs[(2 * at) + 1];
+            n++;
+        }
+        __atomic_store_n(&ring->head, tail, __ATOMIC_RELEASE);
+    }
+
+    if (n > 0)
+    {
+        wb->collisions += ddtable_swmr_set_batch(wb->swmr, wb->batch_keys,
+                                                 wb->batch_vals, n);
+        wb->applied += n;
+        wb->batches++;
+    }
+    return n;
+}
+
+static void* wb_thread_main(void* arg)
+{
+    ddtable_wb_t wb = arg;
+    const struct timespec pause = {
+        (time_t) (wb->interval_us / 1000000),
+        (long) (wb->interval_us % 1000000) * 1000
+    };
+
+    while (!__atomic_load_n(&wb->stop, __ATOMIC_ACQUIRE))
+    {
+        pthread_mutex_lock(&wb->apply_lock);
+        const uint64_t n = wb_apply(wb);
+        pthread_mutex_unlock(&wb->apply_lock);
+        if (n == 0)
+        {
+            nanosleep(&pause, NULL);
+        }
+    }
+    return NULL;
+}
+
+ddtable_wb_t ddtable_wb_new(ddtable_swmr_t swmr, const uint64_t ring_capacity,
+                            const uint64_t interval_us)
+{
+    ddtable_wb_t wb = calloc(1, sizeof(struct ddtable_wb));
+    if (wb == NULL)
+    {
+        return NULL;
+    }
+    wb->swmr = swmr;
+    wb->id = __atomic_fetch_add(&wb_next_id, 1, __ATOMIC_RELAXED);
+    wb->ring_capacity = 2;
+    while (wb->ring_capacity < (ring_capacity ? ring_capacity
+                                : DDTABLE_WB_DEFAULT_RING))
+    {
+        wb->ring_capacity <<= 1;
+    }
+    wb->interval_us = interval_us;
+    pthread_mutex_init(&wb->register_lock, NULL);
+    pthread_mutex_init(&wb->apply_lock, NULL);
+
+    if (interval_us > 0)
+    {
+        if (pthread_create(&wb->thread, NULL, wb_thread_main, wb) != 0)
+        {
+            ddtable_wb_free(wb);
+            return NULL;
+        }
+        wb->has_thread = 1;
+    }
+    return wb;
+}
+
+void ddtable_wb_free(ddtable_wb_t wb)
+{
+    if (wb == NULL)
+    {
+        return;
+    }
+    if (wb->has_thread)
+    {
+        __atomic_store_n(&wb->stop, 1, __ATOMIC_RELEASE);
+        pthread_join(wb->thread, NULL);
+    }
+    ddtable_wb_flush(wb);
+
+    for (uint32_t i = 0; i < wb->num_rings; i++)
+    {
+        free(wb->rings[i]->pairs);
+        free(wb->rings[i]);
+    }
+    pthread_mutex_destroy(&wb->apply_lock);
+    pthread_mutex_destroy(&wb->register_lock);
+    free(wb->batch_vals);
+    free(wb->batch_keys);
+    free(wb);
+}
+
+int ddtable_wb_set_val(ddtable_wb_t wb, const double key, const double val)
+{
+    struct wb_ring* ring = wb_thread_ring(wb);
+    if (ring == NULL)
+    {
+        return 1;
+    }
+
+    const uint64_t tail = ring->tail;
+    if (tail - __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) > ring->mask)
+    {
+        __atomic_store_n(&ring->full, ring->full + 1, __ATOMIC_RELAXED);
+        return 1;
+    }
+    ring->pairs[2 * (tail & ring->mask)] = key;
+    ring->pairs[(2 * (tail & ring->mask)) + 1] = val;
+    __atomic_store_n(&ring->queued, ring->queued + 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&ring->tail, tail + 1, __ATOMIC_RELEASE);
+    return 0;
+}
+
+uint64_t ddtable_wb_flush(ddtable_wb_t wb)
+{
+    // One pass takes everything queued before it read each ring's tail;
+    // looping until empty could chase busy producers forever
+    pthread_mutex_lock(&wb->apply_lock);
+    const uint64_t n = wb_apply(wb);
+    pthread_mutex_unlock(&wb->apply_lock);
+    return n;
+}
+
+void ddtable_wb_get_stats(const ddtable_wb_t wb,
+                          struct ddtable_wb_stats* stats)
+{
+    memset(stats, 0, sizeof(struct ddtable_wb_stats));
+    const uint32_t num_rings = __atomic_load_n(&wb->num_rings,
+                                               __ATOMIC_ACQUIRE);
+    for (uint32_t i = 0; i < num_rings; i++)
+    {
+        stats->queued += __atomic_load_n(&wb->rings[i]->queued,
+                                         __ATOMIC_RELAXED);
+        stats->full += __atomic_load_n(&wb->rings[i]->full,
+                                       __ATOMIC_RELAXED);
+    }
+
+    pthread_mutex_lock(&wb->apply_lock);
+    stats->applied = wb->applied;
+    stats->collisions = wb->collisions;
+    stats->batches = wb->batches;
+    pthread_mutex_unlock(&wb->apply_lock);
+}
@@ -0,0 +1,68 @@
+#ifndef DDTABLE_WRITEBEHIND_H
+#define DDTABLE_WRITEBEHIND_H
+
+#ifdef _cplusplus
+extern "C" {
+#endif /* _cplusplus */
+
+#include <stdint.h>
+
+#include "ddtable_swmr.h"
+
+/* Write-behind inserts for a single-writer/many-reader table.
+ *
+ * Any thread may queue an insert with ddtable_wb_set_val: it lands in that
+ * thread's own lock-free single-producer ring, so the request path never
+ * probes the table or waits on the writer. Queued pairs are applied in
+ * batches, sorted by slot, either by a background thread or whenever
+ * ddtable_wb_flush is called. The batches go through ddtable_swmr_set_batch,
+ * so readers using ddtable_swmr_get_check_key see each slot either before
+ * or after its insert, never half-written. Until a pair is applied, lookups
+ * simply miss it. The write-behind context becomes the table's only writer:
+ * don't call the swmr writer functions directly while it is attached. */
+typedef struct ddtable_wb *ddtable_wb_t;
+
+/* Counters since creation; queued and full are read without stopping the
+ * producers, so they are only a snapshot. */
+struct ddtable_wb_stats
+{
+    uint64_t queued;
+    //! Inserts skipped because the calling thread's ring was full
+    uint64_t full;
+    uint64_t applied;
+    //! Applied pairs whose slot was already taken
+    uint64_t collisions;
+    uint64_t batches;
+};
+
+/* Attaches write-behind to swmr, with rings of ring_capacity pairs per
+ * thread (rounded up to a power of 2; 0 picks a default). If interval_us is
+ * nonzero, a background thread applies whatever is queued and then sleeps
+ * interval_us whenever it finds nothing; with 0, pairs are applied only by
+ * ddtable_wb_flush. Returns NULL on failure. */
+extern ddtable_wb_t ddtable_wb_new(ddtable_swmr_t swmr,
+                                   const uint64_t ring_capacity,
+                                   const uint64_t interval_us);
+
+/* Stops the background thread, applies what is still queued and frees the
+ * context (not the table). No thread may still be queueing. */
+extern void ddtable_wb_free(ddtable_wb_t wb);
+
+/* Queues key -> val from the calling thread. Returns 0 if queued, or 1 if
+ * the insert was skipped because the thread's ring is full or no ring
+ * could be set up for it. */
+extern int ddtable_wb_set_val(ddtable_wb_t wb, const double key,
+                              const double val);
+
+/* Applies everything queued so far, from any thread. Returns how many pairs
+ * were applied. */
+extern uint64_t ddtable_wb_flush(ddtable_wb_t wb);
+
+extern void ddtable_wb_get_stats(const ddtable_wb_t wb,
+                                 struct ddtable_wb_stats* stats);
+
+#ifdef _cplusplus
+}
+#endif /* _cplusplus */
+
+#endif
@@ -10,16 +10,268 @@ extern "C" {
 /* Hash table for double-valued key-value pairs. */
 typedef struct ddtable *ddtable_t;
 
-extern ddtable_t ddtable_new(const uint_fast32_t num_keys);
+extern ddtable_t ddtable_new(const uint64_t num_keys);
+
+/* Creates a table hashing with the given spooky seed. */
+extern ddtable_t ddtable_new_seeded(const uint64_t num_keys,
+                                    const uint64_t seed);
+
+extern uint64_t ddtable_seed(const ddtable_t ddtable);
+
+/* Streaming sizer: feed it keys (or a sample of them) and it estimates the
+ * distinct count with HyperLogLog, then builds a table at the target load
+ * using whichever candidate seed collides least on a reservoir sample. */
+typedef struct ddtable_sizer *ddtable_sizer_t;
+
+extern ddtable_sizer_t ddtable_sizer_new(void);
+
+extern void ddtable_sizer_free(ddtable_sizer_t sizer);
+
+extern void ddtable_sizer_add(ddtable_sizer_t sizer, const double key);
+
+extern uint64_t ddtable_sizer_estimate(const ddtable_sizer_t sizer);
+
+extern ddtable_t ddtable_sizer_new_table(const ddtable_sizer_t sizer);
+
+/* One-shot ddtable_sizer over an array of keys. */
+extern ddtable_t ddtable_new_from_sample(const double* keys,
+                                         const uint64_t num_keys);
+
+/* Creates a table storing val_width doubles per key next to the key, so
+ * all outputs of a multi-output function come from one cache line. */
+extern ddtable_t ddtable_new_vec(const uint64_t num_keys,
+                                 const uint32_t val_width);
+
+/* Creates a table keyed on tuples of key_width (1 to 4) doubles, e.g. the
+ * arguments of pow(x, y), each mapping to val_width doubles. */
+extern ddtable_t ddtable_new_multi(const uint64_t num_keys,
+                                   const uint32_t key_width,
+                                   const uint32_t val_width);
+
+extern uint32_t ddtable_val_width(const ddtable_t ddtable);
 
 extern void ddtable_free(ddtable_t ddtable);
 
+/* Total bytes the table occupies (header, slots and stamps). */
+extern uint64_t ddtable_bytes(const ddtable_t ddtable);
+
+/* Returns a new table sized for num_keys with the same key/value widths and
+ * seed, holding every entry of ddtable that still fits without colliding.
+ * ddtable itself is left untouched (and must still be freed). */
+extern ddtable_t ddtable_resize(const ddtable_t ddtable,
+                                const uint64_t num_keys);
+
+/* Attaches a small direct-mapped front cache of at most cache_bytes (0 picks
+ * a default) that ddtable_get_check_key consults before the main table.
+ * Returns 0 on success. */
+extern int ddtable_attach_cache(ddtable_t ddtable, uint64_t cache_bytes);
+
+extern void ddtable_detach_cache(ddtable_t ddtable);
+
+/* Reports how many lookups consulted the front cache and how many it served. */
+extern void ddtable_get_cache_stats(const ddtable_t ddtable,
+                                    uint64_t* lookups, uint64_t* hits);
+
+/* Attaches an ordered index of the keys set from now on (plus those already
+ * in the table), answering nearest-key and bracketing queries in O(log n)
+ * with a branch-free search. Only for ddtable_new tables. Returns 0 on
+ * success. */
+extern int ddtable_attach_order(ddtable_t ddtable);
+
+extern void ddtable_detach_order(ddtable_t ddtable);
+
+/* Finds the stored key closest to key (the smaller one on a tie). Returns 0
+ * and fills near_key and val, or 1 if nothing is indexed (or key is NaN). */
+extern int ddtable_get_nearest(const ddtable_t ddtable, const double key,
+                               double* near_key, double* val);
+
+/* Finds the largest stored key <= key and the smallest >= key (the same
+ * pair if key itself is stored), e.g. to interpolate between them. Returns
+ * 0 if both exist; otherwise returns 1 and a missing side gets a NaN key. */
+extern int ddtable_get_bracket(const ddtable_t ddtable, const double key,
+                               double* lo_key, double* lo_val,
+                               double* hi_key, double* hi_val);
+
+/* Empties the table in O(1) (amortized) without releasing its memory. */
+extern void ddtable_clear(ddtable_t ddtable);
+
 extern double ddtable_get_val(const ddtable_t ddtable, const double key);
 
 extern double ddtable_get_check_key(const ddtable_t ddtable, const double key);
 
 extern int ddtable_set_val(ddtable_t ddtable, const double key, const double val);
 
+/* Value slot of key, or NULL on a miss, so a stored DDTABLE_NULL_VAL (0.0)
+ * can be told apart from an absent key and values can be updated in place.
+ * The pointer is valid until the table's next clear or free. Writes
+ * through it are seen by every lookup, but with a front cache attached they
+ * must happen before the table's next lookup, and with a checkpoint
+ * attached (see ddtable_ckpt.h) before the table's next update or
+ * ddtable_ckpt_begin, or no checkpoint may ever record them. */
+extern double* ddtable_find(ddtable_t ddtable, const double key);
+
+/* Value slot of key, inserting key with value DDTABLE_NULL_VAL first if it
+ * is absent; *inserted (if inserted isn't NULL) tells which happened.
+ * Returns NULL if the key's slot holds another key. Same pointer validity
+ * as ddtable_find. */
+extern double* ddtable_upsert(ddtable_t ddtable, const double key,
+                              int* inserted);
+
+/* Function being memoized; arg is passed through unchanged. */
+typedef double (*ddtable_memo_fn)(const double key, void* arg);
+
+/* Returns the cached value of key, or computes fn(key, arg) and caches it. */
+extern double ddtable_memoize(ddtable_t ddtable, const double key,
+                              ddtable_memo_fn fn, void* arg);
+
+/* A key hashed once, for lookups in several tables. Every table sharing the
+ * handle's seed only masks the stored hash; tables with another seed simply
+ * rehash the key, so a handle is always safe to use. */
+typedef struct ddtable_hash
+{
+    double key;
+    uint64_t hash;
+    uint64_t seed;
+} ddtable_hash_t;
+
+/* Hashes key for tables with the default seed (anything from ddtable_new). */
+extern ddtable_hash_t ddtable_hash_key(const double key);
+
+extern ddtable_hash_t ddtable_hash_key_seeded(const double key,
+                                              const uint64_t seed);
+
+extern double ddtable_get_check_key_with_hash(ddtable_t ddtable,
+                                              const ddtable_hash_t* handle);
+
+extern int ddtable_set_val_with_hash(ddtable_t ddtable,
+                                     const ddtable_hash_t* handle,
+                                     const double val);
+
+extern double ddtable_memoize_with_hash(ddtable_t ddtable,
+                                        const ddtable_hash_t* handle,
+                                        ddtable_memo_fn fn, void* arg);
+
+/* Accumulate mode for group-by aggregation: each call finds or claims the
+ * key's slot in a single probe and folds val into the stored value in
+ * place (the first val for a key is stored as is; count stores 1 and adds
+ * 1). Returns 0, or 1 if the slot holds another key and the update was
+ * dropped, as ddtable_set_val drops colliding pairs. */
+extern int ddtable_add(ddtable_t ddtable, const double key, const double val);
+
+extern int ddtable_min(ddtable_t ddtable, const double key, const double val);
+
+extern int ddtable_max(ddtable_t ddtable, const double key, const double val);
+
+extern int ddtable_count(ddtable_t ddtable, const double key);
+
+/* The same, safe against concurrent calls from other threads (or processes,
+ * on a shared table): slots are claimed with a CAS on their stamp and
+ * values updated with an atomic read-modify-write. Read the results once
+ * the updaters are done. These need a hashed table without a front cache,
+ * ordered index or checkpoint, so tables from ddtable_new must be sized for
+ * more than 32 keys; anything else returns 1 without updating. */
+extern int ddtable_add_atomic(ddtable_t ddtable, const double key,
+                              const double val);
+
+extern int ddtable_min_atomic(ddtable_t ddtable, const double key,
+                              const double val);
+
+extern int ddtable_max_atomic(ddtable_t ddtable, const double key,
+                              const double val);
+
+extern int ddtable_count_atomic(ddtable_t ddtable, const double key);
+
+/* Aggregation applied by ddtable_accumulate_batch. */
+enum ddtable_accum_op
+{
+    DDTABLE_ACCUM_ADD,
+    DDTABLE_ACCUM_MIN,
+    DDTABLE_ACCUM_MAX,
+    DDTABLE_ACCUM_COUNT
+};
+
+/* Column-at-a-time form: folds vals[i] into keys[i] for all num_keys pairs
+ * (vals may be NULL for DDTABLE_ACCUM_COUNT). Keys are hashed and their
+ * slots prefetched a block ahead. Returns how many updates were dropped. */
+extern uint64_t ddtable_accumulate_batch(ddtable_t ddtable,
+                                         const enum ddtable_accum_op op,
+                                         const double* keys,
+                                         const double* vals,
+                                         const uint64_t num_keys);
+
+/* Vector-valued access for ddtable_new_vec tables. ddtable_get_vec returns
+ * the cached outputs in place (valid until the table is cleared or freed)
+ * or NULL on a miss; ddtable_get_vec_copy copies them out and returns 0 on
+ * a hit, 1 on a miss. */
+extern const double* ddtable_get_vec(const ddtable_t ddtable, const double key);
+
+extern int ddtable_get_vec_copy(const ddtable_t ddtable, const double key,
+                                double* vals);
+
+extern int ddtable_set_vec(ddtable_t ddtable, const double key,
+                           const double* vals);
+
+/* Builds a table for num_keys pairs using up to threads workers (0 means
+ * one per online CPU). Keys are hashed in one pass, radix-partitioned by
+ * slot region, and each worker fills whole regions, so the result is the
+ * same as inserting the pairs serially with ddtable_set_val. */
+extern ddtable_t ddtable_build_from_arrays(const double* keys,
+                                           const double* vals,
+                                           const uint64_t num_keys,
+                                           unsigned int threads);
+
+/* Equi-joins probe_keys against build_keys, matching each probe key to the
+ * first build row with an equal key. The build rows go into tables with
+ * room to spare (ddtable_build_from_arrays style), and the few rows whose
+ * key loses its slot to another key go into further, smaller tables, so no
+ * match is lost to a collision. Each match writes its probe row and build row to out_idx (two entries per
+ * match) and, unless build_vals or out_vals is NULL, the build row's value
+ * to out_vals; matches come out in probe order, at most one per probe key,
+ * so out_idx needs room for 2 * num_probe entries and out_vals for
+ * num_probe. Probing hashes keys a block at a time (vectorized where the
+ * target allows), prefetches their slots a block ahead and is split over up
+ * to threads workers (0 means one per online CPU). Returns the number of
+ * matches, or UINT64_MAX if the table could not be allocated. */
+extern uint64_t ddtable_hash_join(const double* build_keys,
+                                  const double* build_vals,
+                                  const uint64_t num_build,
+                                  const double* probe_keys,
+                                  const uint64_t num_probe, uint64_t* out_idx,
+                                  double* out_vals, unsigned int threads);
+
+/* How ddtable_merge resolves a key stored in more than one of the tables.
+ * dst counts as coming before every source, and sources in array order. */
+enum ddtable_merge_policy
+{
+    DDTABLE_MERGE_KEEP_FIRST,
+    DDTABLE_MERGE_KEEP_LAST,
+    DDTABLE_MERGE_COMBINE
+};
+
+/* Combines an already merged value of key with a later one. */
+typedef double (*ddtable_combine_fn)(const double key, const double old_val,
+                                     const double new_val, void* arg);
+
+/* Merges every entry of srcs into dst using up to threads workers (0 means
+ * one per online CPU). Entries are partitioned by destination slot region
+ * so each worker merges its own regions from all sources without locks;
+ * sources shaped like dst skip rehashing. Distinct keys that collide in dst
+ * keep the earlier one, as with ddtable_set_val. combine (with arg) is only
+ * used by DDTABLE_MERGE_COMBINE. Only for ddtable_new tables; returns 0 on
+ * success. */
+extern int ddtable_merge(ddtable_t dst, const ddtable_t* srcs,
+                         const unsigned int num_srcs, unsigned int threads,
+                         const enum ddtable_merge_policy policy,
+                         ddtable_combine_fn combine, void* arg);
+
+/* Composite-key access for ddtable_new_multi tables; keys points at
+ * key_width doubles. Same return conventions as the vector accessors. */
+extern const double* ddtable_get_multi(const ddtable_t ddtable,
+                                       const double* keys);
+
+extern int ddtable_set_multi(ddtable_t ddtable, const double* keys,
+                             const double* vals);
+
 #ifdef _cplusplus
 }
 #endif /* _cplusplus */
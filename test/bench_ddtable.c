@@ -0,0 +1,387 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <inttypes.h>
+#include <time.h>
+#include <math.h>
+
+#ifdef __CMAKE__
+#include "libddtable.h"
+#include "ddtable_swmr.h"
+#include "ddtable_set.h"
+#include "ddtable_adaptive.h"
+#include "ddtable_perf.h"
+#else
+#include "../src/libddtable.h"
+#include "../src/ddtable_swmr.h"
+#include "../src/ddtable_set.h"
+#include "../src/ddtable_adaptive.h"
+#include "../src/ddtable_perf.h"
+#endif
+
+#define DEFAULT_NUM_OPS 1000000
+#define DEFAULT_RANDOM_SEED 42
+
+//! Table capacities exercised; all small enough to show per-op overhead
+static const uint64_t table_sizes[] = { 64, 1024, 65536 };
+
+//! Tiny tables, filled with at most their capacity so they stay linear
+static const uint64_t tiny_sizes[] = { 8, 16, 32 };
+
+//! Hardware counters for this thread; NULL if unavailable
+static ddtable_perf_t perf = NULL;
+
+static inline double get_curr_secs(void)
+{
+    struct timespec ts;
+    if (clock_gettime(CLOCK_MONOTONIC, &ts) != 0)
+    {
+        perror("Failure to get current time: ");
+        return 0;
+    }
+    return ts.tv_sec + (ts.tv_nsec * 1e-9);
+}
+
+static void bench_table(const uint64_t num_keys, const double* keys,
+                        const unsigned int num_ops)
+{
+    ddtable_t ddtable = ddtable_new(num_keys);
+    volatile double sink = 0;
+    struct ddtable_perf_counts set_counts = { { 0 }, 0 };
+    struct ddtable_perf_counts get_counts = { { 0 }, 0 };
+
+    const double start_set_time = get_curr_secs();
+    DDTABLE_PERF_SCOPE(perf, &set_counts)
+    {
+        for (unsigned int i = 0; i < num_ops; i++)
+        {
+            ddtable_set_val(ddtable, keys[i], keys[i] + 1);
+        }
+    }
+    const double set_time = get_curr_secs() - start_set_time;
+
+    const double start_get_time = get_curr_secs();
+    DDTABLE_PERF_SCOPE(perf, &get_counts)
+    {
+        for (unsigned int i = 0; i < num_ops; i++)
+        {
+            sink += ddtable_get_check_key(ddtable, keys[i]);
+        }
+    }
+    const double get_time = get_curr_secs() - start_get_time;
+
+    // Same lookups through the single-writer/many-reader read path
+    ddtable_swmr_t swmr = ddtable_swmr_new(num_keys);
+    for (unsigned int i = 0; i < num_ops; i++)
+    {
+        ddtable_swmr_set_val(swmr, keys[i], keys[i]);
+    }
+    const double start_swmr_time = get_curr_secs();
+    for (unsigned int i = 0; i < num_ops; i++)
+    {
+        sink += ddtable_swmr_get_check_key(swmr, keys[i]);
+    }
+    const double swmr_time = get_curr_secs() - start_swmr_time;
+
+    printf("Size: %8"PRIu64"\tSET: %6.2f ns/op\tGET: %6.2f ns/op"
+           "\tSWMR GET: %6.2f ns/op\n",
+           num_keys, set_time / num_ops * 1e9, get_time / num_ops * 1e9,
+           swmr_time / num_ops * 1e9);
+    if (perf != NULL)
+    {
+        ddtable_perf_report(&set_counts, num_ops, "  SET", stdout);
+        ddtable_perf_report(&get_counts, num_ops, "  GET", stdout);
+    }
+    ddtable_swmr_free(swmr);
+    ddtable_free(ddtable);
+}
+
+/* Linear-scan lookups against the same keys in a hashed table (a seeded
+ * table never starts out linear). */
+static void bench_tiny(const uint64_t num_keys, const double* keys,
+                       const unsigned int num_ops)
+{
+    ddtable_t linear = ddtable_new(num_keys);
+    ddtable_t hashed = ddtable_new_seeded(num_keys, 0);
+    volatile double sink = 0;
+
+    for (uint64_t k = 0; k < num_keys; k++)
+    {
+        ddtable_set_val(linear, k, k + 1);
+        ddtable_set_val(hashed, k, k + 1);
+    }
+
+    const double start_linear_time = get_curr_secs();
+    for (unsigned int i = 0; i < num_ops; i++)
+    {
+        sink += ddtable_get_check_key(linear, keys[i]);
+    }
+    const double linear_time = get_curr_secs() - start_linear_time;
+
+    const double start_hashed_time = get_curr_secs();
+    for (unsigned int i = 0; i < num_ops; i++)
+    {
+        sink += ddtable_get_check_key(hashed, keys[i]);
+    }
+    const double hashed_time = get_curr_secs() - start_hashed_time;
+
+    printf("Size: %8"PRIu64"\tLINEAR GET: %6.2f ns/op"
+           "\tHASHED GET: %6.2f ns/op\n", num_keys,
+           linear_time / num_ops * 1e9, hashed_time / num_ops * 1e9);
+    ddtable_free(hashed);
+    ddtable_free(linear);
+}
+
+//! Membership through a map with dummy values, a set, and batched
+static void bench_membership(const uint64_t num_keys, const double* keys,
+                             const unsigned int num_ops)
+{
+    ddtable_t map = ddtable_new(num_keys);
+    ddset_t set = ddset_new(num_keys);
+    uint8_t* found = malloc(num_ops * sizeof(uint8_t));
+    volatile uint64_t sink = 0;
+
+    for (unsigned int i = 0; i < num_ops; i++)
+    {
+        ddtable_set_val(map, keys[i], 1);
+        ddset_insert(set, keys[i]);
+    }
+
+    const double start_map_time = get_curr_secs();
+    for (unsigned int i = 0; i < num_ops; i++)
+    {
+        sink += (ddtable_get_check_key(map, keys[i]) != 0);
+    }
+    const double map_time = get_curr_secs() - start_map_time;
+
+    const double start_set_time = get_curr_secs();
+    for (unsigned int i = 0; i < num_ops; i++)
+    {
+        sink += ddset_contains(set, keys[i]);
+    }
+    const double set_time = get_curr_secs() - start_set_time;
+
+    const double start_batch_time = get_curr_secs();
+    sink += ddset_contains_batch(set, keys, num_ops, found);
+    const double batch_time = get_curr_secs() - start_batch_time;
+
+    printf("Size: %8"PRIu64"\tMAP CONTAINS: %6.2f ns/op"
+           "\tSET CONTAINS: %6.2f ns/op\tSET BATCH: %6.2f ns/op\n",
+           num_keys, map_time / num_ops * 1e9, set_time / num_ops * 1e9,
+           batch_time / num_ops * 1e9);
+    free(found);
+    ddset_free(set);
+    ddtable_free(map);
+}
+
+//! Group-by sums: per-key upserts, their atomic form, and a whole column
+static void bench_accumulate(const uint64_t num_keys, const double* keys,
+                             const unsigned int num_ops)
+{
+    ddtable_t ddtable = ddtable_new(num_keys);
+
+    const double start_add_time = get_curr_secs();
+    for (unsigned int i = 0; i < num_ops; i++)
+    {
+        ddtable_add(ddtable, keys[i], 1.0);
+    }
+    const double add_time = get_curr_secs() - start_add_time;
+
+    ddtable_clear(ddtable);
+    const double start_atomic_time = get_curr_secs();
+    for (unsigned int i = 0; i < num_ops; i++)
+    {
+        ddtable_add_atomic(ddtable, keys[i], 1.0);
+    }
+    const double atomic_time = get_curr_secs() - start_atomic_time;
+
+    ddtable_clear(ddtable);
+    const double start_batch_time = get_curr_secs();
+    ddtable_accumulate_batch(ddtable, DDTABLE_ACCUM_ADD, keys, keys, num_ops);
+    const double batch_time = get_curr_secs() - start_batch_time;
+
+    printf("Size: %8"PRIu64"\tADD: %6.2f ns/op\tADD ATOMIC: %6.2f ns/op"
+           "\tADD BATCH: %6.2f ns/op\n", num_keys,
+           add_time / num_ops * 1e9, atomic_time / num_ops * 1e9,
+           batch_time / num_ops * 1e9);
+    ddtable_free(ddtable);
+}
+
+//! Build from the first num_keys keys and probe with all of them, as a
+//! scalar set/get loop and through the hash join kernel
+static void bench_hash_join(const uint64_t num_keys, const double* keys,
+                            const unsigned int num_ops)
+{
+    const uint64_t num_build = (num_keys < num_ops) ? num_keys : num_ops;
+    uint64_t* out_idx = malloc(2 * num_ops * sizeof(uint64_t));
+    double* out_vals = malloc(num_ops * sizeof(double));
+    if (out_idx == NULL || out_vals == NULL)
+    {
+        free(out_vals);
+        free(out_idx);
+        return;
+    }
+
+    const double start_scalar_time = get_curr_secs();
+    ddtable_t ddtable = ddtable_new(num_build);
+    for (uint64_t i = 0; i < num_build; i++)
+    {
+        ddtable_set_val(ddtable, keys[i], keys[i] + 1);
+    }
+    uint64_t num_scalar = 0;
+    for (unsigned int i = 0; i < num_ops; i++)
+    {
+        num_scalar += (ddtable_get_check_key(ddtable, keys[i]) != 0);
+    }
+    const double scalar_time = get_curr_secs() - start_scalar_time;
+    ddtable_free(ddtable);
+
+    const double start_join_time = get_curr_secs();
+    const uint64_t num_joined = ddtable_hash_join(keys, keys, num_build, keys,
+                                                  num_ops, out_idx, out_vals,
+                                                  0);
+    const double join_time = get_curr_secs() - start_join_time;
+
+    printf("Size: %8"PRIu64"\tSCALAR JOIN: %6.2f ns/probe (%"PRIu64")"
+           "\tHASH JOIN: %6.2f ns/probe (%"PRIu64")\n", num_keys,
+           scalar_time / num_ops * 1e9, num_scalar,
+           join_time / num_ops * 1e9, num_joined);
+    free(out_vals);
+    free(out_idx);
+}
+
+//! Same set/get stream through a self-tuning table
+static void bench_adaptive(const uint64_t num_keys, const double* keys,
+                           const unsigned int num_ops)
+{
+    static const char* layout_names[] = { "direct", "probe", "cuckoo" };
+    ddadaptive_t adaptive = ddadaptive_new(num_keys);
+
+    const double start_set_time = get_curr_secs();
+    for (unsigned int i = 0; i < num_ops; i++)
+    {
+        ddadaptive_set_val(adaptive, keys[i], keys[i] + 1);
+    }
+    const double set_time = get_curr_secs() - start_set_time;
+
+    const double start_get_time = get_curr_secs();
+    for (unsigned int i = 0; i < num_ops; i++)
+    {
+        ddadaptive_get_check_key(adaptive, keys[i]);
+    }
+    const double get_time = get_curr_secs() - start_get_time;
+
+    struct ddadaptive_stats stats;
+    ddadaptive_get_stats(adaptive, &stats);
+    printf("Size: %8"PRIu64"\tADAPTIVE SET: %6.2f ns/op\tGET: %6.2f ns/op"
+           "\t(%s, %"PRIu64" dropped)\n", num_keys,
+           set_time / num_ops * 1e9, get_time / num_ops * 1e9,
+           layout_names[stats.layout], stats.drops);
+    ddadaptive_free(adaptive);
+}
+
+#define NUM_SHARED_TABLES 4
+
+/* One key looked up in several same-seed tables, hashing it each time
+ * versus hashing it once into a reusable handle. */
+static void bench_shared_hash(const uint64_t num_keys, const double* keys,
+                              const unsigned int num_ops)
+{
+    ddtable_t tables[NUM_SHARED_TABLES];
+    volatile double sink = 0;
+
+    for (unsigned int t = 0; t < NUM_SHARED_TABLES; t++)
+    {
+        tables[t] = ddtable_new(num_keys);
+        for (unsigned int i = 0; i < num_ops; i++)
+        {
+            ddtable_set_val(tables[t], keys[i], keys[i] + t);
+        }
+    }
+
+    const double start_plain_time = get_curr_secs();
+    for (unsigned int i = 0; i < num_ops; i++)
+    {
+        for (unsigned int t = 0; t < NUM_SHARED_TABLES; t++)
+        {
+            sink += ddtable_get_check_key(tables[t], keys[i]);
+        }
+    }
+    const double plain_time = get_curr_secs() - start_plain_time;
+
+    const double start_handle_time = get_curr_secs();
+    for (unsigned int i = 0; i < num_ops; i++)
+    {
+        const ddtable_hash_t handle = ddtable_hash_key(keys[i]);
+        for (unsigned int t = 0; t < NUM_SHARED_TABLES; t++)
+        {
+            sink += ddtable_get_check_key_with_hash(tables[t], &handle);
+        }
+    }
+    const double handle_time = get_curr_secs() - start_handle_time;
+
+    printf("Size: %8"PRIu64"\t%d TABLES GET: %6.2f ns/key"
+           "\tWITH HASH: %6.2f ns/key\n", num_keys, NUM_SHARED_TABLES,
+           plain_time / num_ops * 1e9, handle_time / num_ops * 1e9);
+    for (unsigned int t = 0; t < NUM_SHARED_TABLES; t++)
+    {
+        ddtable_free(tables[t]);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    unsigned int num_ops = DEFAULT_NUM_OPS;
+    int random_seed = DEFAULT_RANDOM_SEED;
+    if (argc > 1)
+    {
+        num_ops = atoi(argv[1]);
+        if (argc > 2)
+        {
+            random_seed = atoi(argv[2]);
+        }
+    }
+    srand(random_seed);
+
+    // Counters are optional; without them only wall-clock times are shown
+    perf = ddtable_perf_open();
+    if (perf == NULL)
+    {
+        puts("Hardware performance counters unavailable");
+    }
+
+    double* keys = malloc(num_ops * sizeof(double));
+    if (keys == NULL)
+    {
+        perror("Failure to allocate keys: ");
+        return EXIT_FAILURE;
+    }
+
+    const unsigned int num_sizes = sizeof(table_sizes) / sizeof(*table_sizes);
+    for (unsigned int s = 0; s < num_sizes; s++)
+    {
+        for (unsigned int i = 0; i < num_ops; i++)
+        {
+            keys[i] = rand() % (2 * table_sizes[s]);
+        }
+        bench_table(table_sizes[s], keys, num_ops);
+        bench_shared_hash(table_sizes[s], keys, num_ops);
+        bench_membership(table_sizes[s], keys, num_ops);
+        bench_accumulate(table_sizes[s], keys, num_ops);
+        bench_hash_join(table_sizes[s], keys, num_ops);
+        bench_adaptive(table_sizes[s], keys, num_ops);
+    }
+
+    const unsigned int num_tiny = sizeof(tiny_sizes) / sizeof(*tiny_sizes);
+    for (unsigned int s = 0; s < num_tiny; s++)
+    {
+        for (unsigned int i = 0; i < num_ops; i++)
+        {
+            keys[i] = rand() % (2 * tiny_sizes[s]);
+        }
+        bench_tiny(tiny_sizes[s], keys, num_ops);
+    }
+
+    ddtable_perf_close(perf);
+    free(keys);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,160 @@
+#include <stdlib.h>
+#include <stdio.h>
+
+#ifdef __CMAKE__
+#include "libddtable.h"
+#include "ddtable_adaptive.h"
+#else
+#include "../src/libddtable.h"
+#include "../src/ddtable_adaptive.h"
+#endif
+
+#define NUM_SLOTS (1 << 14)
+#define DEFAULT_RANDOM_SEED 42
+
+static const char* layout_names[] = { "direct", "linear probe", "cuckoo" };
+
+//! Every key that was stored must still be found, with its value
+static int check_stored(ddadaptive_t adaptive, const double* keys,
+                        const uint8_t* stored, const unsigned int num_keys)
+{
+    int failed = 0;
+    for (unsigned int i = 0; i < num_keys; i++)
+    {
+        failed |= stored[i] &&
+            (ddadaptive_get_check_key(adaptive, keys[i]) != i + 1);
+    }
+    return failed;
+}
+
+//! A lightly loaded, read-mostly table has no reason to leave direct mapping
+static int check_low_load(void)
+{
+    ddadaptive_t adaptive = ddadaptive_new(NUM_SLOTS);
+    for (int i = 0; i < 200; i++)
+    {
+        ddadaptive_set_val(adaptive, i, i + 1);
+    }
+    for (int r = 0; r < 100; r++)
+    {
+        for (int i = 0; i < 200; i++)
+        {
+            ddadaptive_get_check_key(adaptive, i);
+        }
+    }
+    const int failed = (ddadaptive_layout(adaptive) != DDADAPTIVE_DIRECT);
+    ddadaptive_free(adaptive);
+    return failed;
+}
+
+/* Fills a table to 85% with a read-heavy mix: it has to leave direct mapping
+ * and end up in cuckoo, without losing a key on the way. */
+static int check_filling(double* keys, uint8_t* stored)
+{
+    const unsigned int num_keys = (NUM_SLOTS * 85) / 100;
+    ddadaptive_t adaptive = ddadaptive_new(NUM_SLOTS);
+    enum ddadaptive_layout seen = DDADAPTIVE_DIRECT;
+    int failed = 0;
+
+    for (unsigned int i = 0; i < num_keys; i++)
+    {
+        keys[i] = (rand() * 1.0) + (i * 0.25);
+        stored[i] = (ddadaptive_set_val(adaptive, keys[i], i + 1) == 0);
+        for (int r = 0; r < 4; r++)
+        {
+            const unsigned int j = rand() % (i + 1);
+            failed |= stored[j] &&
+                (ddadaptive_get_check_key(adaptive, keys[j]) != j + 1);
+        }
+        if (ddadaptive_layout(adaptive) != seen)
+        {
+            seen = ddadaptive_layout(adaptive);
+            printf("Switched to %s at load %.2f\n", layout_names[seen],
+                   (double) i / NUM_SLOTS);
+        }
+    }
+    failed |= check_stored(adaptive, keys, stored, num_keys);
+
+    struct ddadaptive_stats stats;
+    ddadaptive_get_stats(adaptive, &stats);
+    printf("Layout %s after %lu migrations, %lu keys, %lu dropped, "
+           "%.2f probes per lookup\n", layout_names[stats.layout],
+           (unsigned long) stats.migrations, (unsigned long) stats.num_keys,
+           (unsigned long) stats.drops, (double) stats.probes / stats.gets);
+    failed |= (stats.layout != DDADAPTIVE_CUCKOO);
+
+    ddadaptive_free(adaptive);
+    return failed;
+}
+
+//! Forced migrations keep every key visible while they are under way
+static int check_forced_migrations(double* keys, uint8_t* stored)
+{
+    const unsigned int num_keys = NUM_SLOTS / 4;
+    ddadaptive_t adaptive = ddadaptive_new(NUM_SLOTS);
+    int failed = 0;
+
+    ddadaptive_migrate(adaptive, DDADAPTIVE_LINEAR_PROBE);
+    for (unsigned int i = 0; i < num_keys; i++)
+    {
+        keys[i] = i * 1.5;
+        stored[i] = (ddadaptive_set_val(adaptive, keys[i], i + 1) == 0);
+        failed |= !stored[i];
+    }
+
+    const enum ddadaptive_layout order[] = {
+        DDADAPTIVE_CUCKOO, DDADAPTIVE_DIRECT, DDADAPTIVE_LINEAR_PROBE
+    };
+    for (int m = 0; m < 3; m++)
+    {
+        failed |= (ddadaptive_migrate(adaptive, order[m]) != 0);
+        // Lookups drive the migration along. Moving to direct mapping
+        // drops whatever collides, so there only the survivors count.
+        if (order[m] == DDADAPTIVE_DIRECT)
+        {
+            for (unsigned int r = 0; r < 2; r++)
+            {
+                for (unsigned int i = 0; i < num_keys; i++)
+                {
+                    stored[i] &= (ddadaptive_get_check_key(adaptive,
+                                                           keys[i]) == i + 1);
+                }
+            }
+        }
+        failed |= check_stored(adaptive, keys, stored, num_keys);
+        struct ddadaptive_stats stats;
+        ddadaptive_get_stats(adaptive, &stats);
+        failed |= stats.migrating || (stats.layout != order[m]);
+    }
+
+    // An empty table that never got loaded goes back to direct mapping
+    ddadaptive_clear(adaptive);
+    failed |= (ddadaptive_get_check_key(adaptive, keys[0]) != 0);
+    failed |= (ddadaptive_layout(adaptive) != DDADAPTIVE_LINEAR_PROBE);
+    ddadaptive_set_val(adaptive, 1.0, 2.0);
+    ddadaptive_clear(adaptive);
+    failed |= (ddadaptive_layout(adaptive) != DDADAPTIVE_DIRECT);
+
+    ddadaptive_free(adaptive);
+    return failed;
+}
+
+int main(void)
+{
+    srand(DEFAULT_RANDOM_SEED);
+    double* keys = malloc(NUM_SLOTS * sizeof(double));
+    uint8_t* stored = malloc(NUM_SLOTS * sizeof(uint8_t));
+    if (keys == NULL || stored == NULL)
+    {
+        return EXIT_FAILURE;
+    }
+
+    int failed = check_low_load();
+    failed |= check_filling(keys, stored);
+    failed |= check_forced_migrations(keys, stored);
+    puts(failed ? "Adaptive layout: FAILED" : "Adaptive layout: OK");
+
+    free(stored);
+    free(keys);
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,363 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#ifdef __CMAKE__
+#include "libddtable.h"
+#include "ddtable_ckpt.h"
+#else
+#include "../src/libddtable.h"
+#include "../src/ddtable_ckpt.h"
+#endif
+
+#define CKPT_PATH "test_ckpt.img"
+#define CKPT_DELTA_PATH CKPT_PATH ".delta"
+#define DDTABLE_SIZE (1 << 16)
+
+//! Nonzero unless b holds exactly a's pairs for keys [0, num_keys)
+static int tables_differ(const ddtable_t a, const ddtable_t b,
+                         const int num_keys)
+{
+    if (b == NULL)
+    {
+        return 1;
+    }
+    for (int k = 0; k < num_keys; k++)
+    {
+        if (ddtable_get_check_key(a, k) != ddtable_get_check_key(b, k))
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void remove_files(void)
+{
+    unlink(CKPT_PATH);
+    unlink(CKPT_DELTA_PATH);
+}
+
+//! Base image plus two checkpoints, then compaction, restore the live table
+static int check_run_and_compact(void)
+{
+    ddtable_t table = ddtable_new(DDTABLE_SIZE);
+    int failed = 0;
+    for (int k = 0; k < 1000; k++)
+    {
+        ddtable_set_val(table, k, k + 0.5);
+    }
+
+    ddtable_ckpt_t ckpt = ddtable_ckpt_new(table, CKPT_PATH, 0, 0);
+    failed |= (ckpt == NULL);
+    for (int k = 1000; k < 1100; k++)
+    {
+        ddtable_set_val(table, k, -k);
+    }
+    failed |= (ddtable_ckpt_run(ckpt) != 0);
+    ddtable_t restored = ddtable_ckpt_restore(CKPT_PATH);
+    failed |= tables_differ(table, restored, 2000);
+    ddtable_free(restored);
+
+    // Nothing dirty: nothing logged
+    struct ddtable_ckpt_stats stats;
+    ddtable_ckpt_get_stats(ckpt, &stats);
+    failed |= (ddtable_ckpt_run(ckpt) != 0);
+    struct ddtable_ckpt_stats idle;
+    ddtable_ckpt_get_stats(ckpt, &idle);
+    failed |= (idle.checkpoints != stats.checkpoints ||
+               idle.delta_bytes != stats.delta_bytes);
+
+    for (int k = 1100; k < 2000; k++)
+    {
+        ddtable_set_val(table, k, k);
+    }
+    failed |= (ddtable_ckpt_run(ckpt) != 0);
+    failed |= (ddtable_ckpt_compact(ckpt) != 0);
+    ddtable_ckpt_get_stats(ckpt, &stats);
+    failed |= (stats.checkpoints != 2 || stats.compactions != 1 ||
+               stats.delta_bytes != 0 || stats.failures != 0);
+    restored = ddtable_ckpt_restore(CKPT_PATH);
+    failed |= tables_differ(table, restored, 2000);
+    ddtable_free(restored);
+
+    // A checkpoint after compaction lands on top of the new base
+    ddtable_set_val(table, 5000, 1);
+    failed |= (ddtable_ckpt_run(ckpt) != 0);
+    restored = ddtable_ckpt_restore(CKPT_PATH);
+    failed |= tables_differ(table, restored, 6000);
+    ddtable_free(restored);
+
+    ddtable_ckpt_free(ckpt);
+    ddtable_free(table);
+    remove_files();
+    return failed;
+}
+
+struct writer_args
+{
+    ddtable_ckpt_t ckpt;
+    volatile int started;
+};
+
+static void* write_checkpoint(void* arg)
+{
+    struct writer_args* args = arg;
+    __atomic_store_n(&args->started, 1, __ATOMIC_RELEASE);
+    ddtable_ckpt_write(args->ckpt);
+    return NULL;
+}
+
+/* Updates made while a checkpoint is being written don't leak into it: the
+ * restored table is the table as it was when the checkpoint began. */
+static int check_copy_on_write(void)
+{
+    ddtable_t table = ddtable_new(DDTABLE_SIZE);
+    ddtable_t expected = ddtable_new(DDTABLE_SIZE);
+    ddtable_ckpt_t ckpt = ddtable_ckpt_new(table, CKPT_PATH, 0, 0);
+    int failed = (ckpt == NULL);
+
+    for (int k = 0; k < 20000; k++)
+    {
+        ddtable_set_val(table, k, k + 1);
+        ddtable_set_val(expected, k, k + 1);
+    }
+    failed |= (ddtable_ckpt_begin(ckpt) != 0);
+    failed |= (ddtable_ckpt_begin(ckpt) != 1);
+    // Nothing is logged yet, so these copy their blocks out first
+    for (int k = 0; k < 1000; k++)
+    {
+        ddtable_set_val(table, k + 20000, k);
+    }
+
+    struct writer_args args = { ckpt, 0 };
+    pthread_t thread;
+    pthread_create(&thread, NULL, write_checkpoint, &args);
+    while (!__atomic_load_n(&args.started, __ATOMIC_ACQUIRE))
+    {
+    }
+    for (int k = 1000; k < 20000; k++)
+    {
+        ddtable_set_val(table, k + 20000, -k);
+    }
+    ddtable_clear(table);
+    pthread_join(thread, NULL);
+
+    ddtable_t restored = ddtable_ckpt_restore(CKPT_PATH);
+    failed |= tables_differ(expected, restored, 40000);
+    ddtable_free(restored);
+
+    // The next checkpoint picks up the clear
+    failed |= (ddtable_ckpt_run(ckpt) != 0);
+    restored = ddtable_ckpt_restore(CKPT_PATH);
+    failed |= tables_differ(table, restored, 40000);
+    ddtable_free(restored);
+
+    struct ddtable_ckpt_stats stats;
+    ddtable_ckpt_get_stats(ckpt, &stats);
+    printf("Checkpoints: %lu logged %lu blocks, %lu copied on write\n",
+           (unsigned long) stats.checkpoints,
+           (unsigned long) stats.blocks_logged,
+           (unsigned long) stats.blocks_copied_on_write);
+    failed |= (stats.checkpoints != 2 || stats.blocks_copied_on_write == 0);
+
+    ddtable_ckpt_free(ckpt);
+    ddtable_free(expected);
+    ddtable_free(table);
+    remove_files();
+    return failed;
+}
+
+//! Tiny linear-mode tables are tracked too, and a torn record is ignored
+static int check_linear_and_torn(void)
+{
+    ddtable_t table = ddtable_new(16);
+    ddtable_ckpt_t ckpt = ddtable_ckpt_new(table, CKPT_PATH, 0, 0);
+    int failed = (ckpt == NULL);
+    for (int k = 0; k < 8; k++)
+    {
+        ddtable_set_val(table, k, k + 100);
+    }
+    failed |= (ddtable_ckpt_run(ckpt) != 0);
+    ddtable_ckpt_free(ckpt);
+
+    // Half a record from a crash mid-checkpoint
+    const int fd = open(CKPT_DELTA_PATH, O_WRONLY | O_APPEND);
+    const char junk[40] = "DDTABCK1";
+    failed |= (fd < 0 || write(fd, junk, sizeof(junk)) != sizeof(junk));
+    close(fd);
+
+    ddtable_t restored = ddtable_ckpt_restore(CKPT_PATH);
+    failed |= tables_differ(table, restored, 16);
+    failed |= (restored != NULL && ddtable_set_val(restored, 9, 1) != 0);
+    ddtable_free(restored);
+
+    failed |= (ddtable_ckpt_restore("test_ckpt_missing.img") != NULL);
+    ddtable_free(table);
+    remove_files();
+    return failed;
+}
+
+/* Writes through find/upsert slots are checkpointed when they follow the
+ * rule: write before the table's next update or checkpoint begin. */
+static int check_slot_writes(void)
+{
+    ddtable_t table = ddtable_new(DDTABLE_SIZE);
+    ddtable_ckpt_t ckpt = ddtable_ckpt_new(table, CKPT_PATH, 0, 0);
+    int failed = (ckpt == NULL);
+
+    for (int k = 0; k < 100; k++)
+    {
+        double* slot = ddtable_upsert(table, k, NULL);
+        if (slot != NULL)
+        {
+            *slot = k + 0.5;
+        }
+    }
+    failed |= (ddtable_ckpt_run(ckpt) != 0);
+    ddtable_t restored = ddtable_ckpt_restore(CKPT_PATH);
+    failed |= tables_differ(table, restored, 100);
+    ddtable_free(restored);
+
+    // Mid-checkpoint, the slot is copied out as it was before it's handed
+    // out, so this checkpoint keeps the old value and the next one the new
+    ddtable_t before = ddtable_ckpt_restore(CKPT_PATH);
+    ddtable_set_val(table, 1000, 1);
+    failed |= (ddtable_ckpt_begin(ckpt) != 0);
+    double* slot = ddtable_find(table, 7);
+    failed |= (slot == NULL);
+    if (slot != NULL)
+    {
+        *slot = -7;
+    }
+    failed |= (ddtable_ckpt_write(ckpt) != 0);
+    ddtable_set_val(before, 1000, 1);
+    restored = ddtable_ckpt_restore(CKPT_PATH);
+    failed |= tables_differ(before, restored, 1001);
+    ddtable_free(restored);
+    ddtable_free(before);
+
+    failed |= (ddtable_ckpt_run(ckpt) != 0);
+    restored = ddtable_ckpt_restore(CKPT_PATH);
+    failed |= tables_differ(table, restored, 1001);
+    failed |= (restored != NULL && ddtable_get_check_key(restored, 7) != -7);
+    ddtable_free(restored);
+
+    ddtable_ckpt_free(ckpt);
+    ddtable_free(table);
+    remove_files();
+    return failed;
+}
+
+//! Copies file from to file to; 0 on success
+static int copy_file(const char* from, const char* to)
+{
+    FILE* in = fopen(from, "rb");
+    FILE* out = fopen(to, "wb");
+    char buf[4096];
+    size_t n;
+    int failed = (in == NULL || out == NULL);
+    while (!failed && (n = fread(buf, 1, sizeof(buf), in)) > 0)
+    {
+        failed = (fwrite(buf, 1, n, out) != n);
+    }
+    if (in != NULL)
+    {
+        fclose(in);
+    }
+    if (out != NULL)
+    {
+        failed |= (fclose(out) != 0);
+    }
+    return failed;
+}
+
+/* Restarting on the same path writes a new base before it truncates the
+ * log; a crash in between leaves the old records next to the new base,
+ * and restore must not apply them. */
+static int check_stale_log(void)
+{
+    ddtable_t table = ddtable_new(DDTABLE_SIZE);
+    ddtable_ckpt_t ckpt = ddtable_ckpt_new(table, CKPT_PATH, 0, 0);
+    int failed = (ckpt == NULL);
+    for (int k = 0; k < 3000; k++)
+    {
+        ddtable_set_val(table, k, k + 1);
+    }
+    failed |= (ddtable_ckpt_run(ckpt) != 0);
+    ddtable_ckpt_free(ckpt);
+    failed |= copy_file(CKPT_DELTA_PATH, CKPT_DELTA_PATH ".old");
+
+    // The restarted process changes every key before its new base
+    ddtable_clear(table);
+    for (int k = 0; k < 3000; k++)
+    {
+        ddtable_set_val(table, k, -k - 1);
+    }
+    ckpt = ddtable_ckpt_new(table, CKPT_PATH, 0, 0);
+    failed |= (ckpt == NULL);
+    ddtable_ckpt_free(ckpt);
+    failed |= (rename(CKPT_DELTA_PATH ".old", CKPT_DELTA_PATH) != 0);
+
+    ddtable_t restored = ddtable_ckpt_restore(CKPT_PATH);
+    failed |= tables_differ(table, restored, 3000);
+    ddtable_free(restored);
+
+    ddtable_free(table);
+    remove_files();
+    return failed;
+}
+
+//! The background thread checkpoints and compacts on its own
+static int check_background(void)
+{
+    ddtable_t table = ddtable_new(DDTABLE_SIZE);
+    ddtable_ckpt_t ckpt = ddtable_ckpt_new(table, CKPT_PATH, 1, 1 << 16);
+    int failed = (ckpt == NULL);
+
+    const struct timespec pause = { 0, 100000 };
+    for (int k = 0; k < 30000; k++)
+    {
+        ddtable_set_val(table, k, k * 0.25);
+        if (k % 100 == 0)
+        {
+            nanosleep(&pause, NULL);
+        }
+    }
+    struct ddtable_ckpt_stats stats;
+    ddtable_ckpt_get_stats(ckpt, &stats);
+    printf("Background: %lu checkpoints, %lu compactions\n",
+           (unsigned long) stats.checkpoints,
+           (unsigned long) stats.compactions);
+    failed |= (stats.checkpoints == 0 || stats.failures != 0);
+
+    // Writes after the last background checkpoint are in the final one
+    for (int k = 30000; k < 31000; k++)
+    {
+        ddtable_set_val(table, k, -k);
+    }
+    ddtable_ckpt_free(ckpt);
+    ddtable_t restored = ddtable_ckpt_restore(CKPT_PATH);
+    failed |= tables_differ(table, restored, 31000);
+    ddtable_free(restored);
+
+    ddtable_free(table);
+    remove_files();
+    return failed;
+}
+
+int main(void)
+{
+    int failed = 0;
+    failed |= check_run_and_compact();
+    failed |= check_copy_on_write();
+    failed |= check_linear_and_torn();
+    failed |= check_stale_log();
+    failed |= check_slot_writes();
+    failed |= check_background();
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
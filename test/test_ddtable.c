@@ -25,6 +25,626 @@ static void fill_using_exp(ddtable_t ddtable, const unsigned int num_vals)
     printf("Number of Collisions: %"PRIiFAST32"\n", num_collisions);
 }
 
+static int check_clear(ddtable_t ddtable)
+{
+    // The same keys every round, with values unique to the round, cycling
+    // past the generation counter's wraparound a couple of times
+    for (unsigned int round = 0; round < 600; round++)
+    {
+        ddtable_clear(ddtable);
+        for (unsigned int k = 0; k < DEFAULT_NUM_VALS; k++)
+        {
+            if (ddtable_get_check_key(ddtable, k) != 0)
+            {
+                fprintf(stderr, "Key %u survived clear in round %u\n", k,
+                        round);
+                return 1;
+            }
+        }
+
+        unsigned int num_stored = 0;
+        for (unsigned int k = 0; k < DEFAULT_NUM_VALS; k++)
+        {
+            if (ddtable_set_val(ddtable, k, round * 1000.0 + k + 1) == 0)
+            {
+                num_stored++;
+            }
+        }
+        for (unsigned int k = 0; k < DEFAULT_NUM_VALS; k++)
+        {
+            const double val = ddtable_get_check_key(ddtable, k);
+            if (val != 0 && val != round * 1000.0 + k + 1)
+            {
+                fprintf(stderr, "Key %u has a stale value in round %u\n", k,
+                        round);
+                return 1;
+            }
+        }
+        if (num_stored < DEFAULT_NUM_VALS - 10)
+        {
+            fprintf(stderr, "Only %u keys stored in round %u\n", num_stored,
+                    round);
+            return 1;
+        }
+    }
+    ddtable_clear(ddtable);
+    puts("Clear: OK");
+    return 0;
+}
+
+static int check_front_cache(ddtable_t ddtable)
+{
+    if (ddtable_attach_cache(ddtable, 0) != 0)
+    {
+        fputs("Could not attach front cache\n", stderr);
+        return 1;
+    }
+
+    for (unsigned int i = 0; i < DEFAULT_NUM_VALS; i++)
+    {
+        ddtable_set_val(ddtable, i, exp(i % 10));
+    }
+
+    // Skewed stream: a handful of hot keys dominate the lookups
+    for (unsigned int i = 0; i < 10 * DEFAULT_NUM_VALS; i++)
+    {
+        const unsigned int k = (i % 4) ? i % 8 : i % DEFAULT_NUM_VALS;
+        const double v = ddtable_get_check_key(ddtable, k);
+        if (v != 0 && v != exp(k % 10))
+        {
+            fprintf(stderr, "Front cache returned bad value for %u\n", k);
+            return 1;
+        }
+    }
+
+    uint64_t lookups, hits;
+    ddtable_get_cache_stats(ddtable, &lookups, &hits);
+    printf("Front cache hit rate: %"PRIu64"/%"PRIu64"\n", hits, lookups);
+
+    // Cleared keys must not be served from the cache either
+    ddtable_clear(ddtable);
+    for (unsigned int k = 0; k < 8; k++)
+    {
+        if (ddtable_get_check_key(ddtable, k) != 0)
+        {
+            fprintf(stderr, "Front cache served cleared key %u\n", k);
+            return 1;
+        }
+    }
+
+    ddtable_detach_cache(ddtable);
+    return (hits == 0);
+}
+
+static int check_vec_vals(void)
+{
+    ddtable_t vtable = ddtable_new_vec(DDTABLE_SIZE, 2);
+    int failed = 0;
+
+    // Memoize sin and cos together: one lookup serves both outputs
+    uint8_t stored[DEFAULT_NUM_VALS];
+    for (unsigned int i = 0; i < DEFAULT_NUM_VALS; i++)
+    {
+        const double sincos[2] = { sin(i), cos(i) };
+        stored[i] = (ddtable_set_vec(vtable, i, sincos) == 0);
+    }
+    unsigned int num_found = 0;
+    for (unsigned int i = 0; i < DEFAULT_NUM_VALS; i++)
+    {
+        double out[2];
+        const double* vals = ddtable_get_vec(vtable, i);
+        if (vals == NULL)
+        {
+            failed |= stored[i]; // Only a collision may lose a key
+            continue;
+        }
+        num_found++;
+        if (vals[0] != sin(i) || vals[1] != cos(i) ||
+            ddtable_get_vec_copy(vtable, i, out) != 0 || out[1] != cos(i))
+        {
+            fprintf(stderr, "Bad vector value for key %u\n", i);
+            failed = 1;
+        }
+    }
+    // 100 keys in 2000 slots: only a handful may collide
+    if (num_found < DEFAULT_NUM_VALS - 10)
+    {
+        fprintf(stderr, "Only %u of %u vector keys found\n", num_found,
+                DEFAULT_NUM_VALS);
+        failed = 1;
+    }
+    failed |= (ddtable_get_vec(vtable, -1) != NULL);
+
+    ddtable_free(vtable);
+    if (!failed)
+    {
+        puts("Vector values: OK");
+    }
+    return failed;
+}
+
+static int check_multi_keys(void)
+{
+    int failed = 0;
+
+    // Two- and three-argument functions, including one padded 3+1 layout
+    for (uint32_t key_width = 2; key_width <= 3; key_width++)
+    {
+        ddtable_t mtable = ddtable_new_multi(DDTABLE_SIZE, key_width, 1);
+        for (unsigned int i = 0; i < DEFAULT_NUM_VALS; i++)
+        {
+            const double args[3] = { i % 10, i / 10, i % 7 };
+            const double val = pow(args[0], args[1]) + args[2];
+            ddtable_set_multi(mtable, args, &val);
+        }
+        unsigned int num_found = 0;
+        for (unsigned int i = 0; i < DEFAULT_NUM_VALS; i++)
+        {
+            const double args[3] = { i % 10, i / 10, i % 7 };
+            const double swapped[3] = { i / 10, i % 10, i % 7 };
+            const double* val = ddtable_get_multi(mtable, args);
+            const double* other = ddtable_get_multi(mtable, swapped);
+            if (val == NULL)
+            {
+                continue; // Lost to a collision
+            }
+            num_found++;
+            // Argument order matters: the swapped key is another slot
+            if (*val != pow(args[0], args[1]) + args[2] ||
+                (args[0] != args[1] && other == val))
+            {
+                fprintf(stderr, "Bad composite value for key %u\n", i);
+                failed = 1;
+            }
+        }
+        // 100 keys in 2000 slots: only a handful may collide
+        if (num_found < DEFAULT_NUM_VALS - 10)
+        {
+            fprintf(stderr, "Only %u of %u composite keys found\n",
+                    num_found, DEFAULT_NUM_VALS);
+            failed = 1;
+        }
+        ddtable_free(mtable);
+    }
+    failed |= (ddtable_new_multi(DDTABLE_SIZE, 5, 1) != NULL);
+
+    if (!failed)
+    {
+        puts("Composite keys: OK");
+    }
+    return failed;
+}
+
+static int check_auto_sizing(void)
+{
+    // Regularly spaced keys with many repeats: 5000 distinct values
+    const unsigned int num_keys = 50000;
+    double* keys = malloc(num_keys * sizeof(double));
+    for (unsigned int i = 0; i < num_keys; i++)
+    {
+        keys[i] = (i % 5000) * 0.25;
+    }
+
+    ddtable_sizer_t sizer = ddtable_sizer_new();
+    for (unsigned int i = 0; i < num_keys; i++)
+    {
+        ddtable_sizer_add(sizer, keys[i]);
+    }
+    const uint64_t estimate = ddtable_sizer_estimate(sizer);
+    ddtable_sizer_free(sizer);
+
+    ddtable_t sized = ddtable_new_from_sample(keys, num_keys);
+    int_fast32_t num_collisions = 0;
+    for (unsigned int i = 0; i < 5000; i++)
+    {
+        num_collisions += ddtable_set_val(sized, keys[i], i);
+    }
+    printf("Estimated distinct keys: %"PRIu64" (seed %"PRIu64
+           ", %"PRIiFAST32" collisions)\n",
+           estimate, ddtable_seed(sized), num_collisions);
+    ddtable_free(sized);
+    free(keys);
+
+    // HLL with 4096 registers should be well within 10%
+    return (estimate < 4500 || estimate > 5500);
+}
+
+static int check_linear_scan(void)
+{
+    // Tiny tables scan packed keys, so a full table has no collisions
+    const unsigned int num_keys = 16;
+    ddtable_t tiny = ddtable_new(num_keys);
+    int failed = 0;
+    for (int round = 0; round < 2; round++)
+    {
+        for (unsigned int i = 0; i < num_keys; i++)
+        {
+            failed |= (ddtable_set_val(tiny, i * 1.5, i + 1) != 0);
+        }
+        failed |= (ddtable_set_val(tiny, 3.0, 99) != 1);
+        for (unsigned int i = 0; i < num_keys; i++)
+        {
+            failed |= (ddtable_get_check_key(tiny, i * 1.5) != i + 1);
+            failed |= (ddtable_get_val(tiny, i * 1.5) != i + 1);
+        }
+        failed |= (ddtable_get_check_key(tiny, -1.5) != 0);
+
+        ddtable_t grown = ddtable_resize(tiny, 1024);
+        for (unsigned int i = 0; grown != NULL && i < num_keys; i++)
+        {
+            failed |= (ddtable_get_check_key(grown, i * 1.5) != i + 1);
+        }
+        failed |= (grown == NULL);
+        ddtable_free(grown);
+        ddtable_clear(tiny);
+        failed |= (ddtable_get_check_key(tiny, 1.5) != 0);
+    }
+
+    // A full table drops new keys, and every key it accepted stays found
+    int accepted[4 * 16 + 1];
+    for (unsigned int i = 0; i <= 4 * num_keys; i++)
+    {
+        accepted[i] = (ddtable_set_val(tiny, i * 1.5, i + 1) == 0);
+        failed |= (accepted[i] != (i < num_keys));
+    }
+    failed |= (ddtable_upsert(tiny, 0.25, NULL) != NULL);
+    for (unsigned int i = 0; i <= 4 * num_keys; i++)
+    {
+        const double v = ddtable_get_check_key(tiny, i * 1.5);
+        failed |= (v != (accepted[i] ? i + 1 : 0));
+    }
+
+    // Merging into a tiny table keeps it linear and follows the policy
+    ddtable_t src = ddtable_new(DDTABLE_SIZE);
+    for (unsigned int i = 0; i < 4 * num_keys; i++)
+    {
+        ddtable_set_val(src, i * 1.5, -1.0 - i);
+    }
+    failed |= ddtable_merge(tiny, &src, 1, 1, DDTABLE_MERGE_KEEP_LAST, NULL,
+                            NULL);
+    for (unsigned int i = 0; i < num_keys; i++)
+    {
+        // Keys src lost to its own collisions keep their old value
+        const double want = (ddtable_get_check_key(src, i * 1.5) != 0)
+            ? -1.0 - i : i + 1;
+        failed |= (ddtable_get_check_key(tiny, i * 1.5) != want);
+    }
+    failed |= (ddtable_get_check_key(tiny, num_keys * 1.5) != 0);
+    ddtable_free(src);
+    ddtable_free(tiny);
+
+    if (!failed)
+    {
+        puts("Linear scan: OK");
+    }
+    return failed;
+}
+
+static int check_ordered_index(void)
+{
+    const unsigned int num_keys = 3000;
+    ddtable_t ddtable = ddtable_new(DDTABLE_SIZE);
+    double* stored = malloc(num_keys * sizeof(double));
+    unsigned int num_stored = 0;
+    int failed = ddtable_attach_order(ddtable);
+
+    // Scattered insertion order; only keys that didn't collide count
+    for (unsigned int i = 0; i < num_keys; i++)
+    {
+        const double key = ((i * 7919) % num_keys) * 0.5;
+        if (ddtable_set_val(ddtable, key, (2 * key) + 1) == 0)
+        {
+            stored[num_stored++] = key;
+        }
+    }
+
+    for (double q = -3.3; q < (num_keys * 0.5) + 3; q += 0.37)
+    {
+        double lo = -INFINITY, hi = INFINITY;
+        for (unsigned int i = 0; i < num_stored; i++)
+        {
+            lo = (stored[i] <= q && stored[i] > lo) ? stored[i] : lo;
+            hi = (stored[i] >= q && stored[i] < hi) ? stored[i] : hi;
+        }
+
+        double lo_key, lo_val, hi_key, hi_val, near_key, near_val;
+        const int partial = ddtable_get_bracket(ddtable, q, &lo_key, &lo_val,
+                                                &hi_key, &hi_val);
+        failed |= (partial != (isinf(lo) || isinf(hi)));
+        failed |= !isinf(lo) && (lo_key != lo || lo_val != (2 * lo) + 1);
+        failed |= !isinf(hi) && (hi_key != hi || hi_val != (2 * hi) + 1);
+
+        failed |= ddtable_get_nearest(ddtable, q, &near_key, &near_val);
+        const double best = (hi - q < q - lo) ? hi : lo;
+        failed |= (near_key != best || near_val != (2 * best) + 1);
+    }
+
+    ddtable_clear(ddtable);
+    double near_key, near_val;
+    failed |= (ddtable_get_nearest(ddtable, 1.0, &near_key, &near_val) != 1);
+
+    free(stored);
+    ddtable_free(ddtable);
+    if (!failed)
+    {
+        printf("Ordered index: OK (%u keys)\n", num_stored);
+    }
+    return failed;
+}
+
+static double square_plus_one(const double key, void* arg)
+{
+    ++*(unsigned int*) arg;
+    return (key * key) + 1;
+}
+
+static double always_zero(const double key, void* arg)
+{
+    (void) key;
+    ++*(unsigned int*) arg;
+    return 0;
+}
+
+static int check_hash_handle(void)
+{
+    // Two tables share the default seed; the third must rehash the handle
+    ddtable_t tables[3] = {
+        ddtable_new(DDTABLE_SIZE), ddtable_new(4 * DDTABLE_SIZE),
+        ddtable_new_seeded(DDTABLE_SIZE, 12345)
+    };
+    unsigned int num_calls = 0;
+    int failed = 0;
+
+    for (int k = 0; k < 500; k++)
+    {
+        const ddtable_hash_t handle = ddtable_hash_key(k * 0.75);
+        for (int t = 0; t < 3; t++)
+        {
+            const int plain = (ddtable_get_check_key(tables[t], k * 0.75) != 0);
+            failed |= (plain != (ddtable_get_check_key_with_hash(tables[t],
+                                                                 &handle) != 0));
+            if (ddtable_set_val_with_hash(tables[t], &handle, k + 1) == 0)
+            {
+                // Stored through the handle, found without it
+                failed |= (ddtable_get_check_key(tables[t], k * 0.75) != k + 1);
+            }
+        }
+    }
+
+    // Memoizing calls the function once per cached key
+    ddtable_clear(tables[0]);
+    const ddtable_hash_t handle = ddtable_hash_key(3.0);
+    failed |= (ddtable_memoize_with_hash(tables[0], &handle, square_plus_one,
+                                         &num_calls) != 10);
+    failed |= (ddtable_memoize(tables[0], 3.0, square_plus_one,
+                               &num_calls) != 10);
+    failed |= (num_calls != 1);
+
+    // A cached 0.0 is a hit too, in hashed and linear-mode tables alike
+    ddtable_t tiny = ddtable_new(16);
+    unsigned int num_zero_calls = 0;
+    failed |= ddtable_attach_cache(tables[1], 0);
+    for (int round = 0; round < 3; round++)
+    {
+        for (int k = 1000; k < 1005; k++)
+        {
+            const ddtable_hash_t zero_handle = ddtable_hash_key(k);
+            failed |= (ddtable_memoize(tables[1], k, always_zero,
+                                       &num_zero_calls) != 0);
+            failed |= (ddtable_memoize_with_hash(tables[2], &zero_handle,
+                                                 always_zero,
+                                                 &num_zero_calls) != 0);
+            failed |= (ddtable_memoize(tiny, k, always_zero,
+                                       &num_zero_calls) != 0);
+        }
+    }
+    failed |= (num_zero_calls != 3 * 5);
+
+    // Hits leave the front cache alone, so the last round is served by it
+    uint64_t lookups, hits;
+    ddtable_get_cache_stats(tables[1], &lookups, &hits);
+    failed |= (lookups != 3 * 5 || hits != 5);
+    ddtable_free(tiny);
+
+    for (int t = 0; t < 3; t++)
+    {
+        ddtable_free(tables[t]);
+    }
+    if (!failed)
+    {
+        puts("Hash handles: OK");
+    }
+    return failed;
+}
+
+// More distinct keys than a linear-scan table holds
+#define NUM_ACCUM_KEYS 40
+
+//! Runs one stream through each accumulator on a table of num_slots slots
+static int check_accumulators_on(const uint64_t num_slots)
+{
+    ddtable_t sums = ddtable_new(num_slots);
+    ddtable_t mins = ddtable_new(num_slots);
+    ddtable_t maxs = ddtable_new(num_slots);
+    ddtable_t counts = ddtable_new(num_slots);
+    ddtable_t batch = ddtable_new(num_slots);
+    double keys[1000], vals[1000];
+    double want_sum[NUM_ACCUM_KEYS] = { 0 }, want_count[NUM_ACCUM_KEYS] = { 0 };
+    double want_min[NUM_ACCUM_KEYS], want_max[NUM_ACCUM_KEYS];
+    int dropped[NUM_ACCUM_KEYS] = { 0 };
+    int failed = 0;
+
+    for (int i = 0; i < 1000; i++)
+    {
+        const int k = rand() % NUM_ACCUM_KEYS;
+        keys[i] = k + 0.5;
+        vals[i] = (rand() % 200) - 100;
+        if (want_count[k] == 0)
+        {
+            want_min[k] = want_max[k] = vals[i];
+        }
+        want_sum[k] += vals[i];
+        want_count[k]++;
+        want_min[k] = (vals[i] < want_min[k]) ? vals[i] : want_min[k];
+        want_max[k] = (vals[i] > want_max[k]) ? vals[i] : want_max[k];
+
+        dropped[k] |= ddtable_add(sums, keys[i], vals[i]);
+        failed |= (ddtable_min(mins, keys[i], vals[i]) != dropped[k]);
+        failed |= (ddtable_max(maxs, keys[i], vals[i]) != dropped[k]);
+        failed |= (ddtable_count(counts, keys[i]) != dropped[k]);
+    }
+    // The batch form drops exactly the updates the single calls did
+    uint64_t num_dropped = 0;
+    for (int i = 0; i < 1000; i++)
+    {
+        num_dropped += dropped[(int) keys[i]];
+    }
+    failed |= (ddtable_accumulate_batch(batch, DDTABLE_ACCUM_ADD, keys, vals,
+                                        1000) != num_dropped);
+
+    // A tiny table keeps the first keys it sees and drops the rest
+    int num_kept = 0;
+    for (int k = 0; k < NUM_ACCUM_KEYS; k++)
+    {
+        num_kept += (want_count[k] != 0 && !dropped[k]);
+    }
+    failed |= (num_slots == 16 && num_kept != 16);
+
+    for (int k = 0; k < NUM_ACCUM_KEYS; k++)
+    {
+        if (dropped[k] || want_count[k] == 0)
+        {
+            continue;
+        }
+        const double key = k + 0.5;
+        // A sum of 0 reads as a miss, so only nonzero sums are comparable
+        failed |= (want_sum[k] != 0 &&
+                   ddtable_get_check_key(sums, key) != want_sum[k]);
+        failed |= (want_sum[k] != 0 &&
+                   ddtable_get_check_key(batch, key) != want_sum[k]);
+        failed |= (want_min[k] != 0 &&
+                   ddtable_get_check_key(mins, key) != want_min[k]);
+        failed |= (want_max[k] != 0 &&
+                   ddtable_get_check_key(maxs, key) != want_max[k]);
+        failed |= (ddtable_get_check_key(counts, key) != want_count[k]);
+    }
+
+    ddtable_free(batch);
+    ddtable_free(counts);
+    ddtable_free(maxs);
+    ddtable_free(mins);
+    ddtable_free(sums);
+    return failed;
+}
+
+static int check_accumulators(void)
+{
+    // Linear-scan and hashed layouts
+    int failed = check_accumulators_on(16);
+    failed |= check_accumulators_on(4096);
+
+    // Updates must show through the front cache once it holds the key
+    ddtable_t ddtable = ddtable_new(4096);
+    ddtable_attach_cache(ddtable, 0);
+    if (ddtable_count(ddtable, 7.0) == 0)
+    {
+        failed |= (ddtable_get_check_key(ddtable, 7.0) != 1);
+        ddtable_count(ddtable, 7.0);
+        failed |= (ddtable_get_check_key(ddtable, 7.0) != 2);
+    }
+    // Tiny tables can't take concurrent updates
+    ddtable_t tiny = ddtable_new(8);
+    failed |= (ddtable_add_atomic(tiny, 1.0, 1.0) != 1);
+    ddtable_free(tiny);
+    ddtable_free(ddtable);
+
+    if (!failed)
+    {
+        puts("Accumulators: OK");
+    }
+    return failed;
+}
+
+//! Slot pointers on a table of num_slots slots
+static int check_find_upsert_on(const uint64_t num_slots)
+{
+    ddtable_t ddtable = ddtable_new(num_slots);
+    int inserted = 0;
+    int failed = 0;
+
+    // A stored 0.0 is a hit, unlike with ddtable_get_check_key
+    failed |= (ddtable_find(ddtable, 1.5) != NULL);
+    double* slot = ddtable_upsert(ddtable, 1.5, &inserted);
+    failed |= (slot == NULL || !inserted || *slot != 0);
+    failed |= (ddtable_find(ddtable, 1.5) != slot);
+
+    // Read-modify-write in place, one probe per update
+    for (int i = 0; i < 10; i++)
+    {
+        slot = ddtable_upsert(ddtable, 1.5, &inserted);
+        failed |= (slot == NULL || inserted);
+        if (slot != NULL)
+        {
+            *slot += i;
+        }
+    }
+    failed |= (ddtable_get_check_key(ddtable, 1.5) != 45);
+
+    // Keys set the usual way are found too
+    ddtable_set_val(ddtable, 2.5, 7);
+    slot = ddtable_find(ddtable, 2.5);
+    failed |= (slot == NULL || *slot != 7);
+
+    ddtable_clear(ddtable);
+    failed |= (ddtable_find(ddtable, 1.5) != NULL);
+    ddtable_free(ddtable);
+    return failed;
+}
+
+static int check_find_upsert(void)
+{
+    int failed = check_find_upsert_on(16);
+    failed |= check_find_upsert_on(4096);
+
+    // A key whose slot holds another key can't be upserted
+    ddtable_t ddtable = ddtable_new(64);
+    double other = 1;
+    ddtable_set_val(ddtable, 0.5, 1);
+    while (ddtable_set_val(ddtable, other, 1) == 0)
+    {
+        other++;
+    }
+    if (ddtable_get_check_key(ddtable, other) == 0)
+    {
+        failed |= (ddtable_upsert(ddtable, other, NULL) != NULL);
+        failed |= (ddtable_find(ddtable, other) != NULL);
+    }
+    ddtable_free(ddtable);
+
+    // In-place writes show through the front cache and the ordered index
+    ddtable = ddtable_new(4096);
+    ddtable_attach_cache(ddtable, 0);
+    ddtable_attach_order(ddtable);
+    ddtable_set_val(ddtable, 3.0, 1);
+    ddtable_get_check_key(ddtable, 3.0);
+    double* slot = ddtable_find(ddtable, 3.0);
+    if (slot != NULL)
+    {
+        *slot = 2;
+    }
+    failed |= (ddtable_get_check_key(ddtable, 3.0) != 2);
+    double near_key, near_val;
+    ddtable_get_nearest(ddtable, 3.1, &near_key, &near_val);
+    failed |= (near_key != 3.0 || near_val != 2);
+    ddtable_free(ddtable);
+
+    if (!failed)
+    {
+        puts("Find/upsert: OK");
+    }
+    return failed;
+}
+
 int main(int argc, char** argv)
 {
     unsigned int num_vals = DEFAULT_NUM_VALS;
@@ -56,8 +676,19 @@ int main(int argc, char** argv)
     ddtable_t ddtable = ddtable_new(DDTABLE_SIZE);
 
     fill_using_exp(ddtable, num_vals);
+
+    int failed = check_clear(ddtable);
+    failed |= check_front_cache(ddtable);
+    failed |= check_vec_vals();
+    failed |= check_multi_keys();
+    failed |= check_auto_sizing();
+    failed |= check_linear_scan();
+    failed |= check_ordered_index();
+    failed |= check_hash_handle();
+    failed |= check_accumulators();
+    failed |= check_find_upsert();
     
     ddtable_free(ddtable);
     
-    return EXIT_SUCCESS;
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
 }
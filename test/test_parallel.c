@@ -0,0 +1,360 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+#include <pthread.h>
+
+#ifdef __CMAKE__
+#include "libddtable.h"
+#else
+#include "../src/libddtable.h"
+#endif
+
+#define DEFAULT_NUM_KEYS 1000000
+#define DEFAULT_NUM_THREADS 4
+#define DEFAULT_RANDOM_SEED 42
+
+static inline double get_curr_secs(void)
+{
+    struct timespec ts;
+    if (clock_gettime(CLOCK_MONOTONIC, &ts) != 0)
+    {
+        perror("Failure to get current time: ");
+        return 0;
+    }
+    return ts.tv_sec + (ts.tv_nsec * 1e-9);
+}
+
+#define NUM_MERGE_SRCS 4
+
+static double add_vals(const double key, const double old_val,
+                       const double new_val, void* arg)
+{
+    (void) key;
+    (void) arg;
+    return old_val + new_val;
+}
+
+//! Policies on two tables holding the same keys
+static int check_merge_policies(void)
+{
+    ddtable_t a = ddtable_new(256);
+    ddtable_t b = ddtable_new(256);
+    for (int k = 1; k <= 100; k++)
+    {
+        ddtable_set_val(a, k, 1);
+        ddtable_set_val(b, k, 2);
+    }
+
+    const enum ddtable_merge_policy policies[] = {
+        DDTABLE_MERGE_KEEP_FIRST, DDTABLE_MERGE_KEEP_LAST,
+        DDTABLE_MERGE_COMBINE
+    };
+    const double expected[] = { 1, 2, 3 };
+    const ddtable_t srcs[] = { a, b };
+    int failed = 0;
+    for (int p = 0; p < 3; p++)
+    {
+        ddtable_t dst = ddtable_new(256);
+        failed |= ddtable_merge(dst, srcs, 2, 2, policies[p], add_vals, NULL);
+        for (int k = 1; k <= 100; k++)
+        {
+            const double v = ddtable_get_check_key(dst, k);
+            failed |= (ddtable_get_check_key(a, k) != 0) ? (v != expected[p])
+                : (v != 0);
+        }
+        ddtable_free(dst);
+    }
+    failed |= (ddtable_merge(a, srcs, 2, 1, DDTABLE_MERGE_KEEP_FIRST,
+                             NULL, NULL) != 1);
+
+    ddtable_free(b);
+    ddtable_free(a);
+    return failed;
+}
+
+//! The partitioned merge must match a single-threaded one exactly
+static int check_merge(const double* keys, const double* vals,
+                       const unsigned int num_keys,
+                       const unsigned int num_threads)
+{
+    ddtable_t srcs[NUM_MERGE_SRCS];
+    for (unsigned int s = 0; s < NUM_MERGE_SRCS; s++)
+    {
+        // Mix of shapes: the first source matches dst, the rest rehash
+        srcs[s] = ddtable_new(s ? num_keys / 2 : num_keys);
+        for (unsigned int i = s; i < num_keys; i += NUM_MERGE_SRCS)
+        {
+            ddtable_set_val(srcs[s], keys[i], vals[i]);
+        }
+    }
+
+    ddtable_t serial = ddtable_new(num_keys);
+    ddtable_t merged = ddtable_new(num_keys);
+    int failed = ddtable_merge(serial, srcs, NUM_MERGE_SRCS, 1,
+                               DDTABLE_MERGE_KEEP_LAST, NULL, NULL);
+    const double start_merge_time = get_curr_secs();
+    failed |= ddtable_merge(merged, srcs, NUM_MERGE_SRCS, num_threads,
+                            DDTABLE_MERGE_KEEP_LAST, NULL, NULL);
+    const double merge_time = get_curr_secs() - start_merge_time;
+
+    unsigned int num_mismatches = 0;
+    for (unsigned int i = 0; i < num_keys; i++)
+    {
+        num_mismatches += (ddtable_get_check_key(serial, keys[i]) !=
+                           ddtable_get_check_key(merged, keys[i]));
+    }
+    printf("Merge of %d tables (%u threads): %.4f s\tMismatches: %u\n",
+           NUM_MERGE_SRCS, num_threads, merge_time, num_mismatches);
+
+    ddtable_free(merged);
+    ddtable_free(serial);
+    for (unsigned int s = 0; s < NUM_MERGE_SRCS; s++)
+    {
+        ddtable_free(srcs[s]);
+    }
+    return failed || num_mismatches;
+}
+
+//! Build row of the first key equal to key by nested loop; -1 if none
+static int64_t nested_loop_row(const double* keys, const unsigned int num_build,
+                               const double key)
+{
+    for (unsigned int j = 0; j < num_build; j++)
+    {
+        if (keys[j] == key)
+        {
+            return j;
+        }
+    }
+    return -1;
+}
+
+/* Joins num_build rows against probe keys of which every other one is
+ * absent, checking each match against the first build row with that key.
+ * With first_rows NULL that row comes from a nested loop; otherwise
+ * first_rows[k] holds it for each integer key k (-1 if absent). */
+static unsigned int check_join_rows(const double* keys, const double* vals,
+                                    const unsigned int num_build,
+                                    const int64_t* first_rows,
+                                    const unsigned int num_threads)
+{
+    const unsigned int num_probe = 2 * num_build;
+    double* probe_keys = malloc(num_probe * sizeof(double));
+    uint64_t* out_idx = malloc(2 * num_probe * sizeof(uint64_t));
+    double* out_vals = malloc(num_probe * sizeof(double));
+    for (unsigned int i = 0; i < num_probe; i++)
+    {
+        probe_keys[i] = (i % 2) ? keys[(i * 7) % num_build] : -1.0 - i;
+    }
+
+    const double start_join_time = get_curr_secs();
+    const uint64_t num_matches = ddtable_hash_join(keys, vals, num_build,
+                                                   probe_keys, num_probe,
+                                                   out_idx, out_vals,
+                                                   num_threads);
+    const double join_time = get_curr_secs() - start_join_time;
+
+    unsigned int num_mismatches = 0;
+    uint64_t m = 0;
+    for (unsigned int i = 0; i < num_probe; i++)
+    {
+        const int64_t row = (first_rows == NULL)
+            ? nested_loop_row(keys, num_build, probe_keys[i])
+            : (probe_keys[i] >= 0) ? first_rows[(int64_t) probe_keys[i]] : -1;
+        if (row < 0)
+        {
+            continue;
+        }
+        num_mismatches += (m >= num_matches || out_idx[2 * m] != i ||
+                           out_idx[(2 * m) + 1] != (uint64_t) row ||
+                           out_vals[m] != vals[row]);
+        m++;
+    }
+    num_mismatches += (m != num_matches);
+    printf("Hash join %u x %u (%u threads): %.4f s\tMatches: %lu\t"
+           "Mismatches: %u\n", num_build, num_probe, num_threads, join_time,
+           (unsigned long) num_matches, num_mismatches);
+
+    free(out_vals);
+    free(out_idx);
+    free(probe_keys);
+    return num_mismatches;
+}
+
+/* Joins keys (integers below num_build) against the first build row of
+ * each probe key: no match may be lost to a collision. */
+static int check_hash_join(const double* keys, const double* vals,
+                           const unsigned int num_build,
+                           const unsigned int num_threads)
+{
+    // A nested loop over a prefix, then a full-size join checked against
+    // each key's first row
+    const unsigned int num_small = (num_build < 4000) ? num_build : 4000;
+    unsigned int num_mismatches = check_join_rows(keys, vals, num_small, NULL,
+                                                  num_threads);
+    int64_t* first_rows = malloc(num_build * sizeof(int64_t));
+    for (unsigned int k = 0; k < num_build; k++)
+    {
+        first_rows[k] = -1;
+    }
+    for (unsigned int j = num_build; j-- > 0;)
+    {
+        first_rows[(int64_t) keys[j]] = j;
+    }
+    num_mismatches += check_join_rows(keys, vals, num_build, first_rows,
+                                      num_threads);
+    free(first_rows);
+
+    // A tiny build side is scanned rather than hashed
+    const double small_keys[3] = { 5.0, 0.5, 5.0 };
+    const double small_vals[3] = { 1.0, 2.0, 3.0 };
+    const double small_probe[4] = { 0.5, 7.0, 5.0, 0.5 };
+    uint64_t small_idx[8];
+    double small_out[4];
+    int failed = (ddtable_hash_join(small_keys, small_vals, 3, small_probe, 4,
+                                    small_idx, small_out, num_threads) != 3);
+    failed |= (small_idx[0] != 0 || small_idx[1] != 1 || small_out[0] != 2.0);
+    failed |= (small_idx[2] != 2 || small_idx[3] != 0 || small_out[1] != 1.0);
+    failed |= (small_idx[4] != 3 || small_idx[5] != 1 || small_out[2] != 2.0);
+
+    return failed || num_mismatches;
+}
+
+#define NUM_ACCUM_KEYS 1000
+#define NUM_ACCUM_ROUNDS 200
+
+struct accum_worker
+{
+    ddtable_t sums;
+    ddtable_t counts;
+    ddtable_t maxs;
+    const double* keys;
+    int id;
+};
+
+//! Adds id + 1 to, counts, and offers id as the max of every key, repeatedly
+static void* accum_worker(void* arg)
+{
+    const struct accum_worker* w = arg;
+    for (int r = 0; r < NUM_ACCUM_ROUNDS; r++)
+    {
+        for (int k = 0; k < NUM_ACCUM_KEYS; k++)
+        {
+            ddtable_add_atomic(w->sums, w->keys[k], w->id + 1);
+            ddtable_count_atomic(w->counts, w->keys[k]);
+            ddtable_max_atomic(w->maxs, w->keys[k], w->id + 1);
+        }
+    }
+    return NULL;
+}
+
+//! Concurrent accumulators must lose no update to a race
+static int check_atomic_accumulate(const unsigned int num_threads)
+{
+    const uint64_t num_slots = 1 << 16;
+    ddtable_t sums = ddtable_new(num_slots);
+    ddtable_t counts = ddtable_new(num_slots);
+    ddtable_t maxs = ddtable_new(num_slots);
+    pthread_t threads[64];
+    struct accum_worker workers[64];
+    const unsigned int n = (num_threads < 64) ? num_threads : 64;
+    double keys[NUM_ACCUM_KEYS];
+
+    // Keys with slots of their own, so every update has somewhere to go
+    ddtable_t probe = ddtable_new(num_slots);
+    for (int k = 0, c = 0; k < NUM_ACCUM_KEYS; c++)
+    {
+        if (ddtable_set_val(probe, c * 1.5, 1) == 0)
+        {
+            keys[k++] = c * 1.5;
+        }
+    }
+    ddtable_free(probe);
+
+    for (unsigned int t = 0; t < n; t++)
+    {
+        workers[t] = (struct accum_worker) { sums, counts, maxs, keys, t };
+        pthread_create(&threads[t], NULL, accum_worker, &workers[t]);
+    }
+    for (unsigned int t = 0; t < n; t++)
+    {
+        pthread_join(threads[t], NULL);
+    }
+
+    int failed = 0;
+    const double want_sum = NUM_ACCUM_ROUNDS * (n * (n + 1) / 2.0);
+    for (int k = 0; k < NUM_ACCUM_KEYS; k++)
+    {
+        failed |= (ddtable_get_check_key(sums, keys[k]) != want_sum);
+        failed |= (ddtable_get_check_key(counts, keys[k]) !=
+                   NUM_ACCUM_ROUNDS * n);
+        failed |= (ddtable_get_check_key(maxs, keys[k]) != n);
+    }
+    printf("Atomic accumulators (%u threads): %s\n", n,
+           failed ? "FAILED" : "OK");
+
+    ddtable_free(maxs);
+    ddtable_free(counts);
+    ddtable_free(sums);
+    return failed;
+}
+
+int main(int argc, char** argv)
+{
+    unsigned int num_keys = DEFAULT_NUM_KEYS;
+    unsigned int num_threads = DEFAULT_NUM_THREADS;
+    if (argc > 1)
+    {
+        num_keys = atoi(argv[1]);
+        if (argc > 2)
+        {
+            num_threads = atoi(argv[2]);
+        }
+    }
+    srand(DEFAULT_RANDOM_SEED);
+
+    double* keys = malloc(num_keys * sizeof(double));
+    double* vals = malloc(num_keys * sizeof(double));
+    for (unsigned int i = 0; i < num_keys; i++)
+    {
+        // Plenty of duplicate keys, so "first insert wins" is exercised
+        keys[i] = rand() % num_keys;
+        vals[i] = i;
+    }
+
+    const double start_serial_time = get_curr_secs();
+    ddtable_t serial = ddtable_new(num_keys);
+    for (unsigned int i = 0; i < num_keys; i++)
+    {
+        ddtable_set_val(serial, keys[i], vals[i]);
+    }
+    const double serial_time = get_curr_secs() - start_serial_time;
+
+    const double start_build_time = get_curr_secs();
+    ddtable_t built = ddtable_build_from_arrays(keys, vals, num_keys,
+                                                num_threads);
+    const double build_time = get_curr_secs() - start_build_time;
+
+    unsigned int num_mismatches = 0;
+    for (unsigned int i = 0; i < num_keys; i++)
+    {
+        num_mismatches += (ddtable_get_check_key(serial, keys[i]) !=
+                           ddtable_get_check_key(built, keys[i]));
+    }
+
+    printf("Serial: %.4f s\tBulk (%u threads): %.4f s\tMismatches: %u\n",
+           serial_time, num_threads, build_time, num_mismatches);
+
+    int failed = (num_mismatches != 0);
+    failed |= check_merge_policies();
+    failed |= check_merge(keys, vals, num_keys, num_threads);
+    failed |= check_hash_join(keys, vals, num_keys, num_threads);
+    failed |= check_atomic_accumulate(num_threads);
+
+    ddtable_free(built);
+    ddtable_free(serial);
+    free(vals);
+    free(keys);
+
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,115 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+
+#ifdef __CMAKE__
+#include "libddtable.h"
+#include "ddtable_registry.h"
+#else
+#include "../src/libddtable.h"
+#include "../src/ddtable_registry.h"
+#endif
+
+#define DEFAULT_BUDGET_BYTES (256 * 1024)
+#define DEFAULT_EPOCH_CALLS 20000
+#define DEFAULT_NUM_ROUNDS 20
+#define DEFAULT_HOT_KEYS 4000
+#define DEFAULT_INITIAL_KEYS 4096
+
+//! Slow function over a small, repeating key set: worth caching
+static double expensive(const double key, void* arg)
+{
+    (void) arg;
+    double x = key;
+    for (int i = 0; i < 200; i++)
+    {
+        x = sin(x) + key;
+    }
+    return x + 1;
+}
+
+//! Cheap function over never-repeating keys: caching it is wasted space
+static double cheap(const double key, void* arg)
+{
+    (void) arg;
+    return key + 1;
+}
+
+//! Counts its calls; 0.0 is a result like any other and must be cached
+static double zero(const double key, void* arg)
+{
+    (void) key;
+    (*(unsigned int*) arg)++;
+    return 0.0;
+}
+
+static int check_zero_results(void)
+{
+    ddtable_registry_t registry = ddtable_registry_new(DEFAULT_BUDGET_BYTES,
+                                                       DEFAULT_EPOCH_CALLS);
+    unsigned int num_calls = 0;
+    const int id = ddtable_registry_add(registry, "zero", zero, &num_calls,
+                                        DEFAULT_INITIAL_KEYS);
+    int failed = (id < 0);
+
+    for (int round = 0; !failed && round < 4; round++)
+    {
+        for (int k = 0; k < 8; k++)
+        {
+            const ddtable_hash_t handle = ddtable_hash_key(k + 8);
+            failed |= (ddtable_registry_call(registry, id, k) != 0.0);
+            failed |= (ddtable_registry_call_with_hash(registry, id,
+                                                       &handle) != 0.0);
+        }
+    }
+
+    // Each key is computed once, then hit; nothing counts as a collision
+    struct ddtable_registry_stats stats;
+    failed |= ddtable_registry_get_stats(registry, id, &stats);
+    failed |= (num_calls != 16 || stats.hits != 48 || stats.collisions != 0);
+
+    ddtable_registry_free(registry);
+    return failed;
+}
+
+int main(void)
+{
+    ddtable_registry_t registry = ddtable_registry_new(DEFAULT_BUDGET_BYTES,
+                                                       DEFAULT_EPOCH_CALLS);
+    const int slow_id = ddtable_registry_add(registry, "expensive", expensive,
+                                             NULL, DEFAULT_INITIAL_KEYS);
+    const int fast_id = ddtable_registry_add(registry, "cheap", cheap,
+                                             NULL, DEFAULT_INITIAL_KEYS);
+    int failed = (slow_id < 0 || fast_id < 0);
+    failed |= check_zero_results();
+
+    unsigned int num_wrong = 0;
+    double next_unique = 1e9;
+    for (int round = 0; !failed && round < DEFAULT_NUM_ROUNDS; round++)
+    {
+        for (int k = 0; k < DEFAULT_HOT_KEYS; k++)
+        {
+            num_wrong += (ddtable_registry_call(registry, slow_id, k) !=
+                          expensive(k, NULL));
+            num_wrong += (ddtable_registry_call(registry, fast_id,
+                                                next_unique) !=
+                          next_unique + 1);
+            next_unique++;
+        }
+    }
+
+    struct ddtable_registry_stats slow, fast;
+    failed |= ddtable_registry_get_stats(registry, slow_id, &slow) ||
+        ddtable_registry_get_stats(registry, fast_id, &fast);
+    if (!failed)
+    {
+        ddtable_registry_dump(registry, stdout);
+    }
+
+    // Memory moves to the table that saves recompute time, within budget
+    failed |= num_wrong || slow.bytes <= fast.bytes ||
+        ddtable_registry_bytes(registry) > DEFAULT_BUDGET_BYTES;
+
+    ddtable_registry_free(registry);
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
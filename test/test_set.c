@@ -0,0 +1,91 @@
+#include <stdlib.h>
+#include <stdio.h>
+
+#ifdef __CMAKE__
+#include "libddtable.h"
+#include "ddtable_set.h"
+#else
+#include "../src/libddtable.h"
+#include "../src/ddtable_set.h"
+#endif
+
+#define DEFAULT_NUM_KEYS 100000
+#define DEFAULT_RANDOM_SEED 42
+
+static int check_tiny_set(void)
+{
+    // Tiny sets scan linearly, so all 16 keys fit with no collisions
+    ddset_t tiny = ddset_new(16);
+    int failed = 0;
+    for (int k = 0; k < 16; k++)
+    {
+        failed |= (ddset_insert(tiny, k * 0.5) != 0);
+    }
+    failed |= (ddset_insert(tiny, 3.5) != 1);
+    failed |= ddset_contains(tiny, -1);
+
+    // Once full, new keys are dropped and every member stays contained
+    for (int k = 0; k < 64; k++)
+    {
+        failed |= (ddset_insert(tiny, 100 + k) != 2);
+        failed |= ddset_contains(tiny, 100 + k);
+    }
+    for (int k = 0; k < 16; k++)
+    {
+        failed |= !ddset_contains(tiny, k * 0.5);
+    }
+
+    ddset_clear(tiny);
+    failed |= ddset_contains(tiny, 0.5);
+    ddset_free(tiny);
+    return failed;
+}
+
+int main(void)
+{
+    const unsigned int num_keys = DEFAULT_NUM_KEYS;
+    srand(DEFAULT_RANDOM_SEED);
+
+    ddset_t set = ddset_new(4 * num_keys);
+    double* stream = malloc(num_keys * sizeof(double));
+    uint8_t* found = malloc(num_keys * sizeof(uint8_t));
+    int failed = (set == NULL || stream == NULL || found == NULL);
+
+    // A stream with plenty of duplicates; keep the first of each
+    unsigned int num_added = 0, num_dups = 0, num_collisions = 0;
+    for (unsigned int i = 0; !failed && i < num_keys; i++)
+    {
+        stream[i] = rand() % (num_keys / 2);
+        const int r = ddset_insert(set, stream[i]);
+        num_added += (r == 0);
+        num_dups += (r == 1);
+        num_collisions += (r == 2);
+        failed |= (r == 0 || r == 1) && !ddset_contains(set, stream[i]);
+    }
+
+    // Batch answers must match single lookups; absent keys are never found
+    const uint64_t num_found = failed ? 0
+        : ddset_contains_batch(set, stream, num_keys, found);
+    unsigned int num_wrong = 0;
+    for (unsigned int i = 0; !failed && i < num_keys; i++)
+    {
+        num_wrong += (found[i] != ddset_contains(set, stream[i]));
+        num_wrong += ddset_contains(set, -1.0 - i);
+    }
+
+    // Slots shrink from 16 + 1 bytes to 8 + 1 (key and stamp)
+    ddtable_t map = ddtable_new(4 * num_keys);
+    failed |= (17 * ddset_bytes(set) > 9 * ddtable_bytes(map) + 4096);
+    ddtable_free(map);
+
+    printf("Set: %u added, %u duplicates, %u collisions, %lu found, "
+           "%u wrong\n", num_added, num_dups, num_collisions,
+           (unsigned long) num_found, num_wrong);
+    failed |= num_wrong || num_found != num_keys - num_collisions;
+    failed |= check_tiny_set();
+
+    free(found);
+    free(stream);
+    ddset_free(set);
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
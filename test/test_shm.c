@@ -0,0 +1,115 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#ifdef __CMAKE__
+#include "libddtable.h"
+#include "ddtable_shm.h"
+#else
+#include "../src/libddtable.h"
+#include "../src/ddtable_shm.h"
+#endif
+
+#define DEFAULT_NUM_WORKERS 8
+#define DEFAULT_NUM_VALS 1000
+#define DDTABLE_SIZE 4096
+#define DDTABLE_SHM_NAME "/ddtable_test_shm"
+
+//! Value worker id stores for key k; the id is recoverable from it
+#define WORKER_VAL(k, id) ((k) * 100.0 + (id) + 1)
+
+/* Every worker races to insert the same keys; exactly one must win each.
+ * Wins are counted per key, across processes, in wins. */
+static void worker(ddtable_t ddtable, const int id, int* wins, int* winner)
+{
+    for (int i = 0; i < DEFAULT_NUM_VALS; i++)
+    {
+        const int k = (i + id * 7) % DEFAULT_NUM_VALS;
+        if (ddtable_shm_set_val(ddtable, k, WORKER_VAL(k, id)) == 0)
+        {
+            __atomic_add_fetch(&wins[k], 1, __ATOMIC_RELAXED);
+            __atomic_store_n(&winner[k], id, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+static int check_fork_pool(void)
+{
+    ddtable_t ddtable = ddtable_shm_new_anon(DDTABLE_SIZE);
+    int* wins = mmap(NULL, 2 * DEFAULT_NUM_VALS * sizeof(int),
+                     PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS,
+                     -1, 0);
+    if (ddtable == NULL || wins == MAP_FAILED)
+    {
+        return 1;
+    }
+    int* winner = wins + DEFAULT_NUM_VALS;
+
+    for (int id = 0; id < DEFAULT_NUM_WORKERS; id++)
+    {
+        const pid_t pid = fork();
+        if (pid == 0)
+        {
+            worker(ddtable, id, wins, winner);
+            _exit(EXIT_SUCCESS);
+        } else if (pid < 0) {
+            perror("Failure to fork: ");
+            return 1;
+        }
+    }
+    while (wait(NULL) > 0);
+
+    // A stored key was won exactly once, and holds its winner's value; a
+    // key lost to a collision was won by nobody
+    int num_found = 0;
+    int failed = 0;
+    for (int k = 0; k < DEFAULT_NUM_VALS; k++)
+    {
+        const double v = ddtable_shm_get_check_key(ddtable, k);
+        if ((v == 0 && wins[k] != 0) ||
+            (v != 0 && (wins[k] != 1 || v != WORKER_VAL(k, winner[k]))))
+        {
+            fprintf(stderr, "Key %d: value %f, %d wins\n", k, v, wins[k]);
+            failed = 1;
+        }
+        num_found += (v != 0);
+    }
+    printf("Keys inserted by %d processes: %d\n",
+           DEFAULT_NUM_WORKERS, num_found);
+    munmap(wins, 2 * DEFAULT_NUM_VALS * sizeof(int));
+    ddtable_shm_detach(ddtable);
+
+    return failed || (num_found == 0);
+}
+
+static int check_named(void)
+{
+    ddtable_shm_unlink(DDTABLE_SHM_NAME);
+    ddtable_t creator = ddtable_shm_open(DDTABLE_SHM_NAME, DDTABLE_SIZE);
+    ddtable_t attacher = ddtable_shm_open(DDTABLE_SHM_NAME, DDTABLE_SIZE);
+    if (creator == NULL || attacher == NULL || creator == attacher)
+    {
+        fputs("Could not create and attach named segment\n", stderr);
+        return 1;
+    }
+
+    ddtable_shm_set_val(creator, 42, 43);
+    const int failed = (ddtable_shm_get_check_key(attacher, 42) != 43);
+
+    ddtable_shm_detach(attacher);
+    ddtable_shm_detach(creator);
+    ddtable_shm_unlink(DDTABLE_SHM_NAME);
+
+    return failed;
+}
+
+int main(void)
+{
+    int failed = check_fork_pool();
+    failed |= check_named();
+    puts(failed ? "Shared tables: FAILED" : "Shared tables: OK");
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
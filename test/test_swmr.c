@@ -0,0 +1,72 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <pthread.h>
+
+#ifdef __CMAKE__
+#include "libddtable.h"
+#include "ddtable_swmr.h"
+#else
+#include "../src/libddtable.h"
+#include "../src/ddtable_swmr.h"
+#endif
+
+#define DEFAULT_NUM_READERS 4
+#define DEFAULT_NUM_ROUNDS 300
+#define DEFAULT_MAX_VAL 1000
+#define DDTABLE_SIZE 1024
+
+static ddtable_swmr_t swmr;
+static volatile int writer_done = 0;
+
+//! Values are always key + 1, so any other nonzero result is a torn read
+static void* reader(void* arg)
+{
+    long* num_bad = arg;
+    unsigned int k = 0;
+    while (!__atomic_load_n(&writer_done, __ATOMIC_ACQUIRE))
+    {
+        k = (k + 7) % DEFAULT_MAX_VAL;
+        const double v = ddtable_swmr_get_check_key(swmr, k);
+        *num_bad += (v != 0 && v != k + 1);
+    }
+    return NULL;
+}
+
+int main(void)
+{
+    swmr = ddtable_swmr_new(DDTABLE_SIZE);
+    pthread_t readers[DEFAULT_NUM_READERS];
+    long num_bad[DEFAULT_NUM_READERS] = { 0 };
+
+    for (int i = 0; i < DEFAULT_NUM_READERS; i++)
+    {
+        pthread_create(&readers[i], NULL, reader, &num_bad[i]);
+    }
+
+    // Fill, grow and clear repeatedly; the clears cross the stamp wraparound
+    for (int round = 0; round < DEFAULT_NUM_ROUNDS; round++)
+    {
+        for (int k = 0; k < DEFAULT_MAX_VAL; k++)
+        {
+            ddtable_swmr_set_val(swmr, (k * 31 + round) % DEFAULT_MAX_VAL,
+                                 (k * 31 + round) % DEFAULT_MAX_VAL + 1);
+        }
+        if (round % 50 == 0)
+        {
+            ddtable_swmr_grow(swmr, DDTABLE_SIZE << (round / 50));
+        }
+        ddtable_swmr_clear(swmr);
+    }
+    __atomic_store_n(&writer_done, 1, __ATOMIC_RELEASE);
+
+    long total_bad = 0;
+    for (int i = 0; i < DEFAULT_NUM_READERS; i++)
+    {
+        pthread_join(readers[i], NULL);
+        total_bad += num_bad[i];
+    }
+    ddtable_swmr_free(swmr);
+
+    printf("SWMR inconsistent reads: %ld\n", total_bad);
+    return total_bad ? EXIT_FAILURE : EXIT_SUCCESS;
+}
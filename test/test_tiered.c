@@ -0,0 +1,115 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#ifdef __CMAKE__
+#include "libddtable.h"
+#include "ddtable_tiered.h"
+#else
+#include "../src/libddtable.h"
+#include "../src/ddtable_tiered.h"
+#endif
+
+#define DEFAULT_NUM_KEYS 20000
+#define DEFAULT_HOT_KEYS 1024
+#define DEFAULT_SPILL_BATCH 2048
+
+/* With segment writes failing, evictions pile up in RAM only until their
+ * buffer is full; after that writes are refused rather than lost. */
+static int check_failing_flushes(void)
+{
+    ddtiered_t tiered = ddtiered_new(16, "/nonexistent/ddtiered-test", 8);
+    int stored[200];
+    unsigned int num_refused = 0;
+    int failed = (tiered == NULL);
+
+    for (int k = 0; !failed && k < 200; k++)
+    {
+        const int r = ddtiered_set_val(tiered, k, k + 1);
+        stored[k] = (r == 0);
+        num_refused += (r == -1);
+        failed |= (r != 0 && r != -1);
+    }
+    for (int k = 0; !failed && k < 200; k++)
+    {
+        failed |= stored[k] && (ddtiered_get_check_key(tiered, k) != k + 1);
+    }
+    failed |= (num_refused == 0);
+
+    ddtiered_free(tiered);
+    return failed;
+}
+
+int main(void)
+{
+    char cold_dir[] = "/tmp/ddtiered-test-XXXXXX";
+    if (mkdtemp(cold_dir) == NULL)
+    {
+        perror("Failure to create cold directory: ");
+        return EXIT_FAILURE;
+    }
+
+    ddtiered_t tiered = ddtiered_new(DEFAULT_HOT_KEYS, cold_dir,
+                                     DEFAULT_SPILL_BATCH);
+    int failed = (tiered == NULL);
+
+    // Far more keys than the hot tier holds, so most end up on disk
+    for (int k = 0; !failed && k < DEFAULT_NUM_KEYS; k++)
+    {
+        failed |= (ddtiered_set_val(tiered, k, (2.0 * k) + 1) != 0);
+    }
+
+    // Every key must come back, from whichever tier it landed in
+    unsigned int num_wrong = 0;
+    for (int k = 0; !failed && k < DEFAULT_NUM_KEYS; k++)
+    {
+        num_wrong += (ddtiered_get_check_key(tiered, k) != (2.0 * k) + 1);
+    }
+
+    // New values for keys that aren't hot shadow the old ones on disk, also
+    // once their segments are merged
+    double* want = malloc(DEFAULT_NUM_KEYS * sizeof(double));
+    failed |= (want == NULL);
+    for (int k = 0; !failed && k < DEFAULT_NUM_KEYS; k++)
+    {
+        want[k] = (ddtiered_set_val(tiered, k, 3.0 * k) == 0)
+            ? 3.0 * k : (2.0 * k) + 1;
+    }
+    failed |= (ddtiered_flush(tiered) != 0);
+    for (int k = 0; !failed && k < DEFAULT_NUM_KEYS; k++)
+    {
+        num_wrong += (ddtiered_get_check_key(tiered, k) != want[k]);
+    }
+    free(want);
+
+    // Absent keys should almost never reach a segment
+    unsigned int num_false = 0;
+    for (int k = DEFAULT_NUM_KEYS; !failed && k < 2 * DEFAULT_NUM_KEYS; k++)
+    {
+        num_false += (ddtiered_get_check_key(tiered, k) != 0);
+    }
+
+    struct ddtiered_stats stats = { 0 };
+    if (!failed)
+    {
+        ddtiered_get_stats(tiered, &stats);
+        printf("Tiered: %u wrong, %u false hits; hot %lu, cold %lu, "
+               "misses %lu, bloom skips %lu, segment probes %lu, "
+               "%lu segments, %lu compactions\n", num_wrong, num_false,
+               (unsigned long) stats.hot_hits, (unsigned long) stats.cold_hits,
+               (unsigned long) stats.misses, (unsigned long) stats.bloom_skips,
+               (unsigned long) stats.segment_probes,
+               (unsigned long) stats.num_segments,
+               (unsigned long) stats.compactions);
+    }
+    // Merging keeps the segment count logarithmic in the flushes
+    failed |= num_wrong || num_false || stats.num_segments == 0 ||
+        stats.num_segments > 8 || stats.compactions == 0 ||
+        stats.cold_hits == 0 || stats.bloom_skips < stats.segment_probes;
+    failed |= check_failing_flushes();
+
+    ddtiered_free(tiered);
+    failed |= (rmdir(cold_dir) != 0); // Fails if segments were left behind
+
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,52 @@
+#include <stdlib.h>
+#include <stdio.h>
+
+#ifdef __CMAKE__
+#include "libddtable.h"
+#include "ddtable_trace.h"
+#else
+#include "../src/libddtable.h"
+#include "../src/ddtable_trace.h"
+#endif
+
+#define DEFAULT_TRACE_PATH "test_trace.bin"
+#define DEFAULT_NUM_RECS 10000
+
+int main(int argc, char** argv)
+{
+    const char* path = (argc > 1) ? argv[1] : DEFAULT_TRACE_PATH;
+    remove(path);
+
+    if (ddtable_trace_open(path) != 0)
+    {
+        return EXIT_FAILURE;
+    }
+
+    // Records straddle several per-thread buffer flushes
+    for (int i = 0; i < DEFAULT_NUM_RECS; i++)
+    {
+        ddtable_trace_record(i % 3 ? DDTABLE_TRACE_GET_CHECK
+                             : DDTABLE_TRACE_SET, i * 0.5);
+    }
+    ddtable_trace_close();
+
+    struct ddtable_trace_rec* recs;
+    size_t num_recs;
+    if (ddtable_trace_load(path, &recs, &num_recs) != 0)
+    {
+        return EXIT_FAILURE;
+    }
+    remove(path);
+
+    int failed = (num_recs != DEFAULT_NUM_RECS);
+    for (size_t i = 0; !failed && i < num_recs; i++)
+    {
+        failed = recs[i].key != i * 0.5 ||
+            recs[i].op != (i % 3 ? DDTABLE_TRACE_GET_CHECK : DDTABLE_TRACE_SET);
+    }
+    free(recs);
+
+    printf("Trace round trip of %zu records: %s\n",
+           num_recs, failed ? "FAILED" : "OK");
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,69 @@
+#include <stdlib.h>
+#include <stdio.h>
+
+#ifdef __CMAKE__
+#include "libddtable.h"
+#include "ddtable_trace.h"
+#else
+#include "../src/libddtable.h"
+#include "../src/ddtable_trace.h"
+#endif
+
+#define DEFAULT_TRACE_PATH "test_trace_hooks.bin"
+#define DDTABLE_SIZE 1000
+
+int main(int argc, char** argv)
+{
+    const char* path = (argc > 1) ? argv[1] : DEFAULT_TRACE_PATH;
+    remove(path);
+
+    ddtable_t ddtable = ddtable_new(DDTABLE_SIZE);
+    ddtable_t untraced = ddtable_new(DDTABLE_SIZE);
+    if (ddtable_trace_open(path) != 0 ||
+        ddtable_trace_table(ddtable, 1) != 0)
+    {
+        fputs("Library built without DDTABLE_TRACE\n", stderr);
+        return EXIT_FAILURE;
+    }
+
+    // Only the traced table's operations show up, in call order
+    ddtable_set_val(ddtable, 1.5, 10);
+    ddtable_set_val(untraced, 7, 7);
+    ddtable_get_check_key(ddtable, 1.5);
+    ddtable_get_val(ddtable, 2.5);
+    ddtable_get_check_key(untraced, 7);
+    ddtable_clear(ddtable);
+    ddtable_trace_table(ddtable, 0);
+    ddtable_set_val(ddtable, 3.5, 1);
+    ddtable_trace_close();
+
+    const struct ddtable_trace_rec expected[] = {
+        { DDTABLE_TRACE_SET, 1.5 },
+        { DDTABLE_TRACE_GET_CHECK, 1.5 },
+        { DDTABLE_TRACE_GET, 2.5 },
+        { DDTABLE_TRACE_CLEAR, 0 }
+    };
+    const size_t num_expected = sizeof(expected) / sizeof(expected[0]);
+
+    struct ddtable_trace_rec* recs;
+    size_t num_recs;
+    if (ddtable_trace_load(path, &recs, &num_recs) != 0)
+    {
+        return EXIT_FAILURE;
+    }
+    remove(path);
+
+    int failed = (num_recs != num_expected);
+    for (size_t i = 0; !failed && i < num_recs; i++)
+    {
+        failed = recs[i].op != expected[i].op ||
+            recs[i].key != expected[i].key;
+    }
+    free(recs);
+    ddtable_free(untraced);
+    ddtable_free(ddtable);
+
+    printf("Trace hooks recorded %zu operations: %s\n",
+           num_recs, failed ? "FAILED" : "OK");
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
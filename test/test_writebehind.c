@@ -0,0 +1,137 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+#include <pthread.h>
+
+#ifdef __CMAKE__
+#include "libddtable.h"
+#include "ddtable_writebehind.h"
+#else
+#include "../src/libddtable.h"
+#include "../src/ddtable_writebehind.h"
+#endif
+
+#define NUM_PRODUCERS 4
+#define NUM_READERS 2
+#define KEYS_PER_PRODUCER 20000
+#define DDTABLE_SIZE (1 << 20)
+
+static ddtable_swmr_t swmr;
+static ddtable_wb_t wb;
+static volatile int producers_done = 0;
+
+//! Producer i queues keys i, i + NUM_PRODUCERS, ..., each mapping to key + 1
+static void* producer(void* arg)
+{
+    const long id = (long) arg;
+    for (long k = id; k < NUM_PRODUCERS * KEYS_PER_PRODUCER;
+         k += NUM_PRODUCERS)
+    {
+        while (ddtable_wb_set_val(wb, k, k + 1) != 0)
+        {
+            // Ring full: let the background thread catch up
+            const struct timespec pause = { 0, 10000 };
+            nanosleep(&pause, NULL);
+        }
+    }
+    return NULL;
+}
+
+//! A lookup sees either nothing or the applied pair, never anything else
+static void* reader(void* arg)
+{
+    long* num_bad = arg;
+    unsigned int k = 0;
+    while (!__atomic_load_n(&producers_done, __ATOMIC_ACQUIRE))
+    {
+        k = (k + 7919) % (NUM_PRODUCERS * KEYS_PER_PRODUCER);
+        const double v = ddtable_swmr_get_check_key(swmr, k);
+        *num_bad += (v != 0 && v != k + 1);
+    }
+    return NULL;
+}
+
+//! Without a background thread nothing is applied until the flush
+static int check_manual_flush(void)
+{
+    ddtable_swmr_t table = ddtable_swmr_new(4096);
+    ddtable_wb_t manual = ddtable_wb_new(table, 256, 0);
+    int failed = 0;
+
+    int num_full = 0;
+    for (int k = 1; k <= 300; k++)
+    {
+        num_full += ddtable_wb_set_val(manual, k, -k);
+    }
+    failed |= (num_full != 300 - 256);
+    failed |= (ddtable_swmr_get_check_key(table, 5) != 0);
+    failed |= (ddtable_wb_flush(manual) != 256);
+
+    struct ddtable_wb_stats stats;
+    ddtable_wb_get_stats(manual, &stats);
+    int num_found = 0;
+    for (int k = 1; k <= 256; k++)
+    {
+        num_found += (ddtable_swmr_get_check_key(table, k) == -k);
+    }
+    failed |= (num_found + stats.collisions != 256);
+    failed |= (stats.queued != 256 || stats.full != 300 - 256 ||
+               stats.applied != 256 || stats.batches != 1);
+
+    ddtable_wb_free(manual);
+    ddtable_swmr_free(table);
+    return failed;
+}
+
+int main(void)
+{
+    int failed = check_manual_flush();
+
+    swmr = ddtable_swmr_new(DDTABLE_SIZE);
+    wb = ddtable_wb_new(swmr, 1024, 50);
+    pthread_t producers[NUM_PRODUCERS];
+    pthread_t readers[NUM_READERS];
+    long num_bad[NUM_READERS] = { 0 };
+
+    for (long i = 0; i < NUM_READERS; i++)
+    {
+        pthread_create(&readers[i], NULL, reader, &num_bad[i]);
+    }
+    for (long i = 0; i < NUM_PRODUCERS; i++)
+    {
+        pthread_create(&producers[i], NULL, producer, (void*) i);
+    }
+    for (int i = 0; i < NUM_PRODUCERS; i++)
+    {
+        pthread_join(producers[i], NULL);
+    }
+    __atomic_store_n(&producers_done, 1, __ATOMIC_RELEASE);
+    long total_bad = 0;
+    for (int i = 0; i < NUM_READERS; i++)
+    {
+        pthread_join(readers[i], NULL);
+        total_bad += num_bad[i];
+    }
+    ddtable_wb_flush(wb);
+
+    // Every queued pair was applied: stored, or lost to a collision
+    struct ddtable_wb_stats stats;
+    ddtable_wb_get_stats(wb, &stats);
+    long num_found = 0;
+    for (long k = 0; k < NUM_PRODUCERS * KEYS_PER_PRODUCER; k++)
+    {
+        num_found += (ddtable_swmr_get_check_key(swmr, k) == k + 1);
+    }
+    printf("Write-behind: %lu queued in %lu batches, %ld found, "
+           "%lu collisions, %ld inconsistent reads\n",
+           (unsigned long) stats.queued, (unsigned long) stats.batches,
+           num_found, (unsigned long) stats.collisions, total_bad);
+    failed |= (total_bad != 0);
+    failed |= (stats.queued != NUM_PRODUCERS * KEYS_PER_PRODUCER);
+    failed |= (stats.applied != stats.queued);
+    failed |= (num_found + (long) stats.collisions != (long) stats.applied);
+
+    ddtable_wb_free(wb);
+    ddtable_swmr_free(swmr);
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
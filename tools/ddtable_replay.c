@@ -0,0 +1,144 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <inttypes.h>
+#include <time.h>
+
+#ifdef __CMAKE__
+#include "libddtable.h"
+#include "ddtable_trace.h"
+#include "ddtable_perf.h"
+#else
+#include "../src/libddtable.h"
+#include "../src/ddtable_trace.h"
+#include "../src/ddtable_perf.h"
+#endif
+
+#define DEFAULT_NUM_KEYS 2000
+#define DEFAULT_CACHE_BYTES 0
+#define DEFAULT_NUM_REPEATS 1
+
+//! Value stored for every traced set, so a nonzero get is always a hit
+#define REPLAY_VAL 1.0
+
+static inline double get_curr_secs(void)
+{
+    struct timespec ts;
+    if (clock_gettime(CLOCK_MONOTONIC, &ts) != 0)
+    {
+        perror("Failure to get current time: ");
+        return 0;
+    }
+    return ts.tv_sec + (ts.tv_nsec * 1e-9);
+}
+
+static void usage(const char* prog)
+{
+    fprintf(stderr, "Usage: %s TRACE [NUM_KEYS] [CACHE_BYTES] [REPEATS]\n"
+            "  NUM_KEYS     capacity passed to ddtable_new (default %d)\n"
+            "  CACHE_BYTES  front cache size, 0 for none (default %d)\n"
+            "  REPEATS      number of passes over the trace (default %d)\n",
+            prog, DEFAULT_NUM_KEYS, DEFAULT_CACHE_BYTES, DEFAULT_NUM_REPEATS);
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 2 || argc > 5)
+    {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    const uint64_t num_keys =
+        (argc > 2) ? strtoull(argv[2], NULL, 10) : DEFAULT_NUM_KEYS;
+    const uint64_t cache_bytes =
+        (argc > 3) ? strtoull(argv[3], NULL, 10) : DEFAULT_CACHE_BYTES;
+    const unsigned int num_repeats =
+        (argc > 4) ? strtoul(argv[4], NULL, 10) : DEFAULT_NUM_REPEATS;
+
+    struct ddtable_trace_rec* recs;
+    size_t num_recs;
+    if (ddtable_trace_load(argv[1], &recs, &num_recs) != 0)
+    {
+        return EXIT_FAILURE;
+    }
+
+    ddtable_t ddtable = ddtable_new(num_keys);
+    if (cache_bytes > 0 && ddtable_attach_cache(ddtable, cache_bytes) != 0)
+    {
+        fputs("Could not attach front cache\n", stderr);
+        return EXIT_FAILURE;
+    }
+
+    uint64_t num_gets = 0, num_hits = 0, num_sets = 0, num_collisions = 0;
+    volatile double sink = 0;
+    ddtable_perf_t perf = ddtable_perf_open();
+    struct ddtable_perf_counts counts = { { 0 }, 0 };
+
+    const double start_time = get_curr_secs();
+    DDTABLE_PERF_SCOPE(perf, &counts)
+    for (unsigned int r = 0; r < num_repeats; r++)
+    {
+        // Each pass starts from an empty table, like the traced process did
+        ddtable_clear(ddtable);
+        for (size_t i = 0; i < num_recs; i++)
+        {
+            const double key = recs[i].key;
+            double v;
+            switch (recs[i].op)
+            {
+            case DDTABLE_TRACE_GET:
+                v = ddtable_get_val(ddtable, key);
+                num_gets++;
+                num_hits += (v == REPLAY_VAL);
+                sink += v;
+                break;
+            case DDTABLE_TRACE_GET_CHECK:
+                v = ddtable_get_check_key(ddtable, key);
+                num_gets++;
+                num_hits += (v == REPLAY_VAL);
+                sink += v;
+                break;
+            case DDTABLE_TRACE_SET:
+                num_sets++;
+                num_collisions += ddtable_set_val(ddtable, key, REPLAY_VAL);
+                break;
+            case DDTABLE_TRACE_CLEAR:
+                ddtable_clear(ddtable);
+                break;
+            default:
+                fprintf(stderr, "Unknown trace op %u at record %zu\n",
+                        (unsigned int) recs[i].op, i);
+                return EXIT_FAILURE;
+            }
+        }
+    }
+    const double elapsed = get_curr_secs() - start_time;
+    const uint64_t num_ops = (uint64_t) num_recs * num_repeats;
+
+    printf("Records: %zu\tRepeats: %u\tNum keys: %"PRIu64
+           "\tCache bytes: %"PRIu64"\n",
+           num_recs, num_repeats, num_keys, cache_bytes);
+    printf("Elapsed: %.6f s\tThroughput: %.3f Mops/s\n",
+           elapsed, (elapsed > 0) ? num_ops / elapsed * 1e-6 : 0.0);
+    printf("Gets: %"PRIu64"\tHit rate: %.4f\n",
+           num_gets, num_gets ? (double) num_hits / num_gets : 0.0);
+    printf("Sets: %"PRIu64"\tCollisions: %"PRIu64"\n",
+           num_sets, num_collisions);
+    if (cache_bytes > 0)
+    {
+        uint64_t cache_lookups, cache_hits;
+        ddtable_get_cache_stats(ddtable, &cache_lookups, &cache_hits);
+        printf("Front cache hit rate: %.4f\n", cache_lookups ?
+               (double) cache_hits / cache_lookups : 0.0);
+    }
+    if (perf != NULL)
+    {
+        ddtable_perf_report(&counts, num_ops, "Counters:", stdout);
+    }
+
+    ddtable_perf_close(perf);
+    ddtable_free(ddtable);
+    free(recs);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,572 @@
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#ifdef __CMAKE__
+#include "libddtable.h"
+#include "ddtable_shm.h"
+#else
+#include "../src/libddtable.h"
+#include "../src/ddtable_shm.h"
+#endif
+
+#include "ddtabled.h"
+
+#define DEFAULT_NUM_KEYS (1 << 20)
+
+//! Stop reading from a client while this many reply bytes are unsent
+#define DDTABLED_WRITE_HIGH_WATER (4 << 20)
+
+//! How often idle shards check for shutdown
+#define DDTABLED_POLL_MS 200
+
+#define DDTABLED_MAX_EVENTS 64
+
+#ifndef EPOLLEXCLUSIVE
+#define EPOLLEXCLUSIVE 0
+#endif
+
+//! A hosted table; entries are only ever appended
+struct served_table
+{
+    char name[DDTABLED_MAX_NAME + 1];
+    char shm_name[sizeof(DDTABLED_SHM_PREFIX) + DDTABLED_MAX_NAME];
+    ddtable_t ddtable;
+};
+
+//! One client connection, owned by the shard that accepted it
+struct conn
+{
+    int fd;
+    //! Received bytes not yet parsed into whole requests
+    uint8_t* rbuf;
+    size_t rlen;
+    size_t rcap;
+    //! Replies not yet written; wbuf[woff, wlen) is pending
+    uint8_t* wbuf;
+    size_t woff;
+    size_t wlen;
+    size_t wcap;
+    //! Events currently registered with epoll
+    uint32_t events;
+};
+
+/* An event loop pinned to nothing but sized one per core: each shard has
+ * its own epoll set and serves the connections it accepted itself, so no
+ * lock is taken on the request path (the tables are safe for concurrent
+ * access across processes, let alone threads). */
+struct shard
+{
+    int epfd;
+    pthread_t thread;
+    uint64_t num_requests;
+    uint64_t num_keys;
+};
+
+static struct served_table tables[DDTABLED_MAX_TABLES];
+static uint32_t num_tables = 0;
+static pthread_mutex_t tables_lock = PTHREAD_MUTEX_INITIALIZER;
+static uint64_t default_num_keys = DEFAULT_NUM_KEYS;
+static int listen_fd = -1;
+static volatile sig_atomic_t stopping = 0;
+
+static void on_signal(int sig)
+{
+    (void) sig;
+    stopping = 1;
+}
+
+static int valid_name(const char* name, const size_t len)
+{
+    if (len == 0 || len > DDTABLED_MAX_NAME)
+    {
+        return 0;
+    }
+    for (size_t i = 0; i < len; i++)
+    {
+        const char c = name[i];
+        if (!((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+              (c >= '0' && c <= '9') || c == '_' || c == '-'))
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+//! Finds or creates the named table; its id, or -1 with *status set
+static int open_table(const char* name, const size_t len, uint64_t num_keys,
+                      uint8_t* status)
+{
+    if (!valid_name(name, len))
+    {
+        *status = DDTABLED_EBADREQ;
+        return -1;
+    }
+
+    int id = -1;
+    pthread_mutex_lock(&tables_lock);
+    for (uint32_t i = 0; i < num_tables && id < 0; i++)
+    {
+        if (strlen(tables[i].name) == len &&
+            memcmp(tables[i].name, name, len) == 0)
+        {
+            id = (int) i;
+        }
+    }
+    if (id < 0 && num_tables < DDTABLED_MAX_TABLES)
+    {
+        struct served_table* t = &tables[num_tables];
+        memcpy(t->name, name, len);
+        t->name[len] = '\0';
+        // valid_name bounded len, so both pieces fit (shm_name has room
+        // for the prefix's terminator)
+        const size_t prefix_len = sizeof(DDTABLED_SHM_PREFIX) - 1;
+        memcpy(t->shm_name, DDTABLED_SHM_PREFIX, prefix_len);
+        memcpy(t->shm_name + prefix_len, name, len);
+        t->shm_name[prefix_len + len] = '\0';
+        t->ddtable = ddtable_shm_open(t->shm_name,
+                                      num_keys ? num_keys : default_num_keys);
+        if (t->ddtable != NULL)
+        {
+            id = (int) num_tables;
+            __atomic_store_n(&num_tables, num_tables + 1, __ATOMIC_RELEASE);
+        }
+    }
+    pthread_mutex_unlock(&tables_lock);
+
+    *status = (id < 0) ? DDTABLED_ENOSPACE : DDTABLED_OK;
+    return id;
+}
+
+//! Table of an id sent by a client, or NULL
+static ddtable_t lookup_table(const uint32_t id)
+{
+    if (id >= __atomic_load_n(&num_tables, __ATOMIC_ACQUIRE))
+    {
+        return NULL;
+    }
+    return tables[id].ddtable;
+}
+
+//! Makes room for len more reply bytes; NULL if memory ran out
+static uint8_t* reply_space(struct conn* c, const size_t len)
+{
+    if (c->woff > 0 && c->woff == c->wlen)
+    {
+        c->woff = c->wlen = 0;
+    }
+    if (c->wlen + len > c->wcap)
+    {
+        size_t cap = c->wcap ? c->wcap : 4096;
+        while (cap < c->wlen + len)
+        {
+            cap *= 2;
+        }
+        uint8_t* wbuf = realloc(c->wbuf, cap);
+        if (wbuf == NULL)
+        {
+            return NULL;
+        }
+        c->wbuf = wbuf;
+        c->wcap = cap;
+    }
+    uint8_t* at = c->wbuf + c->wlen;
+    c->wlen += len;
+    return at;
+}
+
+/* Serves one whole request whose payload follows hdr. Returns 0, or -1 if
+ * the connection should be dropped. */
+static int serve_request(struct shard* shard, struct conn* c,
+                         const struct ddtabled_hdr* hdr,
+                         const uint8_t* payload)
+{
+    struct ddtabled_hdr reply = *hdr;
+    reply.length = 0;
+    reply.status = DDTABLED_OK;
+    reply.reserved = 0;
+
+    ddtable_t ddtable = NULL;
+    if (hdr->op == DDTABLED_GET || hdr->op == DDTABLED_SET)
+    {
+        const size_t per_key = (hdr->op == DDTABLED_GET) ? 1 : 2;
+        ddtable = lookup_table(hdr->table);
+        if (hdr->count > DDTABLED_MAX_BATCH ||
+            hdr->length != hdr->count * per_key * sizeof(double))
+        {
+            reply.status = DDTABLED_EBADREQ;
+        } else if (ddtable == NULL) {
+            reply.status = DDTABLED_ENOTABLE;
+        }
+    }
+
+    const uint32_t count = hdr->count;
+    switch ((reply.status == DDTABLED_OK) ? hdr->op : 0)
+    {
+    case DDTABLED_OPEN:
+    {
+        uint64_t num_keys;
+        if (hdr->length < sizeof(uint64_t))
+        {
+            reply.status = DDTABLED_EBADREQ;
+            break;
+        }
+        memcpy(&num_keys, payload, sizeof(uint64_t));
+        const int id = open_table((const char*) payload + sizeof(uint64_t),
+                                  hdr->length - sizeof(uint64_t), num_keys,
+                                  &reply.status);
+        reply.table = (id < 0) ? UINT32_MAX : (uint32_t) id;
+        break;
+    }
+    case DDTABLED_GET:
+    {
+        reply.length = count * sizeof(double);
+        uint8_t* at = reply_space(c, sizeof(reply) + reply.length);
+        if (at == NULL)
+        {
+            return -1;
+        }
+        memcpy(at, &reply, sizeof(reply));
+        uint8_t* vals = at + sizeof(reply);
+        for (uint32_t i = 0; i < count; i++)
+        {
+            double key;
+            memcpy(&key, payload + (i * sizeof(double)), sizeof(double));
+            const double val = ddtable_shm_get_check_key(ddtable, key);
+            memcpy(vals + (i * sizeof(double)), &val, sizeof(double));
+        }
+        shard->num_requests++;
+        shard->num_keys += count;
+        return 0;
+    }
+    case DDTABLED_SET:
+    {
+        const uint8_t* vals = payload + (count * sizeof(double));
+        uint32_t num_collisions = 0;
+        for (uint32_t i = 0; i < count; i++)
+        {
+            double key, val;
+            memcpy(&key, payload + (i * sizeof(double)), sizeof(double));
+            memcpy(&val, vals + (i * sizeof(double)), sizeof(double));
+            num_collisions += ddtable_shm_set_val(ddtable, key, val);
+        }
+        reply.count = num_collisions;
+        shard->num_requests++;
+        shard->num_keys += count;
+        break;
+    }
+    default:
+        if (reply.status == DDTABLED_OK)
+        {
+            reply.status = DDTABLED_EBADREQ;
+        }
+        break;
+    }
+
+    uint8_t* at = reply_space(c, sizeof(reply));
+    if (at == NULL)
+    {
+        return -1;
+    }
+    memcpy(at, &reply, sizeof(reply));
+    return 0;
+}
+
+//! Serves every whole request buffered so far; -1 to drop the connection
+static int serve_buffered(struct shard* shard, struct conn* c)
+{
+    size_t off = 0;
+    while (c->rlen - off >= sizeof(struct ddtabled_hdr))
+    {
+        struct ddtabled_hdr hdr;
+        memcpy(&hdr, c->rbuf + off, sizeof(hdr));
+        if (hdr.length > DDTABLED_MAX_PAYLOAD + sizeof(uint64_t) +
+            DDTABLED_MAX_NAME)
+        {
+            return -1; // Can't even skip it safely
+        }
+        if (c->rlen - off < sizeof(hdr) + hdr.length)
+        {
+            break;
+        }
+        if (serve_request(shard, c, &hdr, c->rbuf + off + sizeof(hdr)) != 0)
+        {
+            return -1;
+        }
+        off += sizeof(hdr) + hdr.length;
+    }
+    memmove(c->rbuf, c->rbuf + off, c->rlen - off);
+    c->rlen -= off;
+    return 0;
+}
+
+//! Writes out pending replies; -1 on a write error
+static int flush_replies(struct conn* c)
+{
+    while (c->woff < c->wlen)
+    {
+        const ssize_t n = send(c->fd, c->wbuf + c->woff, c->wlen - c->woff,
+                               MSG_NOSIGNAL);
+        if (n < 0)
+        {
+            return (errno == EAGAIN || errno == EWOULDBLOCK ||
+                    errno == EINTR) ? 0 : -1;
+        }
+        c->woff += (size_t) n;
+    }
+    return 0;
+}
+
+//! Reads what the socket has; -1 once the client hung up or on an error
+static int fill_requests(struct conn* c)
+{
+    for (;;)
+    {
+        if (c->rcap - c->rlen < 4096)
+        {
+            const size_t cap = c->rcap ? 2 * c->rcap : 65536;
+            uint8_t* rbuf = realloc(c->rbuf, cap);
+            if (rbuf == NULL)
+            {
+                return -1;
+            }
+            c->rbuf = rbuf;
+            c->rcap = cap;
+        }
+        const ssize_t n = recv(c->fd, c->rbuf + c->rlen, c->rcap - c->rlen, 0);
+        if (n > 0)
+        {
+            c->rlen += (size_t) n;
+            // Leave the rest for the next wakeup once a batch is buffered
+            if (c->rlen >= c->rcap / 2)
+            {
+                return 0;
+            }
+        } else if (n == 0) {
+            return -1;
+        } else {
+            return (errno == EAGAIN || errno == EWOULDBLOCK ||
+                    errno == EINTR) ? 0 : -1;
+        }
+    }
+}
+
+static void close_conn(struct shard* shard, struct conn* c)
+{
+    epoll_ctl(shard->epfd, EPOLL_CTL_DEL, c->fd, NULL);
+    close(c->fd);
+    free(c->rbuf);
+    free(c->wbuf);
+    free(c);
+}
+
+/* Registers interest in reading unless too many replies are unsent (the
+ * client isn't reading them), and in writing while any are. */
+static void update_events(struct shard* shard, struct conn* c)
+{
+    const size_t unsent = c->wlen - c->woff;
+    uint32_t events = 0;
+    if (unsent < DDTABLED_WRITE_HIGH_WATER)
+    {
+        events |= EPOLLIN;
+    }
+    if (unsent > 0)
+    {
+        events |= EPOLLOUT;
+    }
+    if (events != c->events)
+    {
+        struct epoll_event ev;
+        ev.events = events;
+        ev.data.ptr = c;
+        epoll_ctl(shard->epfd, EPOLL_CTL_MOD, c->fd, &ev);
+        c->events = events;
+    }
+}
+
+static void accept_conns(struct shard* shard)
+{
+    for (;;)
+    {
+        const int fd = accept4(listen_fd, NULL, NULL, SOCK_NONBLOCK);
+        if (fd < 0)
+        {
+            return; // EAGAIN, or another shard got there first
+        }
+        struct conn* c = calloc(1, sizeof(struct conn));
+        if (c == NULL)
+        {
+            close(fd);
+            continue;
+        }
+        c->fd = fd;
+        c->events = EPOLLIN;
+        struct epoll_event ev;
+        ev.events = c->events;
+        ev.data.ptr = c;
+        if (epoll_ctl(shard->epfd, EPOLL_CTL_ADD, fd, &ev) != 0)
+        {
+            close(fd);
+            free(c);
+        }
+    }
+}
+
+static void* shard_main(void* arg)
+{
+    struct shard* shard = arg;
+    struct epoll_event events[DDTABLED_MAX_EVENTS];
+
+    while (!stopping)
+    {
+        const int n = epoll_wait(shard->epfd, events, DDTABLED_MAX_EVENTS,
+                                 DDTABLED_POLL_MS);
+        for (int e = 0; e < n; e++)
+        {
+            struct conn* c = events[e].data.ptr;
+            if (c == NULL)
+            {
+                accept_conns(shard);
+                continue;
+            }
+
+            int failed = (events[e].events & EPOLLERR) != 0;
+            int hung_up = 0;
+            if (!failed && (events[e].events & (EPOLLIN | EPOLLHUP)))
+            {
+                // Answer what arrived even if the client then hung up
+                hung_up = fill_requests(c) != 0;
+                failed = serve_buffered(shard, c) != 0;
+            }
+            if (!failed)
+            {
+                failed = flush_replies(c) != 0;
+            }
+            if (failed || hung_up)
+            {
+                close_conn(shard, c);
+            } else {
+                update_events(shard, c);
+            }
+        }
+    }
+    return NULL;
+}
+
+static void usage(const char* prog)
+{
+    fprintf(stderr, "Usage: %s SOCKET [SHARDS] [NUM_KEYS]\n"
+            "  SOCKET    Unix domain socket path to listen on\n"
+            "  SHARDS    event loop threads, 0 for one per CPU (default 0)\n"
+            "  NUM_KEYS  capacity of tables opened without one (default %d)\n",
+            prog, DEFAULT_NUM_KEYS);
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 2 || argc > 4)
+    {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    const char* path = argv[1];
+    unsigned int num_shards = (argc > 2) ? strtoul(argv[2], NULL, 10) : 0;
+    if (argc > 3)
+    {
+        default_num_keys = strtoull(argv[3], NULL, 10);
+    }
+    if (num_shards == 0)
+    {
+        const long online = sysconf(_SC_NPROCESSORS_ONLN);
+        num_shards = (online > 0) ? (unsigned int) online : 1;
+    }
+
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path))
+    {
+        fprintf(stderr, "Socket path too long: %s\n", path);
+        return EXIT_FAILURE;
+    }
+    strcpy(addr.sun_path, path);
+
+    listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    unlink(path);
+    if (listen_fd < 0 ||
+        bind(listen_fd, (struct sockaddr*) &addr, sizeof(addr)) != 0 ||
+        listen(listen_fd, SOMAXCONN) != 0)
+    {
+        perror("Failure to listen: ");
+        return EXIT_FAILURE;
+    }
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_signal;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    struct shard* shards = calloc(num_shards, sizeof(struct shard));
+    unsigned int num_started = 0;
+    for (unsigned int s = 0; shards != NULL && s < num_shards; s++)
+    {
+        // Every shard watches the listening socket and accepts for itself;
+        // EPOLLEXCLUSIVE wakes just one of them per incoming connection
+        struct epoll_event ev;
+        ev.events = EPOLLIN | EPOLLEXCLUSIVE;
+        ev.data.ptr = NULL;
+        shards[s].epfd = epoll_create1(0);
+        if (shards[s].epfd < 0 ||
+            epoll_ctl(shards[s].epfd, EPOLL_CTL_ADD, listen_fd, &ev) != 0 ||
+            pthread_create(&shards[s].thread, NULL, shard_main,
+                           &shards[s]) != 0)
+        {
+            perror("Failure to start shard: ");
+            stopping = 1;
+            break;
+        }
+        num_started++;
+    }
+    if (num_started == num_shards)
+    {
+        printf("Serving on %s with %u shards\n", path, num_shards);
+        fflush(stdout);
+    }
+
+    uint64_t num_requests = 0, num_keys = 0;
+    for (unsigned int s = 0; s < num_started; s++)
+    {
+        pthread_join(shards[s].thread, NULL);
+        num_requests += shards[s].num_requests;
+        num_keys += shards[s].num_keys;
+    }
+    // Connections still open are simply dropped along with the process
+
+    printf("Served %llu requests, %llu keys\n",
+           (unsigned long long) num_requests, (unsigned long long) num_keys);
+    for (uint32_t i = 0; i < num_tables; i++)
+    {
+        ddtable_shm_detach(tables[i].ddtable);
+        ddtable_shm_unlink(tables[i].shm_name);
+    }
+    for (unsigned int s = 0; s < num_started; s++)
+    {
+        close(shards[s].epfd);
+    }
+    free(shards);
+    close(listen_fd);
+    unlink(path);
+    return (num_started == num_shards) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
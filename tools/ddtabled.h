@@ -0,0 +1,73 @@
+#ifndef DDTABLED_H
+#define DDTABLED_H
+
+#include <stdint.h>
+
+/* Wire protocol of ddtabled, the local table server.
+ *
+ * Every message is a fixed header followed by length bytes of payload, in
+ * host byte order (client and server share the host). A client may send
+ * any number of requests before reading replies; each connection's replies
+ * come back in request order, carrying the request's tag.
+ *
+ *   OPEN   payload: uint64_t num_keys, then the table name (not
+ *          terminated). Creates the table if needed; the reply's table
+ *          field holds its id for later requests.
+ *   GET    payload: count keys. Reply payload: count values, where
+ *          DDTABLE_NULL_VAL (0.0) means a miss, as ddtable_get_check_key.
+ *   SET    payload: count keys, then count values. Reply count: how many
+ *          pairs collided, as ddtable_set_val.
+ *
+ * Memoizing through the server is a GET, computing the misses locally and
+ * a SET of those, pipelined behind the next GET. Served tables live in
+ * shared memory named DDTABLED_SHM_PREFIX plus the table name, so C
+ * clients on the host can also ddtable_shm_attach them and skip the
+ * socket entirely. */
+
+//! Most keys one request may carry
+#define DDTABLED_MAX_BATCH 65536
+
+//! Longest table name, which may use [A-Za-z0-9_-] only
+#define DDTABLED_MAX_NAME 64
+
+//! Most tables one server hosts
+#define DDTABLED_MAX_TABLES 64
+
+#define DDTABLED_SHM_PREFIX "/ddtabled."
+
+enum ddtabled_op
+{
+    DDTABLED_OPEN = 1,
+    DDTABLED_GET = 2,
+    DDTABLED_SET = 3
+};
+
+enum ddtabled_status
+{
+    DDTABLED_OK = 0,
+    //! Malformed request: unknown op, bad length, count or name
+    DDTABLED_EBADREQ = 1,
+    //! No table with that id
+    DDTABLED_ENOTABLE = 2,
+    //! The table could not be created (table limit or shared memory)
+    DDTABLED_ENOSPACE = 3
+};
+
+struct ddtabled_hdr
+{
+    //! Payload bytes following the header
+    uint32_t length;
+    uint8_t op;
+    //! ddtabled_status in replies, 0 in requests
+    uint8_t status;
+    uint16_t reserved;
+    uint32_t table;
+    uint32_t count;
+    //! Chosen by the client and echoed in the reply
+    uint64_t tag;
+};
+
+//! Largest payload of a valid request (a full SET)
+#define DDTABLED_MAX_PAYLOAD (DDTABLED_MAX_BATCH * 2 * sizeof(double))
+
+#endif
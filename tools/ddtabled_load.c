@@ -0,0 +1,388 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "ddtabled.h"
+
+#define DEFAULT_NUM_CONNS 4
+#define DEFAULT_BATCH 256
+#define DEFAULT_DEPTH 4
+#define DEFAULT_SECONDS 5
+#define DEFAULT_NUM_KEYS (1 << 20)
+#define DEFAULT_SET_PERCENT 10
+
+//! Table every connection of a run works on
+#define LOAD_TABLE_NAME "ddtabled_load"
+
+//! Value stored for key, so any hit can be checked
+#define LOAD_VAL(key) ((key) * 0.5 + 1.0)
+
+struct load_conn
+{
+    pthread_t thread;
+    const char* path;
+    unsigned int id;
+    //! Latency of every completed request, in ns
+    uint64_t* latencies;
+    uint64_t num_done;
+    uint64_t capacity;
+    uint64_t num_keys_done;
+    uint64_t num_gets;
+    uint64_t num_hits;
+    //! Hits whose value isn't LOAD_VAL(key), or failed replies
+    uint64_t num_errors;
+    int started;
+    int failed;
+};
+
+static unsigned int batch = DEFAULT_BATCH;
+static unsigned int depth = DEFAULT_DEPTH;
+static double seconds = DEFAULT_SECONDS;
+static uint64_t num_keys = DEFAULT_NUM_KEYS;
+static unsigned int set_percent = DEFAULT_SET_PERCENT;
+
+static inline uint64_t get_curr_ns(void)
+{
+    struct timespec ts;
+    if (clock_gettime(CLOCK_MONOTONIC, &ts) != 0)
+    {
+        perror("Failure to get current time: ");
+        return 0;
+    }
+    return (uint64_t) ts.tv_sec * 1000000000 + (uint64_t) ts.tv_nsec;
+}
+
+static inline uint64_t xorshift64(uint64_t* state)
+{
+    uint64_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    return *state = x;
+}
+
+static int write_all(const int fd, const void* buf, size_t len)
+{
+    const uint8_t* at = buf;
+    while (len > 0)
+    {
+        const ssize_t n = send(fd, at, len, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n <= 0)
+        {
+            return -1;
+        }
+        at += n;
+        len -= (size_t) n;
+    }
+    return 0;
+}
+
+static int read_all(const int fd, void* buf, size_t len)
+{
+    uint8_t* at = buf;
+    while (len > 0)
+    {
+        const ssize_t n = recv(fd, at, len, 0);
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n <= 0)
+        {
+            return -1;
+        }
+        at += n;
+        len -= (size_t) n;
+    }
+    return 0;
+}
+
+//! In-flight request: what was asked and when
+struct pending
+{
+    uint64_t sent_ns;
+    double* keys;
+};
+
+/* Sends one random GET or SET batch. Keys are drawn from twice the table
+ * capacity, so lookups miss as well as hit. */
+static int send_batch(const int fd, const uint32_t table, struct pending* p,
+                      uint64_t* rng, uint8_t* buf, const uint64_t tag)
+{
+    struct ddtabled_hdr hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.op = (xorshift64(rng) % 100 < set_percent) ? DDTABLED_SET
+                                                  : DDTABLED_GET;
+    hdr.table = table;
+    hdr.count = batch;
+    hdr.tag = tag;
+    hdr.length = batch * sizeof(double) * ((hdr.op == DDTABLED_SET) ? 2 : 1);
+
+    for (unsigned int i = 0; i < batch; i++)
+    {
+        p->keys[i] = (double) (xorshift64(rng) % (2 * num_keys));
+    }
+    memcpy(buf, &hdr, sizeof(hdr));
+    memcpy(buf + sizeof(hdr), p->keys, batch * sizeof(double));
+    if (hdr.op == DDTABLED_SET)
+    {
+        double* vals = (double*) (buf + sizeof(hdr) + batch * sizeof(double));
+        for (unsigned int i = 0; i < batch; i++)
+        {
+            vals[i] = LOAD_VAL(p->keys[i]);
+        }
+    }
+    p->sent_ns = get_curr_ns();
+    return write_all(fd, buf, sizeof(hdr) + hdr.length);
+}
+
+//! Opens the shared table; its id, or UINT32_MAX
+static uint32_t open_table(const int fd)
+{
+    const size_t name_len = strlen(LOAD_TABLE_NAME);
+    uint8_t buf[sizeof(struct ddtabled_hdr) + sizeof(uint64_t) +
+                DDTABLED_MAX_NAME];
+    struct ddtabled_hdr hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.op = DDTABLED_OPEN;
+    hdr.length = sizeof(uint64_t) + name_len;
+    memcpy(buf, &hdr, sizeof(hdr));
+    memcpy(buf + sizeof(hdr), &num_keys, sizeof(uint64_t));
+    memcpy(buf + sizeof(hdr) + sizeof(uint64_t), LOAD_TABLE_NAME, name_len);
+
+    if (write_all(fd, buf, sizeof(hdr) + hdr.length) != 0 ||
+        read_all(fd, &hdr, sizeof(hdr)) != 0 || hdr.status != DDTABLED_OK)
+    {
+        return UINT32_MAX;
+    }
+    return hdr.table;
+}
+
+//! Keeps depth batches in flight on one connection until time runs out
+static void* conn_main(void* arg)
+{
+    struct load_conn* lc = arg;
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, lc->path, sizeof(addr.sun_path) - 1);
+
+    const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr*) &addr, sizeof(addr)) != 0)
+    {
+        perror("Failure to connect: ");
+        lc->failed = 1;
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+        return NULL;
+    }
+
+    const uint32_t table = open_table(fd);
+    struct pending* pending = calloc(depth, sizeof(struct pending));
+    uint8_t* buf = malloc(sizeof(struct ddtabled_hdr) +
+                          2 * batch * sizeof(double));
+    double* vals = malloc(batch * sizeof(double));
+    int failed = (table == UINT32_MAX || pending == NULL || buf == NULL ||
+                  vals == NULL);
+    for (unsigned int d = 0; !failed && d < depth; d++)
+    {
+        pending[d].keys = malloc(batch * sizeof(double));
+        failed = (pending[d].keys == NULL);
+    }
+
+    uint64_t rng = 0x9e3779b97f4a7c15ULL * (lc->id + 1);
+    uint64_t num_sent = 0;
+    const uint64_t end_ns = get_curr_ns() + (uint64_t) (seconds * 1e9);
+    for (; !failed && num_sent < depth; num_sent++)
+    {
+        failed = send_batch(fd, table, &pending[num_sent], &rng, buf,
+                            num_sent) != 0;
+    }
+
+    // Replies come back in order, so the oldest request is always next
+    while (!failed && lc->num_done < num_sent)
+    {
+        struct ddtabled_hdr hdr;
+        struct pending* p = &pending[lc->num_done % depth];
+        if (read_all(fd, &hdr, sizeof(hdr)) != 0 ||
+            hdr.tag != lc->num_done || hdr.length > batch * sizeof(double) ||
+            read_all(fd, vals, hdr.length) != 0)
+        {
+            failed = 1;
+            break;
+        }
+        const uint64_t now = get_curr_ns();
+        lc->num_errors += (hdr.status != DDTABLED_OK);
+        if (hdr.op == DDTABLED_GET && hdr.status == DDTABLED_OK)
+        {
+            for (unsigned int i = 0; i < batch; i++)
+            {
+                if (vals[i] != 0)
+                {
+                    lc->num_hits++;
+                    lc->num_errors += (vals[i] != LOAD_VAL(p->keys[i]));
+                }
+            }
+            lc->num_gets += batch;
+        }
+
+        if (lc->num_done == lc->capacity)
+        {
+            lc->capacity = lc->capacity ? 2 * lc->capacity : 65536;
+            uint64_t* latencies = realloc(lc->latencies,
+                                          lc->capacity * sizeof(uint64_t));
+            if (latencies == NULL)
+            {
+                failed = 1;
+                break;
+            }
+            lc->latencies = latencies;
+        }
+        lc->latencies[lc->num_done++] = now - p->sent_ns;
+        lc->num_keys_done += batch;
+
+        if (now < end_ns)
+        {
+            failed = send_batch(fd, table, p, &rng, buf, num_sent++) != 0;
+        }
+    }
+
+    for (unsigned int d = 0; pending != NULL && d < depth; d++)
+    {
+        free(pending[d].keys);
+    }
+    free(pending);
+    free(vals);
+    free(buf);
+    close(fd);
+    lc->failed = failed;
+    return NULL;
+}
+
+static int cmp_u64(const void* a, const void* b)
+{
+    const uint64_t x = *(const uint64_t*) a;
+    const uint64_t y = *(const uint64_t*) b;
+    return (x > y) - (x < y);
+}
+
+static void usage(const char* prog)
+{
+    fprintf(stderr, "Usage: %s SOCKET [CONNS] [BATCH] [DEPTH] [SECONDS] "
+            "[NUM_KEYS] [SET_PERCENT]\n"
+            "  CONNS        client connections, one thread each (default %d)\n"
+            "  BATCH        keys per request, at most %d (default %d)\n"
+            "  DEPTH        requests in flight per connection (default %d)\n"
+            "  SECONDS      how long to keep sending (default %d)\n"
+            "  NUM_KEYS     table capacity; keys span twice that "
+            "(default %d)\n"
+            "  SET_PERCENT  share of requests that are SETs (default %d)\n",
+            prog, DEFAULT_NUM_CONNS, DDTABLED_MAX_BATCH, DEFAULT_BATCH,
+            DEFAULT_DEPTH, DEFAULT_SECONDS, DEFAULT_NUM_KEYS,
+            DEFAULT_SET_PERCENT);
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 2 || argc > 8)
+    {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    const unsigned int num_conns =
+        (argc > 2) ? strtoul(argv[2], NULL, 10) : DEFAULT_NUM_CONNS;
+    batch = (argc > 3) ? strtoul(argv[3], NULL, 10) : DEFAULT_BATCH;
+    depth = (argc > 4) ? strtoul(argv[4], NULL, 10) : DEFAULT_DEPTH;
+    seconds = (argc > 5) ? strtod(argv[5], NULL) : DEFAULT_SECONDS;
+    num_keys = (argc > 6) ? strtoull(argv[6], NULL, 10) : DEFAULT_NUM_KEYS;
+    set_percent = (argc > 7) ? strtoul(argv[7], NULL, 10) : DEFAULT_SET_PERCENT;
+    if (num_conns == 0 || batch == 0 || batch > DDTABLED_MAX_BATCH ||
+        depth == 0 || num_keys == 0)
+    {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    struct load_conn* conns = calloc(num_conns, sizeof(struct load_conn));
+    if (conns == NULL)
+    {
+        return EXIT_FAILURE;
+    }
+    const uint64_t start_ns = get_curr_ns();
+    for (unsigned int i = 0; i < num_conns; i++)
+    {
+        conns[i].path = argv[1];
+        conns[i].id = i;
+        conns[i].started =
+            (pthread_create(&conns[i].thread, NULL, conn_main, &conns[i]) == 0);
+        conns[i].failed = !conns[i].started;
+    }
+
+    uint64_t num_requests = 0, num_done_keys = 0, num_gets = 0;
+    uint64_t num_hits = 0, num_errors = 0;
+    int failed = 0;
+    for (unsigned int i = 0; i < num_conns; i++)
+    {
+        if (conns[i].started)
+        {
+            pthread_join(conns[i].thread, NULL);
+        }
+        num_requests += conns[i].num_done;
+        num_done_keys += conns[i].num_keys_done;
+        num_gets += conns[i].num_gets;
+        num_hits += conns[i].num_hits;
+        num_errors += conns[i].num_errors;
+        failed |= conns[i].failed;
+    }
+    const double elapsed = (get_curr_ns() - start_ns) * 1e-9;
+
+    uint64_t* latencies = malloc((num_requests + 1) * sizeof(uint64_t));
+    uint64_t n = 0;
+    for (unsigned int i = 0; latencies != NULL && i < num_conns; i++)
+    {
+        memcpy(&latencies[n], conns[i].latencies,
+               conns[i].num_done * sizeof(uint64_t));
+        n += conns[i].num_done;
+    }
+    if (n > 0)
+    {
+        qsort(latencies, n, sizeof(uint64_t), cmp_u64);
+    }
+
+    printf("Connections: %u\tBatch: %u\tDepth: %u\tSets: %u%%\n",
+           num_conns, batch, depth, set_percent);
+    printf("Elapsed: %.3f s\tRequests: %llu (%.0f/s)\tKeys: %.3f Mops/s\n",
+           elapsed, (unsigned long long) num_requests,
+           elapsed > 0 ? num_requests / elapsed : 0.0,
+           elapsed > 0 ? num_done_keys / elapsed * 1e-6 : 0.0);
+    if (n > 0)
+    {
+        printf("Latency (us): p50 %.1f\tp99 %.1f\tp99.9 %.1f\tmax %.1f\n",
+               latencies[n / 2] * 1e-3, latencies[(n * 99) / 100] * 1e-3,
+               latencies[(n * 999) / 1000] * 1e-3, latencies[n - 1] * 1e-3);
+    }
+    printf("Gets: %llu\tHit rate: %.4f\tErrors: %llu\n",
+           (unsigned long long) num_gets,
+           num_gets ? (double) num_hits / num_gets : 0.0,
+           (unsigned long long) num_errors);
+
+    free(latencies);
+    for (unsigned int i = 0; i < num_conns; i++)
+    {
+        free(conns[i].latencies);
+    }
+    free(conns);
+    return (failed || num_errors) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,45 @@
+#!/bin/sh
+# Starts ddtabled on a temporary socket, drives it with ddtabled_load and
+# checks that SIGTERM shuts it down cleanly.
+#
+# Usage: ddtabled_test.sh DDTABLED DDTABLED_LOAD
+
+server="$1"
+load="$2"
+dir=$(mktemp -d) || exit 1
+sock="$dir/ddtabled.sock"
+trap 'kill "$pid" 2>/dev/null; rm -rf "$dir"' EXIT
+
+"$server" "$sock" 2 > "$dir/server.log" 2>&1 &
+pid=$!
+
+# Wait up to 5 s for the socket to appear
+tries=0
+while [ ! -S "$sock" ]; do
+    tries=$((tries + 1))
+    if [ "$tries" -gt 50 ] || ! kill -0 "$pid" 2>/dev/null; then
+        echo "ddtabled did not start"
+        cat "$dir/server.log"
+        exit 1
+    fi
+    sleep 0.1
+done
+
+if ! "$load" "$sock" 2 256 4 1 65536 20; then
+    echo "ddtabled_load failed"
+    exit 1
+fi
+
+kill -TERM "$pid"
+wait "$pid"
+status=$?
+cat "$dir/server.log"
+if [ "$status" -ne 0 ]; then
+    echo "ddtabled exited with status $status after SIGTERM"
+    exit 1
+fi
+if [ -e "$sock" ] || [ -e /dev/shm/ddtabled.ddtabled_load ]; then
+    echo "ddtabled left its socket or shared memory behind"
+    exit 1
+fi
+echo "ddtabled: OK"